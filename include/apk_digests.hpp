@@ -0,0 +1,107 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "local_zip.hpp"
+
+/*
+ * Calculates digests of an APK, which are signed by APK Signature Scheme v1
+ * (SHA-256 of every entry for MANIFEST.MF) and v2/v3 (SHA-256 of contents
+ * split into 1 MiB chunks). Digests are cached in a file together with layout
+ * of entries, so after an incremental update of the archive only changed
+ * entries and chunks, which cover changed or moved data, are hashed again.
+ * Chunks with gaps between entries are always hashed, since content of gaps
+ * isn't known.
+ */
+class ApkDigests {
+public:
+  static constexpr std::size_t CHUNK_SIZE{1U << 20U};
+
+  // Loads the cache if it exists. Malformed file is treated as empty.
+  explicit ApkDigests(std::filesystem::path cache_path);
+
+  /*
+   * Calculates digests of an opened archive, which isn't signed with v2 or
+   * later schemes yet (v2 digests are the same for the unsigned archive and
+   * the signed one). Hashing is done concurrently. If threads_count is zero,
+   * then number of CPU cores is used. Throws an exception on failure.
+   */
+  void update(const LocalZip& apk, unsigned threads_count = 0U);
+
+  // Lowercase hexadecimal digests of uncompressed data by names of entries.
+  [[nodiscard]] auto get_entry_digests() const ->
+      std::map<std::string, std::string, std::less<>>;
+  // Lowercase hexadecimal digest of contents for v2 and v3 schemes.
+  [[nodiscard]] inline auto get_content_digest() const -> const auto&
+      { return m_content_digest; }
+
+  // Numbers of entries and chunks of entries, which weren't found in the
+  // cache, so they were hashed by the last update.
+  [[nodiscard]] inline auto get_hashed_entries_count() const
+      { return m_hashed_entries_count; }
+  [[nodiscard]] inline auto get_hashed_chunks_count() const
+      { return m_hashed_chunks_count; }
+
+  // Replaces the file atomically. Returns false on failure.
+  auto save() const -> bool;
+
+private:
+  struct Entry {
+    std::string name;
+    // Offset of the local header.
+    std::uint64_t offset{};
+    // Size of the local header and compressed data.
+    std::uint64_t size{};
+    // Of the local header, so changes of its fields are detected.
+    std::uint32_t header_crc32{};
+    std::uint32_t crc32{};
+    std::uint64_t compressed_size{};
+    std::uint64_t uncompressed_size{};
+    std::string digest;
+  };
+
+  // Returns false on failure.
+  auto load() -> bool;
+  /*
+   * Reads the local header and hashes data of an entry, unless the cached
+   * entry with the same name (nullptr if there is no such one) matches it.
+   */
+  [[nodiscard]] static auto hash_entry(const LocalZip& apk,
+      const ZipDirectory::Entry& zip_entry, const Entry* cached,
+      bool& is_hashed) -> Entry;
+  /*
+   * Returns chunks of the entries section, which don't need to be hashed:
+   * they must be covered by cached entries, which weren't moved.
+   */
+  [[nodiscard]] auto find_unchanged_chunks(const std::vector<Entry>& entries,
+      std::uint64_t section_size) const -> std::vector<bool>;
+  // Reads and hashes size bytes of the archive by chunks.
+  static void hash_range(const LocalZip& apk, std::uint64_t offset,
+      std::uint64_t size, std::vector<std::string>& digests);
+  [[nodiscard]] static auto hash_chunk(const char* data, std::size_t size)
+      -> std::string;
+
+  std::filesystem::path m_cache_path;
+  // Sorted by offset.
+  std::vector<Entry> m_entries;
+  // Size of contents of entries (the first section for v2).
+  std::uint64_t m_section_size{};
+  std::vector<std::string> m_chunk_digests;
+  std::string m_content_digest;
+
+  std::size_t
+      m_hashed_entries_count{},
+      m_hashed_chunks_count{};
+};
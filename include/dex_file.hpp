@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "general/enum_array.hpp"
+
+/*
+ * Memory-mapped DEX file. The header is validated on opening, other
+ * structures are parsed on demand with bounds checking, so all functions
+ * throw runtime_error on malformed data. Only little-endian files are
+ * supported.
+ */
+class DexFile {
+public:
+  // Pools of identifiers, which are referenced by index.
+  enum class Pool {
+    STRING,
+    TYPE,
+    PROTO,
+    FIELD,
+    METHOD,
+
+    _COUNT
+  };
+
+  struct ProtoId {
+    std::uint32_t shorty_idx{};
+    std::uint32_t return_type_idx{};
+    // Offset of the parameters type list or zero if there are no parameters.
+    std::uint32_t params_off{};
+  };
+
+  // Identifier of a field or method.
+  struct MemberId {
+    std::uint32_t class_idx{};
+    // Type of a field or prototype of a method.
+    std::uint32_t type_idx{};
+    std::uint32_t name_idx{};
+  };
+
+  struct ClassDef {
+    std::uint32_t class_idx{};
+    std::uint32_t access_flags{};
+    std::uint32_t superclass_idx{};
+    std::uint32_t interfaces_off{};
+    std::uint32_t source_file_idx{};
+    std::uint32_t annotations_off{};
+    std::uint32_t class_data_off{};
+    std::uint32_t static_values_off{};
+  };
+
+  // Reads data sequentially starting from an offset.
+  class Reader {
+  public:
+    Reader(std::string_view data, std::size_t offset);
+
+    [[nodiscard]] auto read_u8() -> std::uint8_t;
+    [[nodiscard]] auto read_u16() -> std::uint16_t;
+    [[nodiscard]] auto read_u32() -> std::uint32_t;
+    [[nodiscard]] auto read_uleb128() -> std::uint32_t;
+    [[nodiscard]] auto read_sleb128() -> std::int32_t;
+    // Value is stored increased by one, so NO_INDEX is encoded as zero.
+    [[nodiscard]] auto read_uleb128p1() -> std::uint32_t;
+    [[nodiscard]] auto read(std::size_t size) -> std::string_view;
+
+    [[nodiscard]] inline auto get_offset() const { return m_offset; }
+
+  private:
+    std::string_view m_data;
+    std::size_t m_offset{};
+  };
+
+  static constexpr std::uint32_t NO_INDEX{0xFFFFFFFFU};
+  static constexpr std::size_t HEADER_SIZE{0x70U};
+
+  explicit DexFile(const std::filesystem::path& path);
+  ~DexFile();
+
+  DexFile(const DexFile&) = delete;
+  auto operator=(const DexFile&) -> DexFile& = delete;
+  DexFile(DexFile&&) = delete;
+  auto operator=(DexFile&&) -> DexFile& = delete;
+
+  // Version of the format (e. g. 35 for “dex\n035”).
+  [[nodiscard]] inline auto get_version() const { return m_version; }
+  // Call sites and method handles are used by invoke-custom and the like.
+  [[nodiscard]] inline auto has_method_handles() const
+      { return m_has_method_handles; }
+
+  [[nodiscard]] auto get_count(Pool pool) const -> std::uint32_t;
+  [[nodiscard]] inline auto get_class_defs_count() const
+      { return m_class_defs.size; }
+
+  // Returns MUTF-8 encoded string without the terminating null character.
+  [[nodiscard]] auto get_string(std::uint32_t idx) const -> std::string_view;
+  // Returns index of the descriptor string.
+  [[nodiscard]] auto get_type(std::uint32_t idx) const -> std::uint32_t;
+  [[nodiscard]] auto get_proto(std::uint32_t idx) const -> ProtoId;
+  [[nodiscard]] auto get_field(std::uint32_t idx) const -> MemberId;
+  [[nodiscard]] auto get_method(std::uint32_t idx) const -> MemberId;
+  [[nodiscard]] auto get_class_def(std::uint32_t idx) const -> ClassDef;
+  // Returns type indexes of a list. Zero offset means an empty list.
+  [[nodiscard]] auto get_type_list(std::uint32_t offset) const ->
+      std::vector<std::uint32_t>;
+
+  [[nodiscard]] auto get_reader(std::uint32_t offset) const -> Reader;
+
+private:
+  // Location of identifiers within the file.
+  struct Section {
+    std::uint32_t size{};
+    std::uint32_t offset{};
+  };
+
+  static constexpr std::uint32_t ENDIAN_CONSTANT{0x12345678U};
+  static constexpr std::uint16_t
+      CALL_SITE_ID_ITEM{0x0007U},
+      METHOD_HANDLE_ITEM{0x0008U};
+
+  void parse_header();
+  void parse_map(std::uint32_t offset);
+  // Returns offset of an item.
+  [[nodiscard]] auto locate(const Section& section,
+      std::uint32_t idx, std::size_t item_size) const -> std::size_t;
+
+  std::string_view m_data;
+  // Size of the mapping, which can exceed the file size from the header.
+  std::size_t m_mapping_size{};
+
+  unsigned m_version{};
+  bool m_has_method_handles{};
+  std::array<Section, size<Pool>()> m_pools{};
+  Section m_class_defs;
+};
@@ -0,0 +1,209 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "general/enum_array.hpp"
+#include "dex_file.hpp"
+
+/*
+ * Merges DEX files (e. g. intermediate ones produced by d8 for each class)
+ * into the final classes*.dex files without running d8. Identifier pools of
+ * the inputs are merged by sorting, then classes are copied with remapped
+ * indexes. Classes are spread across several files when a file would
+ * reference more than 65536 identifiers of some pool (native multidex, so
+ * there is no main DEX list). Call sites and method handles aren't supported.
+ */
+class DexMerger {
+  using Pool = DexFile::Pool;
+
+public:
+  static constexpr std::uint32_t MAX_IDS_COUNT{1U << 16U};
+
+  /*
+   * Output files will reference at most max_ids_count identifiers of each
+   * pool. Lower limit only spreads classes across more files.
+   */
+  explicit DexMerger(std::uint32_t max_ids_count = MAX_IDS_COUNT);
+
+  /*
+   * Maps a file and collects identifiers referenced by its classes. Throws
+   * runtime_error if the file is malformed or defines a class, which is
+   * already added.
+   */
+  void add(const std::filesystem::path& dex_path);
+  /*
+   * Writes classes.dex, classes2.dex, etc. to an existing directory and
+   * returns their paths. Files left by a previous merge, which produced more
+   * files, are removed. Throws runtime_error on failure.
+   */
+  auto write(const std::filesystem::path& output_dir) const ->
+      std::vector<std::filesystem::path>;
+
+private:
+  // Used to translate an index of an input file.
+  using remap_t = std::uint32_t (Pool pool, std::uint32_t idx);
+  // Indexed by pool.
+  template<typename T> using pools_t = std::array<T, size<Pool>()>;
+
+  struct Input {
+    std::unique_ptr<const DexFile> dex;
+    // Global indexes of identifiers of the file.
+    pools_t<std::vector<std::uint32_t>> globals;
+  };
+
+  struct EncodedMember {
+    std::uint32_t idx{};
+    std::uint32_t access_flags{};
+    // Only for methods.
+    std::uint32_t code_off{};
+  };
+  // Static fields, instance fields, direct methods and virtual methods.
+  using ClassData = std::array<std::vector<EncodedMember>, 4U>;
+  static constexpr std::size_t FIELD_LISTS_COUNT{2U};
+
+  struct AnnotationsDirectory {
+    std::uint32_t class_annotations_off{};
+    // Pairs of a member index and offset of an annotation set (or a list of
+    // annotation sets for parameters).
+    std::vector<std::pair<std::uint32_t, std::uint32_t>>
+        fields,
+        methods,
+        params;
+  };
+
+  struct Class {
+    std::size_t input{};
+    DexFile::ClassDef def;
+    // Global indexes of types.
+    std::uint32_t type{};
+    std::uint32_t superclass{DexFile::NO_INDEX};
+    std::vector<std::uint32_t> interfaces;
+
+    ClassData data;
+    AnnotationsDirectory annotations;
+    // Sorted global indexes of all identifiers, which are referenced
+    // (directly or through other identifiers) by the class.
+    pools_t<std::vector<std::uint32_t>> refs;
+  };
+
+  // Global identifiers, which refer to other global identifiers.
+  struct Proto {
+    std::uint32_t shorty{};
+    std::uint32_t return_type{};
+    std::vector<std::uint32_t> params;
+
+    inline auto operator<(const Proto& rhs) const -> bool {
+      return std::tie(shorty, return_type, params) <
+             std::tie(rhs.shorty, rhs.return_type, rhs.params);
+    }
+  };
+  // Class type, field type (or method prototype) and name.
+  using Member = std::tuple<std::uint32_t, std::uint32_t, std::uint32_t>;
+
+  // Positions of global identifiers in sorted order, indexed by pool.
+  using ranks_t = pools_t<std::vector<std::uint32_t>>;
+  struct Output;
+
+  // Returns global index of an identifier of an input file.
+  [[nodiscard]] static auto get_global(const Input& input,
+      Pool pool, std::uint32_t idx) -> std::uint32_t;
+  // Adds an identifier and identifiers, which it refers to.
+  void collect(pools_t<std::vector<std::uint32_t>>& refs,
+               Pool pool, std::uint32_t global_idx) const;
+  void intern(Input& input);
+  [[nodiscard]] auto read_class(std::size_t input_idx,
+      const Input& input, std::uint32_t class_def_idx) const -> Class;
+
+  [[nodiscard]] auto make_ranks() const -> ranks_t;
+  // Returns lists of classes for each output file.
+  [[nodiscard]] auto split(const ranks_t& ranks) const ->
+      std::vector<std::vector<const Class*>>;
+  // Orders classes, so superclasses and interfaces precede their subclasses.
+  [[nodiscard]] auto sort_classes(const std::vector<const Class*>& classes)
+      const -> std::vector<const Class*>;
+  void write_dex(const std::vector<const Class*>& classes,
+                 const ranks_t& ranks, const std::filesystem::path& path) const;
+
+  [[nodiscard]] auto make_remap(const Output& output,
+      std::size_t input_idx) const -> std::function<remap_t>;
+  // Following functions write data items of all classes to an output.
+  void write_ids(Output& output, const ranks_t& ranks) const;
+  void write_code(Output& output) const;
+  void write_class_data(Output& output) const;
+  void write_annotations(Output& output) const;
+  void write_static_values(Output& output) const;
+  static void write_class_defs(Output& output);
+  static void write_map(Output& output);
+  static void write_header(Output& output);
+
+  [[nodiscard]] static auto read_class_data(const DexFile& dex,
+      std::uint32_t offset) -> ClassData;
+  [[nodiscard]] static auto read_annotations(const DexFile& dex,
+      std::uint32_t offset) -> AnnotationsDirectory;
+  // Reads an annotation set or a list of annotation sets.
+  [[nodiscard]] static auto read_offsets(const DexFile& dex,
+      std::uint32_t offset) -> std::vector<std::uint32_t>;
+  // Returns offsets of all annotation sets of a class.
+  [[nodiscard]] static auto get_annotation_sets(const DexFile& dex,
+      const AnnotationsDirectory& annotations) -> std::vector<std::uint32_t>;
+
+  /*
+   * Following functions copy items translating indexes. Offsets, which
+   * refer to other items, are written as zero, so they must be patched.
+   */
+
+  // Returns offset of debug information of the input code item.
+  static auto copy_code(DexFile::Reader& reader,
+      const std::function<remap_t>& remap, std::string& out) -> std::uint32_t;
+  static void copy_insns(DexFile::Reader& reader, std::uint32_t units_count,
+      const std::function<remap_t>& remap, std::string& out);
+  // Returns new offsets of handlers relatively to the list by the old ones.
+  static auto copy_handlers(DexFile::Reader& reader,
+      const std::function<remap_t>& remap, std::string& out) ->
+      std::map<std::uint32_t, std::uint32_t>;
+  static void copy_debug_info(DexFile::Reader& reader,
+      const std::function<remap_t>& remap, std::string& out);
+  static void copy_encoded_value(DexFile::Reader& reader,
+      const std::function<remap_t>& remap, std::string& out);
+  static void copy_encoded_array(DexFile::Reader& reader,
+      const std::function<remap_t>& remap, std::string& out);
+  static void copy_encoded_annotation(DexFile::Reader& reader,
+      const std::function<remap_t>& remap, std::string& out);
+
+  std::uint32_t m_max_ids_count;
+  std::vector<Input> m_inputs;
+  std::vector<Class> m_classes;
+  // Maximum version of the input files.
+  unsigned m_version{};
+
+  // Strings are MUTF-8 encoded. Values of maps are global indexes.
+  std::vector<const std::string*> m_strings;
+  std::map<std::string, std::uint32_t, std::less<>> m_string_indexes;
+  std::vector<std::uint32_t> m_types;
+  std::map<std::uint32_t, std::uint32_t> m_type_indexes;
+  std::vector<const Proto*> m_protos;
+  std::map<Proto, std::uint32_t> m_proto_indexes;
+  std::vector<const Member*> m_fields;
+  std::map<Member, std::uint32_t> m_field_indexes;
+  std::vector<const Member*> m_methods;
+  std::map<Member, std::uint32_t> m_method_indexes;
+  // Indexes of classes by their global types.
+  std::map<std::uint32_t, std::size_t> m_class_indexes;
+};
@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cpr/cprtypes.h>
+#include "http_client.hpp"
+
+/*
+ * Downloads files with the known SHA-256 checksum. Data is written to a
+ * partial file named after the checksum, so an interrupted transfer will be
+ * resumed by the next attempt instead of being started from scratch. Large
+ * files can be fetched as several byte ranges over parallel connections.
+ *
+ * Downloaded files are kept in the cache as blobs named after their
+ * checksums, so the same file is never downloaded twice.
+ */
+class Downloader {
+  using progress_callback_t =
+      void (std::uint64_t downloaded, std::uint64_t total);
+
+public:
+  static constexpr std::uint64_t DEFAULT_MIN_SEGMENT_SIZE{1U << 24U};
+
+  Downloader() = default;
+  /*
+   * Blobs and partial files are kept in cache_dir (it will be created if
+   * required). A file is split into at most segments_count parts, but each
+   * of them can't be smaller than min_segment_size.
+   */
+  Downloader(HttpClient client, std::filesystem::path cache_dir,
+      unsigned short segments_count = 1U,
+      std::uint64_t min_segment_size = DEFAULT_MIN_SEGMENT_SIZE);
+
+  /*
+   * Returns path of the blob, downloading it if it isn't cached yet. Callback
+   * calls are serialized, total size passed to it is zero if unknown. Throws
+   * runtime_error on failure. Partial data is kept for the next attempt,
+   * unless it turned out to be corrupted.
+   */
+  [[nodiscard]] auto fetch(const cpr::Url& url, std::string_view sha256,
+      const std::function<progress_callback_t>& callback = {}) const
+      -> std::filesystem::path;
+  // Fetches a file and copies it to output_path.
+  void download(const cpr::Url& url, std::string_view sha256,
+      const std::filesystem::path& output_path,
+      const std::function<progress_callback_t>& callback = {}) const;
+
+  /*
+   * Returns path of the blob if it's cached, or empty path. Blobs are
+   * verified before they're put to the cache, so they aren't hashed again.
+   * Blob must not be modified.
+   */
+  [[nodiscard]] auto
+      find(std::string_view sha256) const -> std::filesystem::path;
+  // Blob at the returned path may not exist.
+  [[nodiscard]] inline auto get_blob_path(const std::string_view sha256) const
+      { return m_cache_dir / BLOBS_SUBDIR_NAME / sha256; }
+
+  inline void set_segments_count(const unsigned short count)
+      { m_segments_count = count; }
+
+private:
+  // Byte range [first, last) of a file, pos is the next byte to fetch.
+  struct Segment {
+    std::uint64_t first{};
+    std::uint64_t last{};
+    std::uint64_t pos{};
+  };
+
+  // Persisted alongside the partial file.
+  struct State {
+    // ETag or Last-Modified value of the remote file, can be empty.
+    std::string validator;
+    std::uint64_t size{};
+    std::vector<Segment> segments;
+  };
+
+  // Properties of the remote file, retrieved using a HEAD request.
+  struct Remote {
+    cpr::Url url;
+    std::string validator;
+    std::uint64_t size{};
+    bool ranges_supported{};
+  };
+
+  static constexpr std::string_view
+      BLOBS_SUBDIR_NAME{"blobs"},
+      PARTIAL_SUBDIR_NAME{"partial"};
+  static constexpr std::string_view
+      PARTIAL_FILE_EXTENSION{".part"},
+      STATE_FILE_EXTENSION{".state"};
+  // How often to save the state while downloading.
+  static constexpr std::chrono::seconds STATE_SAVE_INTERVAL{1};
+  // Used to hash data of the partial file, which was written before.
+  static constexpr std::size_t READ_BUFFER_SIZE{1U << 20U};
+
+  [[nodiscard]] auto get_remote(const cpr::Url& url) const -> Remote;
+  // Returns empty state if the file doesn't exist or can't be parsed.
+  [[nodiscard]] static auto
+      load_state(const std::filesystem::path& path) -> State;
+  // Returns false on failure.
+  static auto save_state(
+      const std::filesystem::path& path, const State& state) -> bool;
+  [[nodiscard]] auto split(std::uint64_t size) const -> std::vector<Segment>;
+
+  /*
+   * Fetches all unfinished segments concurrently and returns SHA-256 checksum
+   * of the file. Data is hashed in order as it arrives, data fetched by
+   * previous attempts or ahead of other segments is read back once. Returns
+   * empty string if the remote file has been changed since the state was
+   * created, so download must be started over. Throws runtime_error on
+   * failure.
+   */
+  auto download_segments(const Remote& remote, State& state,
+      const std::filesystem::path& partial_path,
+      const std::filesystem::path& state_path,
+      const std::function<progress_callback_t>& callback) const
+      -> std::string;
+  /*
+   * Used when the server doesn't support range requests. Returns SHA-256
+   * checksum of the downloaded data.
+   */
+  auto download_entirely(const cpr::Url& url,
+      const std::filesystem::path& partial_path,
+      const std::function<progress_callback_t>& callback) const
+      -> std::string;
+
+  HttpClient m_client;
+  std::filesystem::path m_cache_dir;
+  unsigned short m_segments_count{1U};
+  std::uint64_t m_min_segment_size{DEFAULT_MIN_SEGMENT_SIZE};
+};
@@ -0,0 +1,79 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+#include <cpr/callback.h>
+#include <cpr/response.h>
+#include <cpr/session.h>
+#include <curl/curl.h>
+
+/*
+ * Performs HTTP requests sharing DNS cache, TLS sessions and open
+ * connections, so consecutive requests to the same host don't pay for
+ * connection setup again. HTTP/2 is negotiated for TLS connections.
+ *
+ * Since cpr::Session isn't thread-safe, every request uses its own session,
+ * so requests can be made from several threads at once. Copies of a client
+ * share the same cache.
+ */
+class HttpClient {
+public:
+  // Throws runtime_error on failure.
+  HttpClient();
+
+  // Options are the same as for the corresponding cpr functions.
+  template<typename... Ts> auto get(Ts&&... options) const -> cpr::Response;
+  template<typename... Ts> auto head(Ts&&... options) const -> cpr::Response;
+  template<typename... Ts> auto download(const cpr::WriteCallback& write,
+      Ts&&... options) const -> cpr::Response;
+
+  /*
+   * Requests compressed transfer of responses, which are decoded
+   * transparently. Must not be used for range requests, since ranges
+   * would refer to the encoded data.
+   */
+  inline void set_compression(const bool enable) { m_compression = enable; }
+
+  /*
+   * Returns callback, which stores status code of the last response (if
+   * redirected) as soon as its status line is received, so body of an
+   * unexpected response can be rejected before anything is written.
+   */
+  [[nodiscard]] static auto
+      make_status_callback(long& status_code) -> cpr::HeaderCallback;
+
+private:
+  // Shared data along with the locks required by libcurl.
+  struct Share {
+    Share();
+    ~Share();
+
+    Share(const Share&) = delete;
+    auto operator=(const Share&) -> Share& = delete;
+    Share(Share&&) = delete;
+    auto operator=(Share&&) -> Share& = delete;
+
+    CURLSH* handle;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes;
+  };
+
+  static void lock(CURL* handle, curl_lock_data data,
+                   curl_lock_access access, void* share);
+  static void unlock(CURL* handle, curl_lock_data data, void* share);
+
+  // Attaches a session to the shared data.
+  void prepare(cpr::Session& session) const;
+
+  std::shared_ptr<Share> m_share;
+  bool m_compression{};
+};
+
+#include "http_client.inl"
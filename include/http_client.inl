@@ -0,0 +1,32 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <utility>
+
+template<typename... Ts>
+auto HttpClient::get(Ts&&... t_options) const -> cpr::Response {
+  cpr::Session session;
+  prepare(session);
+  (session.SetOption(std::forward<Ts>(t_options)), ...);
+  return session.Get();
+}
+
+template<typename... Ts>
+auto HttpClient::head(Ts&&... t_options) const -> cpr::Response {
+  cpr::Session session;
+  prepare(session);
+  (session.SetOption(std::forward<Ts>(t_options)), ...);
+  return session.Head();
+}
+
+template<typename... Ts> auto HttpClient::download(
+    const cpr::WriteCallback& t_write, Ts&&... t_options) const
+    -> cpr::Response {
+  cpr::Session session;
+  prepare(session);
+  (session.SetOption(std::forward<Ts>(t_options)), ...);
+  return session.Download(t_write);
+}
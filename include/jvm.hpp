@@ -42,8 +42,12 @@ class Jvm {
   using tool_t = auto (const std::vector<std::string>& args,
                  std::string& out, std::string& err) const -> int;
 public:
-  // Throws an exception on failure.
-  Jvm(jvm_tools::flags_t init_tools, std::shared_ptr<const Sdk> sdk);
+  /*
+   * Tools are loaded from JAR files of the given SDK API (of the selected
+   * one if it's zero). Throws an exception on failure.
+   */
+  Jvm(jvm_tools::flags_t init_tools, std::shared_ptr<const Sdk> sdk,
+      unsigned short sdk_api = 0U);
   ~Jvm();
 
   Jvm(const Jvm&) = delete;
@@ -86,8 +90,8 @@ private:
   void redirect_output();
   void set_security_manager() const;
   void init_javac();
-  void init_android_tools(
-      jvm_tools::flags_t tools, std::shared_ptr<const Sdk> sdk);
+  void init_android_tools(jvm_tools::flags_t tools,
+      std::shared_ptr<const Sdk> sdk, unsigned short sdk_api);
 
   [[nodiscard]] auto make_args(const std::vector<std::string>& args) const ->
       jni::Local<jni::Array<jni::String>>;
@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Records installed components: checksum of the archive or file (taken from
+ * the manifest), which a component was installed from, along with metadata
+ * and checksums of the installed files. It allows to skip installation of
+ * components, that haven't been changed since the last installation, and to
+ * verify integrity of the installed files.
+ *
+ * Paths are stored relative to the ledger's directory. All member functions
+ * are thread-safe.
+ */
+class Ledger {
+  using progress_callback_t =
+      void (std::uintmax_t verified, std::uintmax_t total);
+
+public:
+  struct Mismatch {
+    std::string component;
+    std::filesystem::path path;
+    std::string reason;
+  };
+
+  // Loads the ledger if it exists. Malformed file is treated as empty.
+  explicit Ledger(std::filesystem::path path);
+
+  /*
+   * Returns true if a component was installed from the file with the same
+   * checksum and all of its files weren't modified (size and modification
+   * time are compared) since that.
+   */
+  [[nodiscard]] auto is_up_to_date(
+      std::string_view component, std::string_view sha256) const -> bool;
+  /*
+   * Replaces the previous record of a component. Returns false if metadata
+   * or checksum of a file can't be retrieved, the component is forgotten in
+   * that case.
+   */
+  auto record(std::string_view component, std::string_view sha256,
+              const std::vector<std::filesystem::path>& files) -> bool;
+  void forget(std::string_view component);
+  [[nodiscard]] auto is_recorded(const std::filesystem::path& path) const
+      -> bool;
+  // Paths of all recorded files relative to the ledger's directory.
+  [[nodiscard]] auto get_files() const -> std::vector<std::filesystem::path>;
+  /*
+   * Returns groups (of at least two relative paths) of non-empty files with
+   * the same size and checksum. Recorded data is used, files aren't read, but
+   * files modified since recording are skipped.
+   */
+  [[nodiscard]] auto find_duplicates() const
+      -> std::vector<std::vector<std::filesystem::path>>;
+
+  /*
+   * Replaces records of components, that are recorded in another ledger.
+   * Both ledgers must be located in the same directory.
+   */
+  void merge(const Ledger& other);
+  /*
+   * Updates size and modification time of the passed (relative paths) or, if
+   * nothing is passed, all recorded files, keeping their checksums. Used after
+   * files were replaced by copies with the same content. Returns false if
+   * metadata of some file can't be retrieved.
+   */
+  auto refresh_metadata(
+      const std::vector<std::filesystem::path>& files = {}) -> bool;
+
+  /*
+   * Hashes all recorded files concurrently and returns every file, which
+   * doesn't match its record. Callback calls are serialized.
+   */
+  [[nodiscard]] auto verify(
+      const std::function<progress_callback_t>& callback = {}) const
+      -> std::vector<Mismatch>;
+
+  // Replaces the file atomically. Returns false on failure.
+  auto save() const -> bool;
+
+private:
+  struct File {
+    // Relative to the ledger's directory.
+    std::filesystem::path path;
+    std::uintmax_t size{};
+    // Count of file clock ticks.
+    std::int64_t mod_time{};
+    std::string sha256;
+  };
+
+  struct Component {
+    std::string sha256;
+    std::vector<File> files;
+  };
+
+  // Returns false on failure.
+  auto load() -> bool;
+  // Returns true if the file still has the recorded metadata.
+  [[nodiscard]] auto check_file(const File& file) const -> bool;
+
+  std::filesystem::path m_path;
+  std::map<std::string, Component, std::less<>> m_components;
+  mutable std::mutex m_mutex;
+};
@@ -0,0 +1,103 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "zip_directory.hpp"
+
+/*
+ * Extracts entries of a ZIP archive located on the local file system.
+ * Stored entries are copied by the kernel (using copy_file_range), so their
+ * data doesn't pass through user space. Deflated entries are decompressed
+ * straight to the output files. Several entries can be extracted at once.
+ */
+class LocalZip {
+  using extract_callback_t = void (const ZipDirectory::Entry& entry);
+  using read_callback_t = void (const char* data, std::size_t size);
+
+public:
+  // Pair of an entry and its output path.
+  using Target = std::pair<const ZipDirectory::Entry*, std::filesystem::path>;
+
+  explicit LocalZip(std::filesystem::path path);
+
+  // Reads the central directory. Returns false on failure.
+  auto open() -> bool;
+  [[nodiscard]] inline auto get_directory() const -> const auto&
+      { return m_directory; }
+  [[nodiscard]] inline auto get_path() const -> const auto& { return m_path; }
+  [[nodiscard]] inline auto get_size() const { return m_size; }
+  // Location of the central directory.
+  [[nodiscard]] inline auto get_location() const -> const auto&
+      { return m_location; }
+  /*
+   * Returns offset of compressed data of an entry. Throws an exception if
+   * the data is out of the archive.
+   */
+  [[nodiscard]] auto get_data_offset(const ZipDirectory::Entry& entry) const
+      -> std::uint64_t;
+
+  /*
+   * Extracts an entry replacing the output file (a new file is created, so
+   * hard links of the previous one aren't affected). Throws an exception on
+   * failure, including CRC-32 mismatch of a deflated entry. CRC-32 of stored
+   * entries isn't verified, since their data isn't read by the process:
+   * integrity of the archive must be verified by its checksum.
+   */
+  void extract(const ZipDirectory::Entry& entry,
+               const std::filesystem::path& output_path) const;
+  /*
+   * Passes uncompressed data of an entry to the callback by parts. Throws an
+   * exception on failure, including CRC-32 mismatch.
+   */
+  void read_entry(const ZipDirectory::Entry& entry,
+                  const std::function<read_callback_t>& callback) const;
+  // Reads exactly size bytes of the archive. Throws an exception on failure.
+  void read_range(std::uint64_t offset, void* data, std::size_t size) const;
+  /*
+   * Extracts entries concurrently. Every thread opens the archive on its own.
+   * If threads_count is zero, then number of CPU cores is used. Callback is
+   * called after extracting of each entry, calls are serialized. Throws the
+   * first occurred exception after all threads are stopped.
+   */
+  void extract_all(const std::vector<Target>& targets,
+      unsigned threads_count = 0U,
+      const std::function<extract_callback_t>& callback = {}) const;
+
+private:
+  // Large buffer reduces number of system calls.
+  static constexpr std::size_t BUFFER_SIZE{1U << 20U};
+
+  // Throws an exception on failure.
+  [[nodiscard]] auto open_fd() const -> int;
+  [[nodiscard]] auto get_data_offset(int fd,
+      const ZipDirectory::Entry& entry) const -> std::uint64_t;
+  void extract(int fd, const ZipDirectory::Entry& entry,
+               const std::filesystem::path& output_path) const;
+
+  // Copies range of the input file to the current position of the output one.
+  static void copy(int in_fd, std::uint64_t offset,
+                   int out_fd, std::uint64_t size);
+  // Verifies size and CRC-32 of the decompressed data.
+  static void inflate(int in_fd, std::uint64_t offset,
+                      const ZipDirectory::Entry& entry,
+                      const std::function<read_callback_t>& callback);
+  // Reads exactly size bytes. Throws an exception on failure.
+  static void read(int fd, std::uint64_t offset, void* data, std::size_t size);
+  static void write(int fd, const void* data, std::size_t size);
+
+  std::filesystem::path m_path;
+  std::uint64_t m_size{};
+  ZipDirectory::Location m_location;
+  ZipDirectory m_directory;
+};
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Stacked multi-line progress display. Every bar occupies its own line and
+ * can be updated from a separate thread. Finished bars are printed above the
+ * active ones and never redrawn again.
+ */
+class MultiProgress {
+public:
+  // Interface of this class mimics fcli::Progress,
+  // so functions can be written for both of them.
+  class Bar {
+  public:
+    Bar(MultiProgress& parent, std::string_view text, bool determined);
+
+    void show();
+    // Removes the bar from the display until show will be called again.
+    void hide();
+    // Prints the (already formatted) message instead of the bar and hides it.
+    void finish(bool success, std::string_view msg);
+
+    auto operator=(std::string_view text) -> Bar&;
+    // Sets percents (from 0 to 100) of the determined bar.
+    auto operator=(double percents) -> Bar&;
+
+    // Passing strings directly, as std::string
+    // converts to both of string_view and double.
+    inline auto operator=(const std::string& text) -> Bar&
+        { return *this = std::string_view(text); }
+    inline auto operator=(const char* text) -> Bar&
+        { return *this = std::string_view(text); }
+
+    void set_determined(bool determined);
+    [[nodiscard]] auto is_determined() const -> bool;
+    [[nodiscard]] auto get_text() const -> std::string;
+    [[nodiscard]] auto get_percents() const -> double;
+
+  private:
+    friend class MultiProgress;
+
+    MultiProgress& m_parent;
+    std::string m_text;
+    bool m_determined;
+    double m_percents{};
+    bool m_visible{};
+  };
+
+  /*
+   * Width is the maximum line length. If the output isn't interactive
+   * (e. g. redirected to a file), then only messages of the finished bars
+   * will be printed, since cursor movements can't be used there.
+   */
+  explicit MultiProgress(unsigned short width,
+      bool interactive = true, std::ostream& os = std::cout);
+  // Clears lines of the active bars.
+  ~MultiProgress();
+
+  // Bars refer to their parent.
+  MultiProgress(const MultiProgress&) = delete;
+  auto operator=(const MultiProgress&) -> MultiProgress& = delete;
+  MultiProgress(MultiProgress&&) = delete;
+  auto operator=(MultiProgress&&) -> MultiProgress& = delete;
+
+  // Returned reference stays valid during lifetime of the MultiProgress.
+  auto add(std::string_view text, bool determined = false) -> Bar&;
+
+private:
+  // Minimum interval between two redraws that aren't forced.
+  static constexpr std::chrono::milliseconds REFRESH_INTERVAL{50};
+  static constexpr unsigned short MIN_BAR_WIDTH{10U};
+
+  // Following functions must be called with the locked mutex.
+
+  // If force is false, then redraw can be skipped to limit its frequency.
+  void render(bool force = false);
+  [[nodiscard]] auto render_bar(const Bar& bar) const -> std::string;
+  // Moves the cursor to the first line of the active bars and clears them.
+  void clear_active_lines();
+
+  unsigned short m_width;
+  bool m_interactive;
+  std::ostream& m_os;
+
+  // Using recursive mutex, since getters of a bar can
+  // be called while the bar is being modified.
+  mutable std::recursive_mutex m_mutex;
+  // List guarantees that references to the bars won't be invalidated.
+  std::list<Bar> m_bars;
+  // Messages of the finished bars that yet to be printed.
+  std::vector<std::string> m_finished_msgs;
+
+  // Number of the lines that currently occupied by the active bars.
+  std::size_t m_active_lines{};
+  std::size_t m_frame{};
+  std::chrono::steady_clock::time_point m_last_render;
+};
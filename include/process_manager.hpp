@@ -0,0 +1,136 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "general/enum_array.hpp"
+
+/*
+ * Runs several processes at once and supervises them using epoll, so the
+ * calling thread sleeps until some process writes output, is ready to read
+ * input or exits. Callbacks are called on the thread, which waits.
+ */
+class ProcessManager {
+  using line_callback_t = void (std::string_view line);
+
+public:
+  struct Command {
+    std::vector<std::string> args;
+    // Called for each line of an output (without the line break). If a
+    // callback isn't set, then the corresponding output is discarded.
+    std::function<line_callback_t>
+        out_callback,
+        err_callback;
+    // Written to the standard input, which is closed afterwards.
+    std::string input;
+    // Process is killed when it runs longer. Zero means no limit.
+    std::chrono::milliseconds timeout{};
+    // Working directory of a process. The current one is used if empty.
+    std::filesystem::path work_dir;
+    // Variables are added to (or replace) the inherited environment.
+    std::map<std::string, std::string, std::less<>> env;
+  };
+
+  struct Result {
+    // Exit code or 128 + number of the signal, that terminated a process.
+    int exit_code{};
+    bool timed_out{};
+    // CPU time, maximum resident set size, etc.
+    rusage usage{};
+  };
+
+  // Throws runtime_error on failure.
+  ProcessManager();
+  // Kills processes, which are still running.
+  ~ProcessManager();
+
+  ProcessManager(const ProcessManager&) = delete;
+  auto operator=(const ProcessManager&) -> ProcessManager& = delete;
+  ProcessManager(ProcessManager&&) = delete;
+  auto operator=(ProcessManager&&) -> ProcessManager& = delete;
+
+  /*
+   * Starts a process and returns its index in the results of wait. Throws
+   * runtime_error if the process can't be started (e. g., the executable
+   * doesn't exist).
+   */
+  auto start(Command command) -> std::size_t;
+  /*
+   * Blocks until all started processes exit and their outputs are read.
+   * Exceptions thrown by callbacks are propagated.
+   */
+  auto wait() -> std::vector<Result>;
+
+private:
+  enum class Channel {
+    IN,
+    OUT,
+    ERR,
+    // Becomes readable when a process exits.
+    PID,
+
+    _COUNT
+  };
+
+  struct Process {
+    Command command;
+    pid_t pid{-1};
+    // Descriptors indexed by channel.
+    std::array<int, size<Channel>()> fds{-1, -1, -1, -1};
+    // Incomplete lines of the standard output and error.
+    std::string
+        out_line,
+        err_line;
+    std::size_t written_input{};
+    std::chrono::steady_clock::time_point deadline;
+    bool reaped{};
+    Result result;
+  };
+
+  static constexpr std::size_t
+      READ_BUFFER_SIZE{1U << 16U},
+      MAX_EVENTS{64U};
+
+  /*
+   * Launches a process using posix_spawn, so memory of the calling process
+   * isn't copied (that's expensive when JVM is loaded) and the current
+   * working directory isn't changed. Standard descriptors of the process are
+   * replaced by std_fds. Throws runtime_error on failure.
+   */
+  [[nodiscard]] static auto spawn(const Command& command,
+      const std::array<int, 3U>& std_fds) -> pid_t;
+  void watch(std::size_t index, Channel channel, std::uint32_t events);
+  void close_channel(Process& process, Channel channel);
+
+  void write_input(Process& process);
+  void read_output(Process& process, Channel channel);
+  // Waits for a process, so it must be exited or about to exit.
+  static void reap(Process& process);
+  // Calls callback for each complete line and removes them from the buffer.
+  static void split_lines(std::string& buffer,
+      const std::function<line_callback_t>& callback, bool flush);
+
+  [[nodiscard]] static auto is_finished(const Process& process) -> bool;
+  static void close_fd(int& fd);
+
+  int m_epoll_fd{-1};
+  std::vector<Process> m_processes;
+  std::vector<char> m_read_buffer;
+};
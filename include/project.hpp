@@ -6,11 +6,14 @@
 
 #pragma once
 
+#include <cstddef>
 #include <filesystem>
 #include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include <fcli/terminal.hpp>
 #include <pugixml.hpp>
@@ -19,6 +22,7 @@
 
 // Don't include headers within each other.
 class Apm;
+class ZipWriter;
 
 class Project {
 public:
@@ -27,6 +31,8 @@ public:
     ASSETS,
     RESOURCES,
     JAVA_SRC,
+    // Native libraries in subdirectories named after ABIs.
+    JNI_LIBS,
 
     _COUNT
   };
@@ -64,6 +70,9 @@ public:
     _COUNT
   };
 
+  // Pair of an APK entry name and path of its file.
+  using ApkEntry = std::pair<std::string, std::filesystem::path>;
+
   // Throws an exception on failure.
   explicit Project(const std::filesystem::path& root_dir);
   // Returns program execution status.
@@ -80,6 +89,15 @@ public:
   [[nodiscard]] auto get_apk_path(ApkType type, BuildConfig build_config,
       bool auto_create_parent_dir = true) const -> std::filesystem::path;
 
+  /*
+   * Adds files to the aligned APK. Entries, which are read while an
+   * application starts, come first. Native libraries and the resource table
+   * are stored and aligned to the page size, so Android maps them straight
+   * from the APK instead of extracting. Throws an exception on failure.
+   */
+  static void write_apk_entries(ZipWriter& writer,
+                                std::vector<ApkEntry> entries);
+
   // Returns program execution status.
   static auto create(const std::filesystem::path& dir,
       unsigned short sdk_api, const std::filesystem::path& templ_zip,
@@ -91,13 +109,18 @@ private:
       ROOT_BUILD_DIR_NAME{"build"};
   // Minimum value of the Android's minimum API level to run an application.
   static constexpr unsigned short MIN_API{21U};
+  static constexpr std::size_t PAGE_ALIGNMENT{4096U};
 
   // It must return program execution status.
   using fail_func_t = int (std::string_view msg);
   static auto check_output_apk(const std::filesystem::path& path,
       const std::function<fail_func_t>& fail_func) -> int;
-  auto check_sdk(const Apm& apm,
-                 const std::function<fail_func_t>& fail_func) const -> int;
+  // Passes the installed API, that will be used to build a project.
+  auto check_sdk(const Apm& apm, const std::function<fail_func_t>& fail_func,
+                 unsigned short& api) const -> int;
+  // Checks that all tools and JAR files of the API are available.
+  static auto check_sdk_files(const Sdk& sdk, unsigned short api,
+      const std::function<fail_func_t>& fail_func) -> int;
 
   [[nodiscard]] static auto request_app_name() -> std::string;
   [[nodiscard]] static auto request_package() -> std::string;
@@ -120,6 +143,9 @@ private:
       std::string_view package, unsigned short sdk_api, unsigned short min_api);
   static void set_app_name(
       const std::filesystem::path& strings_xml, std::string_view name);
+  // Native libraries are mapped from the APK, so they mustn't be extracted.
+  static void disable_native_libs_extraction(
+      const std::filesystem::path& manifest_xml);
   // Creates a folder hierarchy in root directory according
   // to package name and moves a file to the extreme folder.
   static void relocate_class(const std::filesystem::directory_entry& root_dir,
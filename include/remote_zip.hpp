@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include <cpr/cprtypes.h>
+
+#include "http_client.hpp"
+#include "sha256.hpp"
+#include "zip_directory.hpp"
+
+/*
+ * Reads a ZIP archive located on a HTTP server without downloading it
+ * entirely: only the central directory and data of the required entries
+ * are fetched using range requests.
+ */
+class RemoteZip {
+  using fetch_callback_t = void (std::size_t fetched_bytes);
+
+public:
+  RemoteZip(HttpClient client, cpr::Url url);
+
+  /*
+   * Fetches the central directory. Returns false if the server doesn't
+   * support range requests or the archive can't be parsed, so it must
+   * be downloaded entirely instead.
+   */
+  auto open() -> bool;
+  [[nodiscard]] inline auto get_directory() const -> const auto&
+      { return m_directory; }
+
+  /*
+   * Fetches data of an entry and decompresses it to the stream. Callback
+   * receives number of bytes fetched since the previous call. If sha256
+   * isn't null, then decompressed data is hashed by it as it's written.
+   * Nothing is written unless the server responds with partial content.
+   * Throws an exception on failure, including CRC-32 mismatch.
+   */
+  void extract(const ZipDirectory::Entry& entry, std::ostream& os,
+      const std::function<fetch_callback_t>& callback = {},
+      Sha256* sha256 = nullptr) const;
+
+private:
+  // Local file header can have larger extra field than its central copy.
+  static constexpr std::size_t LOCAL_EXTRA_RESERVE{512U};
+  static constexpr std::size_t INFLATE_BUFFER_SIZE{1U << 16U};
+
+  // Returns exactly size bytes. Throws an exception on failure.
+  [[nodiscard]] auto fetch(
+      std::uint64_t offset, std::uint64_t size) const -> std::string;
+  [[nodiscard]] static auto
+      make_range(std::uint64_t offset, std::uint64_t size) -> cpr::Header;
+
+  HttpClient m_client;
+  cpr::Url m_url;
+  std::uint64_t m_size{};
+  ZipDirectory m_directory;
+};
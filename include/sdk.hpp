@@ -6,30 +6,49 @@
 
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
-#include <fstream>
+#include <functional>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <string_view>
+#include <system_error>
 
-#include <fcli/progress.hpp>
 #include <fcli/terminal.hpp>
 
+#include <cpr/cprtypes.h>
 #include <cpr/response.h>
-#include <libzippp/libzippp.h>
 #include <pugixml.hpp>
 
 #include "config.hpp"
+#include "downloader.hpp"
+#include "http_client.hpp"
+#include "ledger.hpp"
+#include "local_zip.hpp"
+#include "multi_progress.hpp"
+#include "remote_zip.hpp"
 #include "tmp_file.hpp"
 
 /*
  * This class has two main aims:
  * 1. download and install files, that required to build applications;
  * 2. provide paths to this files.
+ *
+ * Several API versions can be installed side by side. Files of each of them
+ * are located in its own directory, while API independent files are shared.
+ *
+ * Besides the user's root directory, files are looked up in the system-wide
+ * store, which has the same layout and is used read-only. It can be filled
+ * by installing SDK with XDG_DATA_HOME pointing to the parent directory of
+ * the store. APIs installed by a user take precedence over the store ones.
  */
 class Sdk {
 public:
   static constexpr std::string_view DEBUG_KEYSTORE_PASSWORD{"android"};
+  // Path of the system-wide store. Empty value disables the store.
+  static constexpr std::string_view SYSTEM_DIR_ENV_VAR{"APM_SYSTEM_SDK_DIR"};
 
   enum class Tool {
     // Compiles and packages APK's resources.
@@ -61,93 +80,277 @@ public:
     _COUNT
   };
 
-  // Assigns (doesn't create) the root directory path.
+  /*
+   * Assigns (doesn't create) the root and cache directory paths. The latest
+   * installed API is selected, so paths of its files will be provided.
+   */
   Sdk();
-  // Starts interactive installation process. If SDK already installed,
-  // then API version should be passed. Returns program execution status.
-  auto install(std::shared_ptr<Config> config, const fcli::Terminal& term,
-               unsigned short installed_api = {}) -> int;
+  // Starts interactive installation process. Returns program execution status.
+  auto install(std::shared_ptr<Config> config,
+               const fcli::Terminal& term) -> int;
+
+  /*
+   * Checks files of all installed APIs against the checksums recorded while
+   * installing and reports all problems at once. Components with corrupted
+   * files are forgotten, so the next installation will repair them. Returns
+   * program execution status.
+   */
+  auto verify(const fcli::Terminal& term) const -> int;
+
+  /*
+   * Packs verified files of all installed APIs along with the ledger into a
+   * single archive (bundle), so SDK can be installed without network access.
+   * Returns program execution status.
+   */
+  auto export_bundle(const std::filesystem::path& path,
+                     const fcli::Terminal& term) const -> int;
+  /*
+   * Installs SDK from a bundle or from a directory with the same layout as
+   * the root one (mirror). Installed files are verified against the bundled
+   * ledger. Returns program execution status.
+   */
+  auto install_bundle(const std::filesystem::path& source,
+      std::shared_ptr<Config> config, const fcli::Terminal& term) -> int;
 
+  // Only completely installed APIs (in any store) are returned.
+  [[nodiscard]] auto get_installed_apis() const -> std::set<unsigned short>;
+  /*
+   * Previous versions installed files of a single API directly to the root
+   * directory. This function moves them to the directory of the passed API
+   * (that was saved in the configuration). Errors are ignored.
+   */
+  void adopt_legacy_files(unsigned short api);
+
+  // Selects API, which files will be provided by the getters.
+  inline void set_api(const unsigned short api) { m_api = api; }
+  // Returns zero if there are no installed APIs.
+  [[nodiscard]] inline auto get_api() const { return m_api; }
+  // Large files will be downloaded using this number of connections.
+  inline void set_download_segments(const unsigned short count)
+      { m_downloader.set_segments_count(count); }
+
+  /*
+   * If must_exist set to true and a file doesn't exist, runtime_error will
+   * be thrown. Files of the given API are provided, or files of the selected
+   * one if api is zero.
+   */
+  [[nodiscard]] auto get_tool_path(Tool tool, bool must_exist = true,
+      unsigned short api = 0U) const -> std::filesystem::path;
+  [[nodiscard]] auto get_jar_path(Jar jar, bool must_exist = true,
+      unsigned short api = 0U) const -> std::filesystem::path;
   // If must_exist set to true and a file
   // doesn't exist, runtime_error will be thrown.
-  [[nodiscard]] auto get_tool_path(
-      Tool tool, bool must_exist = true) const -> std::filesystem::path;
-  [[nodiscard]] auto get_jar_path(
-      Jar jar, bool must_exist = true) const -> std::filesystem::path;
   [[nodiscard]] auto get_file_path(
       File file, bool must_exist = true) const -> std::filesystem::path;
 
 private:
+  // Entry of a remote archive to install.
+  struct ZipEntryTarget {
+    std::filesystem::path output_path;
+    // Checksum of the entry data from the manifest, can be empty. Entries
+    // without checksums can't be fetched separately from their archive,
+    // since CRC-32 from the central directory isn't trusted.
+    std::string sha256;
+  };
+
   static constexpr std::string_view
       ROOT_DIR_NAME{"apm"},
       TOOLS_SUBDIR_NAME{"bin"},
-      JARS_SUBDIR_NAME{"lib"};
+      JARS_SUBDIR_NAME{"lib"},
+      // Followed by API version.
+      API_DIR_PREFIX{"api-"},
+      // Used if the environment variable isn't set.
+      DEFAULT_SYSTEM_DIR{"/opt/apm"};
+  // Suffix of the blob path, where entries fetched from a remote archive
+  // are cached (the archive itself isn't downloaded in that case).
+  static constexpr std::string_view ENTRIES_DIR_SUFFIX{".entries"};
+  // Archives of larger size aren't kept in memory by download_to_memory.
+  static constexpr std::uint64_t MAX_MEMORY_ARCHIVE_SIZE{1U << 27U};
+  // Located in the root directory.
+  static constexpr std::string_view LEDGER_FILE_NAME{"ledger"};
+  // Ledger of a bundle is placed to the root directory while installing.
+  static constexpr std::string_view IMPORTED_LEDGER_FILE_NAME{"ledger.import"};
+  // Subdirectory of the root one, where a bundle is unpacked and verified
+  // before its files replace the installed ones.
+  static constexpr std::string_view STAGING_DIR_NAME{".staging"};
 
   static constexpr std::string_view
       REPO_RAW_URL_PREFIX{"https://github.com/lem0nez/apm/raw/data/"};
+  // Cached copy of the manifest is located in the cache directory. File with
+  // the validators (ETag and Last-Modified values) is named after the copy.
+  static constexpr std::string_view
+      MANIFEST_FILE_NAME{"manifest.xml"},
+      VALIDATORS_FILE_EXTENSION{".validators"};
 
-  // Returns empty document on failure.
-  [[nodiscard]] static auto download_manifest(
-      unsigned short progress_width) -> pugi::xml_document;
+  /*
+   * Downloads the manifest only if it has been changed since the cached copy
+   * was saved. The cached copy is also used if the server is unreachable.
+   * Returns empty document on failure.
+   */
+  [[nodiscard]] auto download_manifest(
+      unsigned short progress_width) const -> pugi::xml_document;
+  // Errors are ignored, since the cached copy isn't required.
+  static void save_manifest(const cpr::Response& response,
+                            const std::filesystem::path& path,
+                            const std::filesystem::path& validators_path);
   // Returns zero on failure.
-  [[nodiscard]] static auto
-      request_api(const pugi::xml_document& manifest) -> unsigned short;
+  [[nodiscard]] static auto request_api(const pugi::xml_document& manifest,
+      const std::set<unsigned short>& installed_apis) -> unsigned short;
   // Throws an exception of failure.
-  void create_dirs() const;
+  void create_dirs(std::string_view api) const;
 
   /*
-   * These install functions returns false on failure. Stream of the temporary
-   * file must be opened in binary output mode before calling each of function.
-   * Passing API version as string, since all functions use this number only in
-   * strings.
+   * These install functions returns false on failure. They are running
+   * concurrently, so each of them adds its own bar to the progress and
+   * downloads archives to its own temporary file. Passing API version as
+   * string, since all functions use this number only in strings.
+   *
+   * Components, that are up to date according to the ledger, are skipped.
+   * Installed ones are recorded to the ledger.
    */
 
   using api_dependent_install_func_t = auto (const pugi::xml_document& manifest,
-      const std::string& api, TmpFile<std::ofstream>& tmp_file,
-      unsigned short progress_width) const -> bool;
+      const std::string& api, MultiProgress& progress,
+      Ledger& ledger) const -> bool;
   api_dependent_install_func_t
       install_tools,
       install_build_tools,
       install_framework;
 
-  auto download_apm_jar(const pugi::xml_document& manifest,
-      unsigned short progress_width) const -> bool;
-  auto install_tzdata(
-      const pugi::xml_document& manifest, TmpFile<std::ofstream>& tmp_file,
-      unsigned short progress_width) const -> bool;
-  auto download_assets(const pugi::xml_document& manifest,
-      unsigned short progress_width) const -> bool;
+  using api_independent_install_func_t = auto (
+      const pugi::xml_document& manifest,
+      MultiProgress& progress, Ledger& ledger) const -> bool;
+  api_independent_install_func_t
+      download_apm_jar,
+      install_tzdata,
+      download_assets;
 
   /*
    * If HTTP status isn't OK, this function hides progress, prints the failure
    * message and returns false. fail_using_progress determines whether to use
-   * the Progress's finish function or cerr to print the failure message.
+   * the bar's finish function or cerr to print the failure message.
    */
   [[nodiscard]] static auto check_response(const cpr::Response& response,
-      std::string_view failure_msg, fcli::Progress& progress,
+      std::string_view failure_msg, MultiProgress::Bar& progress,
       bool fail_using_progress = true) -> bool;
   // Gets value of sha256 attribute. Returns empty string on failure.
   [[nodiscard]] static auto get_sha256(
       const pugi::xml_node& node) -> std::string;
   /*
-   * Sets progress as undetermined, changes its text, compares checksums and if
-   * they are not equal, finishes progress with the failure message and returns
-   * false.
-   */
-  [[nodiscard]] static auto check_sha256(
-      const std::filesystem::path& file_path, std::string_view checksum,
-      fcli::Progress& progress, std::string_view failure_msg) -> bool;
-  // Do the same as check_response and check_sha256. Subject used in the
-  // failure messages (that print using the Progress's finish function).
-  [[nodiscard]] static auto check_response_and_sha256(
-      const cpr::Response& response, const std::filesystem::path& file_path,
+   * Returns path of the cached file, downloading it if required. An
+   * interrupted download will be resumed by the next call. On failure
+   * finishes progress with the failure message (subject is used in it)
+   * and returns empty path.
+   */
+  [[nodiscard]] auto fetch_file(const cpr::Url& url,
       std::string_view checksum, std::string_view subject,
-      fcli::Progress& progress) -> bool;
-  // Before extracting updates text of progress. On failure
-  // finishes progress with the failure message and returns false.
-  [[nodiscard]] static auto extract_zip_entry(
-      const libzippp::ZipEntry& entry, const std::filesystem::path& output_path,
-      std::string_view name, fcli::Progress& progress) -> bool;
-
-  std::filesystem::path m_root_dir_path;
+      MultiProgress::Bar& progress) const -> std::filesystem::path;
+  /*
+   * Returns a callback, which shows percents and downloaded size of a file
+   * using the progress bar. Bar must outlive the callback.
+   */
+  [[nodiscard]] static auto make_download_callback(MultiProgress::Bar& progress)
+      -> std::function<void (std::uint64_t downloaded, std::uint64_t total)>;
+  /*
+   * Downloads a file to memory verifying its checksum, nothing is cached.
+   * Files, which are larger than MAX_MEMORY_ARCHIVE_SIZE or which size isn't
+   * reported by the server, are downloaded to a temporary file on disk. On
+   * failure finishes progress with the failure message and returns nullptr.
+   */
+  [[nodiscard]] auto download_to_memory(const cpr::Url& url,
+      std::string_view checksum, std::string_view subject,
+      MultiProgress::Bar& progress) const -> std::unique_ptr<TmpFile<>>;
+  // Fetches a file and copies it to output_path. Returns false on failure.
+  [[nodiscard]] auto download_file(const cpr::Url& url,
+      std::string_view checksum, const std::filesystem::path& output_path,
+      std::string_view subject, MultiProgress::Bar& progress) const -> bool;
+  /*
+   * Extracts entries (key is name of an entry) from a remote archive. If the
+   * manifest provides checksums of all entries and the server supports range
+   * requests, then only the required entries are fetched, verified and
+   * cached. Otherwise the entire archive is downloaded and its checksum is
+   * verified. Subject is used in the failure messages.
+   */
+  [[nodiscard]] auto install_zip_entries(const cpr::Url& url,
+      std::string_view checksum,
+      const std::map<std::string, ZipEntryTarget>& entries,
+      std::string_view subject, MultiProgress::Bar& progress) const -> bool;
+  /*
+   * Fetches entries to output_dir preserving their paths in the archive. An
+   * entry is moved there only after its checksum is verified.
+   */
+  [[nodiscard]] static auto fetch_zip_entries(const RemoteZip& remote_zip,
+      const std::map<std::string, ZipEntryTarget>& entries,
+      const std::filesystem::path& output_dir, std::string_view subject,
+      MultiProgress::Bar& progress) -> bool;
+  /*
+   * Extracts entries of a local archive concurrently. Before extracting
+   * updates text of progress. On failure finishes progress with the failure
+   * message and returns false.
+   */
+  [[nodiscard]] static auto extract_zip_entries(const LocalZip& zip,
+      const std::vector<LocalZip::Target>& targets, std::string_view subject,
+      MultiProgress::Bar& progress) -> bool;
+
+  /*
+   * Copies files recorded in the ledger of a bundle or mirror, along with the
+   * ledger itself, to output_dir. On failure finishes progress with the
+   * failure message and returns false.
+   */
+  [[nodiscard]] static auto unpack_bundle(const std::filesystem::path& source,
+      const std::filesystem::path& output_dir, MultiProgress::Bar& progress)
+      -> bool;
+  /*
+   * Replaces files with the same content (according to the ledger) across
+   * installed APIs by hard links to a single file, so they share disk space
+   * and page cache. If a hard link can't be created, then the file is cloned
+   * (shares data on disk only). Prints size of the saved space.
+   */
+  void deduplicate(Ledger& ledger) const;
+  // Atomically replaces target by a hard link to or a clone of source.
+  [[nodiscard]] static auto share_file(const std::filesystem::path& source,
+      const std::filesystem::path& target) -> bool;
+  // Unlike copy_file, hard links of the replaced file aren't affected.
+  static void replace_file(const std::filesystem::path& from,
+      const std::filesystem::path& to, std::error_code& err);
+  // Returns callback for Ledger::verify, which limits progress refresh rate.
+  [[nodiscard]] static auto make_verify_callback(MultiProgress::Bar& progress)
+      -> std::function<void (std::uintmax_t, std::uintmax_t)>;
+
+  /*
+   * Returns directory (the root or the system one), where all files of API
+   * are located. Returns nullptr if API isn't installed.
+   */
+  [[nodiscard]] auto find_api_store(
+      std::string_view api) const -> const std::filesystem::path*;
+  /*
+   * Returns path of an API independent file in the system store if the file
+   * is missing in the root directory. Otherwise path is returned as is.
+   */
+  [[nodiscard]] auto resolve_shared(
+      const std::filesystem::path& path) const -> std::filesystem::path;
+  // Replaces the root directory prefix of path by another directory.
+  [[nodiscard]] auto rebase(const std::filesystem::path& path,
+      const std::filesystem::path& dir) const -> std::filesystem::path;
+
+  // Following functions return paths in the root directory.
+  // If API is empty, then the root directory will be returned.
+  [[nodiscard]] auto
+      get_api_dir(std::string_view api) const -> std::filesystem::path;
+  // API is ignored for API independent files.
+  [[nodiscard]] auto make_tool_path(
+      Tool tool, std::string_view api) const -> std::filesystem::path;
+  [[nodiscard]] auto make_jar_path(
+      Jar jar, std::string_view api) const -> std::filesystem::path;
+  [[nodiscard]] auto make_file_path(File file) const -> std::filesystem::path;
+
+  std::filesystem::path
+      m_root_dir_path,
+      m_cache_dir_path,
+      // Empty if the store is disabled.
+      m_system_dir_path;
+  // Shared by all requests, so connections to the same host are reused.
+  HttpClient m_http_client;
+  Downloader m_downloader;
+  unsigned short m_api{};
 };
@@ -0,0 +1,42 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <openssl/evp.h>
+
+/*
+ * Incremental SHA-256 calculator. Using the EVP interface of OpenSSL,
+ * since it selects the fastest implementation for a CPU (e. g. SHA-NI
+ * or ARMv8 cryptographic extensions).
+ */
+class Sha256 {
+public:
+  // Throws an exception on failure.
+  Sha256();
+
+  // Returns false on failure.
+  auto update(const void* data, std::size_t size) -> bool;
+  /*
+   * Returns lowercase hexadecimal digest or empty string on failure.
+   * After calling this function the calculator starts from scratch.
+   */
+  [[nodiscard]] auto finish() -> std::string;
+
+private:
+  struct CtxDeleter {
+    inline void operator()(EVP_MD_CTX* ctx) const { EVP_MD_CTX_free(ctx); }
+  };
+
+  // Returns false on failure.
+  auto init() -> bool;
+
+  std::unique_ptr<EVP_MD_CTX, CtxDeleter> m_ctx;
+};
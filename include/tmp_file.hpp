@@ -17,9 +17,24 @@ public:
                 std::is_base_of_v<std::ofstream, T> ||
                 std::is_base_of_v<std::ifstream, T>,
                 "T must be a file stream");
+
+  enum class Storage {
+    // Named file in the temporary directory.
+    DISK,
+    /*
+     * Anonymous file in RAM (created by memfd_create). If it's not
+     * supported, then an anonymous file (O_TMPFILE) in the temporary
+     * directory is used, or a named one as the last resort. Path of an
+     * anonymous file refers to its descriptor, so it's valid only within
+     * the process and can't be removed.
+     */
+    MEMORY
+  };
+
   // Creates a temporary file and opens a stream. Can throw an exception.
   // If no flags are specified then default openmode for T will be used.
-  explicit TmpFile(std::ios::openmode openmode = {});
+  explicit TmpFile(std::ios::openmode openmode = {},
+                   Storage storage = Storage::DISK);
   // Closes the stream and deletes the file.
   ~TmpFile();
 
@@ -32,9 +47,9 @@ public:
    * move assignment operator of file stream classes throw exceptions.
    */
   // NOLINTNEXTLINE(hicpp-noexcept-move)
-  TmpFile(TmpFile&&) = default;
+  TmpFile(TmpFile&& other);
   // NOLINTNEXTLINE(hicpp-noexcept-move)
-  auto operator=(TmpFile&&) -> TmpFile& = default;
+  auto operator=(TmpFile&& other) -> TmpFile&;
 
   [[nodiscard]] inline auto get_stream() -> auto& { return m_stream; }
   [[nodiscard]] inline auto get_path() const { return m_path; }
@@ -42,8 +57,14 @@ public:
 private:
   static constexpr std::string_view NAME_TEMPLATE{"apm-XXXXXX"};
 
+  // Returns descriptor of an anonymous file or -1 on failure.
+  [[nodiscard]] static auto create_anonymous() -> int;
+  void release();
+
   // Store a path as it required to delete the file.
   std::filesystem::path m_path;
+  // Descriptor of an anonymous file, that keeps it alive.
+  int m_anonymous_fd{-1};
   T m_stream;
 };
 
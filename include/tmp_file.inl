@@ -8,32 +8,94 @@
 #include <stdexcept>
 #include <string>
 #include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
-template <typename T> TmpFile<T>::TmpFile(const std::ios::openmode t_openmode) {
+template <typename T> TmpFile<T>::TmpFile(
+    const std::ios::openmode t_openmode, const Storage t_storage) {
   using namespace std;
-  // Using string instead of path so the mkstemp function can modify data.
-  string path{filesystem::temp_directory_path() / NAME_TEMPLATE};
-  const auto fd{mkstemp(path.data())};
 
-  if (fd == -1) {
-    throw runtime_error("failed to create a temporary file");
+  if (t_storage == Storage::MEMORY) {
+    m_anonymous_fd = create_anonymous();
+  }
+
+  if (m_anonymous_fd != -1) {
+    m_path = "/proc/self/fd/" + to_string(m_anonymous_fd);
+  } else {
+    // Using string instead of path so the mkstemp function can modify data.
+    string path{filesystem::temp_directory_path() / NAME_TEMPLATE};
+    const auto fd{mkstemp(path.data())};
+
+    if (fd == -1) {
+      throw runtime_error("failed to create a temporary file");
+    }
+    m_path = path;
+    close(fd);
   }
 
-  m_path = path;
   if (t_openmode == ios::openmode{}) {
     m_stream.open(m_path);
   } else {
     m_stream.open(m_path, t_openmode);
   }
-  close(fd);
+  if (!m_stream.is_open()) {
+    release();
+    throw runtime_error("failed to open a temporary file");
+  }
 }
 
 template<typename T> TmpFile<T>::~TmpFile() {
+  release();
+}
+
+template<typename T> TmpFile<T>::TmpFile(TmpFile&& t_other):
+    m_path(std::move(t_other.m_path)),
+    m_anonymous_fd(std::exchange(t_other.m_anonymous_fd, -1)),
+    m_stream(std::move(t_other.m_stream)) {
+  t_other.m_path.clear();
+}
+
+template<typename T>
+auto TmpFile<T>::operator=(TmpFile&& t_other) -> TmpFile& {
+  if (this != &t_other) {
+    release();
+    m_path = std::move(t_other.m_path);
+    t_other.m_path.clear();
+    m_anonymous_fd = std::exchange(t_other.m_anonymous_fd, -1);
+    m_stream = std::move(t_other.m_stream);
+  }
+  return *this;
+}
+
+template<typename T> auto TmpFile<T>::create_anonymous() -> int {
+  using namespace std;
+
+  // File is removed automatically when the last descriptor is closed.
+  int fd{memfd_create(string(NAME_TEMPLATE).c_str(), MFD_CLOEXEC)};
+  if (fd == -1) {
+    error_code err;
+    const auto dir{filesystem::temp_directory_path(err)};
+    if (!err) {
+      fd = open(dir.c_str(), O_RDWR | O_TMPFILE | O_CLOEXEC, 0600);
+    }
+  }
+  return fd;
+}
+
+template<typename T> void TmpFile<T>::release() {
   using namespace std;
 
   m_stream.close();
-  error_code err;
-  // Using a non-throwing function, since we're inside the destructor.
-  filesystem::remove(m_path, err);
+  if (m_anonymous_fd != -1) {
+    close(m_anonymous_fd);
+    m_anonymous_fd = -1;
+  } else if (!m_path.empty()) {
+    error_code err;
+    // Using a non-throwing function, since we're inside the destructor.
+    filesystem::remove(m_path, err);
+  }
+  m_path.clear();
 }
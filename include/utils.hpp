@@ -8,7 +8,6 @@
 
 #include <cstdint>
 #include <filesystem>
-#include <fstream>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -17,10 +16,6 @@
 #include <string_view>
 #include <vector>
 
-#include <cpr/cprtypes.h>
-#include <cpr/response.h>
-
-#include <fcli/progress.hpp>
 #include <fcli/terminal.hpp>
 
 #include "general/enum_array.hpp"
@@ -79,26 +74,25 @@ public:
     return std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
   }
 
-  /*
-   * Downloads a file with progress reporting. append_size determines
-   * whether to append downloaded and total file sizes to the text of
-   * progress bar (original text will be restored after downloading).
-   *
-   * If progress is undetermined, then total
-   * file size and percents won't be reported.
-   */
-  static auto download(std::ofstream& ofs, const cpr::Url& url,
-      fcli::Progress& progress, bool append_size = true) -> cpr::Response;
-
   // Returns empty string on failure.
   [[nodiscard]] static auto calc_sha256(
       const std::filesystem::path& path) -> std::string;
+  /*
+   * Replaces the file atomically with a copy, unless it already has the same
+   * content. The copy gets modification time of the source, so a target with
+   * the same size and time is considered unchanged without hashing. Data is
+   * shared using reflink on copy-on-write file systems, copied by the kernel
+   * (using copy_file_range) on others or copied through a buffer as the last
+   * resort. Returns false on failure.
+   */
+  static auto copy_file(const std::filesystem::path& from,
+                        const std::filesystem::path& to) -> bool;
 
   /*
    * Executes a command in a new process. If a callback is provided, it will be
    * called every time when entire line retrieved or EOF of a stream reached. If
-   * work_dir is provided, function will change the current working directory
-   * before executing the command and then will restore it.
+   * work_dir is provided, the command will be executed in it (working
+   * directory of the calling process isn't changed).
    */
   static auto exec(const std::vector<std::string>& cmd,
       const std::function<output_callback_t>& out_callback = {},
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Parser of the ZIP central directory (including ZIP64 extensions). It works
+ * with raw bytes, so data can be read from any source: local file, memory
+ * or remote server. All functions throw runtime_error on malformed data.
+ */
+class ZipDirectory {
+public:
+  enum class Method : std::uint16_t {
+    STORED = 0U,
+    DEFLATED = 8U
+  };
+
+  struct Entry {
+    std::string name;
+    std::uint16_t version_made_by{};
+    std::uint16_t flags{};
+    Method method{};
+    std::uint16_t mod_time{};
+    std::uint16_t mod_date{};
+    std::uint32_t crc32{};
+    std::uint64_t compressed_size{};
+    std::uint64_t uncompressed_size{};
+    std::uint32_t external_attrs{};
+    // Offset of the local file header.
+    std::uint64_t local_header_offset{};
+  };
+
+  // Location of the central directory within an archive.
+  struct Location {
+    std::uint64_t offset{};
+    std::uint64_t size{};
+    std::uint64_t entries_count{};
+  };
+
+  // Size of the end of central directory record without comment.
+  static constexpr std::size_t EOCD_SIZE{22U};
+  // Maximum size of the archive's tail, that contains the end of central
+  // directory record (including comment) and the ZIP64 structures.
+  static constexpr std::size_t MAX_TAIL_SIZE{EOCD_SIZE + UINT16_MAX + 76U};
+  // Size of the local file header without file name and extra field.
+  static constexpr std::size_t LOCAL_HEADER_SIZE{30U};
+
+  ZipDirectory() = default;
+  // Parses the entire central directory.
+  explicit ZipDirectory(std::string_view data);
+
+  /*
+   * Searches for the end of central directory record in the last bytes
+   * (tail) of an archive. tail_offset is position of tail in the archive.
+   */
+  [[nodiscard]] static auto find_location(
+      std::string_view tail, std::uint64_t tail_offset) -> Location;
+  /*
+   * Returns size of the local file header (including variable fields). At
+   * least LOCAL_HEADER_SIZE bytes of the header must be passed. Compressed
+   * data of an entry starts right after the header.
+   */
+  [[nodiscard]] static auto
+      get_local_header_size(std::string_view header) -> std::size_t;
+
+  // Returns nullptr if there is no such entry.
+  [[nodiscard]] auto find(std::string_view name) const -> const Entry*;
+  // Entries are in order of the central directory.
+  [[nodiscard]] inline auto get_entries() const -> const auto&
+      { return m_entries; }
+
+  /*
+   * Reads little-endian integer. There are no alignment requirements
+   * for data, since fields of ZIP structures aren't aligned.
+   */
+  template<typename T> [[nodiscard]] static auto
+      read_le(std::string_view data, std::size_t offset) -> T;
+
+private:
+  std::vector<Entry> m_entries;
+  // Key is name of an entry and value is index in the entries vector.
+  std::map<std::string, std::size_t, std::less<>> m_indexes;
+};
+
+#include "zip_directory.inl"
@@ -0,0 +1,23 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <stdexcept>
+#include <type_traits>
+
+template<typename T> auto ZipDirectory::read_le(
+    const std::string_view t_data, const std::size_t t_offset) -> T {
+  static_assert(std::is_unsigned_v<T>, "T must be unsigned integer");
+
+  if (t_offset > t_data.size() || t_data.size() - t_offset < sizeof(T)) {
+    throw std::runtime_error("unexpected end of ZIP data");
+  }
+  T val{};
+  for (std::size_t i{}; i != sizeof(T); ++i) {
+    val |= static_cast<T>(static_cast<T>(
+           static_cast<unsigned char>(t_data[t_offset + i])) << (i * 8U));
+  }
+  return val;
+}
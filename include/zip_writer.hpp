@@ -0,0 +1,208 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "local_zip.hpp"
+#include "zip_directory.hpp"
+
+/*
+ * Writes a ZIP archive. Without compression files are stored, so they can be
+ * extracted by copying ranges of the archive. Otherwise data of entries is
+ * split into blocks, which are deflated concurrently. Entries of other
+ * archives can be copied without recompression. Stored and copied data is
+ * written by the kernel (using copy_file_range), so memory usage doesn't
+ * depend on sizes of files. Permissions of files are preserved. Data of
+ * stored entries is aligned like zipalign does it (using padding in the
+ * extra field of the local header), so it can be accessed straight from
+ * memory. ZIP64 extensions aren't supported, so an archive is limited to
+ * 4 GiB and 65535 entries. All functions throw runtime_error on failure.
+ */
+class ZipWriter {
+public:
+  enum class Compression {
+    // All entries are stored.
+    NONE,
+    // Fast deflating for debug builds.
+    FAST,
+    // The best deflating for release builds.
+    MAXIMUM
+  };
+
+  // Alignment of data of stored entries, if another one isn't requested.
+  static constexpr std::size_t DEFAULT_ALIGNMENT{4U};
+
+  /*
+   * Creates (or truncates) the archive. If update is true, then an existing
+   * archive is updated in place instead: entries with unchanged data stay
+   * where they are and data of new or changed entries is appended, entries
+   * which aren't added again are dropped. Stale space is compacted when it
+   * takes more than a quarter of the archive. If writing fails, the archive
+   * remains broken, so the next update rewrites it entirely.
+   */
+  explicit ZipWriter(const std::filesystem::path& path,
+      Compression compression = Compression::NONE, bool update = false);
+
+  /*
+   * Already compressed files (detected by extension or by sampling of
+   * content) are stored. If alignment (a power of two up to 32 KiB) isn't
+   * zero, then the file is stored and its data is aligned to it (e. g. to
+   * the page size, so it can be mapped into memory). Blocks are processed
+   * in the background, so failure of writing an entry can be reported by
+   * subsequent calls.
+   */
+  void add(std::string_view name, const std::filesystem::path& file_path,
+           std::size_t alignment = 0U);
+  /*
+   * Copies data of an entry of another archive as is, so it isn't
+   * decompressed and compressed again. The entry must be stored or deflated,
+   * and it must be stored if alignment isn't zero.
+   */
+  void copy(const LocalZip& zip, const ZipDirectory::Entry& entry,
+            std::size_t alignment = 0U);
+  /*
+   * Entries of a previous archive (e. g. of the previous build) are copied
+   * instead of compressing added files with the same name, size and CRC-32.
+   * The previous archive mustn't be the one being written. Returns false if
+   * it can't be opened, then all files are compressed.
+   */
+  auto reuse(const std::filesystem::path& previous_path) -> bool;
+  // Writes the central directory and closes the archive.
+  void finish();
+
+private:
+  using Method = ZipDirectory::Method;
+
+  struct Record {
+    std::string name;
+    Method method{};
+    std::uint16_t flags{};
+    // Data is copied from another archive, so the CRC-32 and sizes are known.
+    bool is_copied{};
+    // CRC-32 of an added file is calculated before its data is processed.
+    bool is_hashed{};
+    std::uint32_t crc32{};
+    std::uint64_t compressed_size{};
+    std::uint64_t size{};
+    std::uint64_t local_header_offset{};
+    // Including name and extra field.
+    std::uint64_t local_header_size{};
+    // Applies only to stored data.
+    std::size_t alignment{DEFAULT_ALIGNMENT};
+    // Unix permissions.
+    std::uint32_t mode{};
+  };
+
+  // Processed part of data of an entry.
+  struct Block {
+    std::string data;
+    std::uint32_t crc32{};
+    // Size of the unprocessed data.
+    std::size_t size{};
+    bool is_deflated{};
+    // Range of a file, which is written instead of data.
+    std::shared_ptr<const int> source_fd;
+    std::uint64_t source_offset{};
+    std::uint64_t source_size{};
+  };
+  struct PendingBlock {
+    std::size_t record_idx{};
+    bool is_first{};
+    bool is_last{};
+    std::future<Block> block;
+  };
+
+  static constexpr std::size_t
+      DATA_BLOCK_SIZE{1U << 20U},
+      // Size of the deflate window. Tail of the previous block is used as
+      // dictionary for the next one, so splitting barely affects the ratio.
+      DICTIONARY_SIZE{1U << 15U};
+
+  // Returns false if the archive can't be updated in place.
+  auto load(const std::filesystem::path& path) -> bool;
+  [[nodiscard]] static auto make_record(const ZipDirectory::Entry& entry)
+      -> Record;
+  // Returns the default alignment for zero. Throws if alignment is invalid.
+  [[nodiscard]] static auto get_alignment(std::size_t alignment)
+      -> std::size_t;
+  /*
+   * Returns true if an entry can replace a file of the passed size, then
+   * CRC-32 of the file must be compared. If must_store is true, then only
+   * stored entries are suitable.
+   */
+  [[nodiscard]] auto can_reuse(Method method, std::uint64_t size,
+      std::uint64_t file_size, bool must_store) const -> bool;
+  // Reads rest of a file and rewinds it.
+  [[nodiscard]] static auto calc_crc32(std::ifstream& ifs,
+      const std::filesystem::path& file_path) -> std::uint32_t;
+
+  // Returns false if data shouldn't be deflated. Sample is start of a file.
+  [[nodiscard]] static auto is_compressible(
+      const std::filesystem::path& file_path, std::string_view sample) -> bool;
+  /*
+   * Queues blocks of a file, which are copied by the kernel, so only their
+   * CRC-32 is calculated by the process (unless the file is already hashed).
+   * Memory usage doesn't depend on size of the file.
+   */
+  void add_stored(const std::filesystem::path& file_path,
+                  std::uint64_t size, bool is_hashed);
+  [[nodiscard]] static auto hash_range(std::shared_ptr<const int> fd,
+      std::uint64_t offset, std::size_t size, std::filesystem::path file_path)
+      -> Block;
+  /*
+   * Calculates CRC-32 and deflates data. Blocks of an entry are independent
+   * raw deflate streams, which are flushed to byte boundary, so they can be
+   * concatenated. Data of an entry, that consists of a single block, is
+   * stored if deflating doesn't help. CRC-32 isn't calculated if the file
+   * is already hashed.
+   */
+  [[nodiscard]] static auto process_block(std::string data,
+      std::string dictionary, int level, bool is_first, bool is_last,
+      bool is_hashed) -> Block;
+  // Queues data of an entry of another archive.
+  void copy(const LocalZip& zip,
+            const ZipDirectory::Entry& entry, Record record);
+  // Waits for the oldest pending block and writes it.
+  void write_next();
+  // Pads the extra field to align stored data.
+  void write_local_header(const Record& record);
+  /*
+   * Moves entries to the beginning of the archive eliminating gaps. Stored
+   * entries are moved by multiples of their alignment, so it's preserved.
+   */
+  void compact();
+
+  [[nodiscard]] auto get_flags(Method method) const -> std::uint16_t;
+
+  std::filesystem::path m_path;
+  std::ofstream m_ofs;
+  Compression m_compression;
+  std::vector<Record> m_records;
+  // Entries of the updated archive, which aren't added yet.
+  std::map<std::string, Record, std::less<>> m_old_records;
+  bool m_is_updating{};
+  // Blocks in order of writing.
+  std::deque<PendingBlock> m_pending;
+  std::unique_ptr<LocalZip> m_previous;
+  // Descriptor of the archive to copy ranges of files.
+  std::shared_ptr<const int> m_fd;
+  // Limits memory usage while letting all cores work.
+  std::size_t m_max_pending_count{};
+  std::uint64_t m_offset{};
+};
@@ -0,0 +1,362 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <zlib.h>
+
+#include "apk_digests.hpp"
+#include "sha256.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+namespace {
+/*
+ * Calls the function for every index concurrently. Throws the first occurred
+ * exception after all threads are stopped.
+ */
+void for_each_index(const size_t t_count, const unsigned t_threads_count,
+                    const function<void (size_t)>& t_func) {
+  // Guards the error.
+  mutex error_mutex;
+  exception_ptr error;
+
+  atomic_size_t next_index{};
+  const auto process{[&] {
+    try {
+      for (auto i{next_index++}; i < t_count; i = next_index++) {
+        t_func(i);
+      }
+    } catch (...) {
+      const lock_guard lock(error_mutex);
+      if (!error) {
+        error = current_exception();
+      }
+      // Stop other threads.
+      next_index = t_count;
+    }
+  }};
+
+  const auto threads_count{min<size_t>(
+      t_threads_count == 0U ? max(thread::hardware_concurrency(), 1U) :
+      t_threads_count, max<size_t>(t_count, 1U))};
+  vector<future<void>> results;
+  for (size_t t{}; t != threads_count; ++t) {
+    results.push_back(async(launch::async, process));
+  }
+  for (auto& r : results) {
+    r.get();
+  }
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+// Converts a hexadecimal digest to bytes.
+auto to_binary(const string_view t_hex) -> string {
+  if (t_hex.size() % 2U != 0U) {
+    throw runtime_error("malformed digest");
+  }
+  const auto to_nibble{[] (const char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    throw runtime_error("malformed digest");
+  }};
+
+  string result(t_hex.size() / 2U, '\0');
+  for (size_t i{}; i != result.size(); ++i) {
+    result[i] = static_cast<char>(
+        (to_nibble(t_hex[i * 2U]) << 4) | to_nibble(t_hex[i * 2U + 1U]));
+  }
+  return result;
+}
+
+// Prefix of a digest: magic byte and little-endian 32-bit count.
+auto make_prefix(const char t_magic, const size_t t_count) {
+  array<char, 5U> prefix{t_magic};
+  for (size_t i{}; i != 4U; ++i) {
+    prefix.at(i + 1U) = static_cast<char>((t_count >> (i * 8U)) & 0xFFU);
+  }
+  return prefix;
+}
+
+auto finish(Sha256& t_sha256) -> string {
+  auto digest{t_sha256.finish()};
+  if (digest.empty()) {
+    throw runtime_error("failed to calculate a digest");
+  }
+  return digest;
+}
+} // namespace
+
+ApkDigests::ApkDigests(path t_cache_path): m_cache_path(move(t_cache_path)) {
+  if (!load()) {
+    m_entries.clear();
+    m_section_size = 0U;
+    m_chunk_digests.clear();
+  }
+}
+
+void ApkDigests::update(const LocalZip& t_apk, const unsigned t_threads_count) {
+  const auto& zip_entries{t_apk.get_directory().get_entries()};
+  map<string_view, const Entry*> cached_entries;
+  for (const auto& e : m_entries) {
+    cached_entries.emplace(e.name, &e);
+  }
+
+  vector<Entry> entries(zip_entries.size());
+  atomic_size_t hashed_entries_count{};
+  for_each_index(entries.size(), t_threads_count, [&] (const size_t i) {
+    const auto iter{cached_entries.find(zip_entries[i].name)};
+    bool is_hashed{};
+    entries[i] = hash_entry(t_apk, zip_entries[i],
+        iter == cached_entries.cend() ? nullptr : iter->second, is_hashed);
+    if (is_hashed) {
+      ++hashed_entries_count;
+    }
+  });
+  sort(entries.begin(), entries.end(), [] (const auto& a, const auto& b) {
+    return a.offset < b.offset;
+  });
+
+  // The first section contains local headers and data of entries, the second
+  // one is the central directory and the third one is its end.
+  const auto& location{t_apk.get_location()};
+  const auto section_size{location.offset};
+  const auto chunks_count{(section_size + CHUNK_SIZE - 1U) / CHUNK_SIZE};
+  const auto unchanged_chunks{find_unchanged_chunks(entries, section_size)};
+
+  vector<string> chunk_digests(chunks_count);
+  atomic_size_t hashed_chunks_count{};
+  for_each_index(chunk_digests.size(), t_threads_count, [&] (const size_t i) {
+    if (unchanged_chunks[i]) {
+      chunk_digests[i] = m_chunk_digests[i];
+      return;
+    }
+    const auto offset{i * CHUNK_SIZE};
+    const auto size{static_cast<size_t>(
+        min<uint64_t>(CHUNK_SIZE, section_size - offset))};
+    string data(size, '\0');
+    t_apk.read_range(offset, data.data(), data.size());
+    chunk_digests[i] = hash_chunk(data.data(), data.size());
+    ++hashed_chunks_count;
+  });
+
+  auto all_digests{chunk_digests};
+  const auto directory_end{location.offset + location.size};
+  hash_range(t_apk, location.offset, location.size, all_digests);
+  hash_range(t_apk, directory_end,
+             t_apk.get_size() - directory_end, all_digests);
+
+  Sha256 sha256;
+  const auto prefix{make_prefix('\x5A', all_digests.size())};
+  if (!sha256.update(prefix.data(), prefix.size())) {
+    throw runtime_error("failed to calculate a digest");
+  }
+  for (const auto& d : all_digests) {
+    const auto digest{to_binary(d)};
+    if (!sha256.update(digest.data(), digest.size())) {
+      throw runtime_error("failed to calculate a digest");
+    }
+  }
+
+  m_content_digest = finish(sha256);
+  m_entries = move(entries);
+  m_section_size = section_size;
+  m_chunk_digests = move(chunk_digests);
+  m_hashed_entries_count = hashed_entries_count;
+  m_hashed_chunks_count = hashed_chunks_count;
+}
+
+auto ApkDigests::get_entry_digests() const ->
+    map<string, string, less<>> {
+  map<string, string, less<>> digests;
+  for (const auto& e : m_entries) {
+    digests.emplace(e.name, e.digest);
+  }
+  return digests;
+}
+
+auto ApkDigests::save() const -> bool {
+  error_code err;
+  create_directories(m_cache_path.parent_path(), err);
+  // Replace the file atomically, so it won't be left half-written.
+  auto tmp_path{m_cache_path};
+  tmp_path += ".tmp";
+  {
+    ofstream ofs(tmp_path, ios::trunc);
+    ofs << m_section_size << ' ' << m_chunk_digests.size() << ' ' <<
+           m_entries.size() << '\n';
+    for (const auto& d : m_chunk_digests) {
+      ofs << d << '\n';
+    }
+    // Name is the last field, since it may contain spaces.
+    for (const auto& e : m_entries) {
+      ofs << e.offset << ' ' << e.size << ' ' << e.header_crc32 << ' ' <<
+             e.crc32 << ' ' << e.compressed_size << ' ' <<
+             e.uncompressed_size << ' ' << e.digest << ' ' << e.name << '\n';
+    }
+    if (!ofs) {
+      return false;
+    }
+  }
+  rename(tmp_path, m_cache_path, err);
+  return !err;
+}
+
+// ---------------- +
+// Helper functions |
+// ---------------- +
+
+auto ApkDigests::load() -> bool {
+  ifstream ifs(m_cache_path);
+  if (!ifs) {
+    // Nothing is cached yet.
+    return true;
+  }
+
+  size_t chunks_count{}, entries_count{};
+  if (!(ifs >> m_section_size >> chunks_count >> entries_count) ||
+      chunks_count != (m_section_size + CHUNK_SIZE - 1U) / CHUNK_SIZE) {
+    return false;
+  }
+  m_chunk_digests.resize(chunks_count);
+  for (auto& d : m_chunk_digests) {
+    if (!(ifs >> d)) {
+      return false;
+    }
+  }
+  m_entries.resize(entries_count);
+  for (auto& e : m_entries) {
+    if (!(ifs >> e.offset >> e.size >> e.header_crc32 >> e.crc32 >>
+          e.compressed_size >> e.uncompressed_size >> e.digest) ||
+        ifs.get() != ' ' || !getline(ifs, e.name) || e.name.empty()) {
+      return false;
+    }
+  }
+  return is_sorted(m_entries.cbegin(), m_entries.cend(),
+      [] (const auto& a, const auto& b) { return a.offset < b.offset; });
+}
+
+auto ApkDigests::hash_entry(const LocalZip& t_apk,
+    const ZipDirectory::Entry& t_zip_entry, const Entry* const t_cached,
+    bool& t_is_hashed) -> Entry {
+  Entry entry{t_zip_entry.name, t_zip_entry.local_header_offset, {}, {},
+              t_zip_entry.crc32, t_zip_entry.compressed_size,
+              t_zip_entry.uncompressed_size, {}};
+
+  string header(ZipDirectory::LOCAL_HEADER_SIZE, '\0');
+  t_apk.read_range(entry.offset, header.data(), header.size());
+  header.resize(ZipDirectory::get_local_header_size(header));
+  t_apk.read_range(entry.offset, header.data(), header.size());
+  entry.size = header.size() + entry.compressed_size;
+  entry.header_crc32 = static_cast<uint32_t>(crc32(0U,
+      reinterpret_cast<const Bytef*>(header.data()),
+      static_cast<uInt>(header.size())));
+
+  // Data is assumed to be the same, if CRC-32 and sizes are.
+  if (t_cached != nullptr && t_cached->crc32 == entry.crc32 &&
+      t_cached->compressed_size == entry.compressed_size &&
+      t_cached->uncompressed_size == entry.uncompressed_size) {
+    entry.digest = t_cached->digest;
+    t_is_hashed = false;
+    return entry;
+  }
+
+  Sha256 sha256;
+  t_apk.read_entry(t_zip_entry, [&sha256] (const char* data, size_t size) {
+    if (!sha256.update(data, size)) {
+      throw runtime_error("failed to calculate a digest");
+    }
+  });
+  entry.digest = finish(sha256);
+  t_is_hashed = true;
+  return entry;
+}
+
+auto ApkDigests::find_unchanged_chunks(const vector<Entry>& t_entries,
+    const uint64_t t_section_size) const -> vector<bool> {
+  const auto chunks_count{(t_section_size + CHUNK_SIZE - 1U) / CHUNK_SIZE};
+  vector<bool> unchanged(chunks_count);
+
+  // Ranges of the section covered by entries, which stay at the same place
+  // with the same local header and data. Adjacent ranges are merged.
+  vector<pair<uint64_t, uint64_t>> ranges;
+  auto cached_iter{m_entries.cbegin()};
+  for (const auto& e : t_entries) {
+    // Both vectors are sorted by offset.
+    while (cached_iter != m_entries.cend() && cached_iter->offset < e.offset) {
+      ++cached_iter;
+    }
+    if (cached_iter == m_entries.cend() || cached_iter->offset != e.offset ||
+        cached_iter->name != e.name || cached_iter->size != e.size ||
+        cached_iter->header_crc32 != e.header_crc32 ||
+        cached_iter->crc32 != e.crc32 ||
+        cached_iter->compressed_size != e.compressed_size) {
+      continue;
+    }
+    if (!ranges.empty() && ranges.back().second == e.offset) {
+      ranges.back().second += e.size;
+    } else {
+      ranges.emplace_back(e.offset, e.offset + e.size);
+    }
+  }
+
+  auto range_iter{ranges.cbegin()};
+  for (size_t i{}; i != unchanged.size(); ++i) {
+    const auto begin{i * CHUNK_SIZE};
+    const auto end{min<uint64_t>(begin + CHUNK_SIZE, t_section_size)};
+    // The cached chunk must have the same bounds.
+    if (i >= m_chunk_digests.size() ||
+        end != min<uint64_t>(begin + CHUNK_SIZE, m_section_size)) {
+      continue;
+    }
+    while (range_iter != ranges.cend() && range_iter->second < end) {
+      ++range_iter;
+    }
+    unchanged[i] = range_iter != ranges.cend() && range_iter->first <= begin;
+  }
+  return unchanged;
+}
+
+void ApkDigests::hash_range(const LocalZip& t_apk, const uint64_t t_offset,
+    const uint64_t t_size, vector<string>& t_digests) {
+  string data;
+  for (uint64_t offset{}; offset < t_size; offset += CHUNK_SIZE) {
+    data.resize(static_cast<size_t>(
+        min<uint64_t>(CHUNK_SIZE, t_size - offset)));
+    t_apk.read_range(t_offset + offset, data.data(), data.size());
+    t_digests.push_back(hash_chunk(data.data(), data.size()));
+  }
+}
+
+auto ApkDigests::hash_chunk(const char* const t_data, const size_t t_size)
+    -> string {
+  Sha256 sha256;
+  const auto prefix{make_prefix('\xA5', t_size)};
+  if (!sha256.update(prefix.data(), prefix.size()) ||
+      !sha256.update(t_data, t_size)) {
+    throw runtime_error("failed to calculate a digest");
+  }
+  return finish(sha256);
+}
@@ -44,6 +44,13 @@ Apm::Apm(error_condition& t_err): m_opts("apm", "Android Project Manager") {
   // Options that don't require a project directory.
   m_opts.add_options("Other")
       ("s,set-up", "Download and install SDK")
+      ("from", "Install SDK from an exported bundle or a mirror directory",
+          value<path>(), "PATH")
+      ("segments", "Download large SDK files using NUM parallel connections",
+          value<unsigned short>(), "NUM")
+      ("verify-sdk", "Check integrity of the installed SDK files")
+      ("export-sdk", "Pack the installed SDK into a bundle for offline setup",
+          value<path>(), "FILE")
       ("j,set-jks", "Set a Java KeyStore for signing the release APK files",
           value<path>(), "FILE")
       ("colors", "Change number of colors in a palette (0, 8 or 256)",
@@ -72,6 +79,13 @@ Apm::Apm(error_condition& t_err): m_opts("apm", "Android Project Manager") {
 
   try {
     m_sdk = make_shared<Sdk>();
+    // API saved in the configuration is used for new projects.
+    if (const optional api{m_config->get<unsigned short>(Config::Key::SDK)}) {
+      m_sdk->adopt_legacy_files(*api);
+      if (m_sdk->get_installed_apis().count(*api) != 0U) {
+        m_sdk->set_api(*api);
+      }
+    }
   } catch (const exception& e) {
     cerr << Text::format_message(Message::ERROR,
             "Couldn't prepare SDK: "s + e.what()) << endl;
@@ -105,7 +119,17 @@ auto Apm::run(int& t_argc, char** t_argv) -> int {
     }
   }
 
-  const optional installed_sdk{m_config->get<unsigned short>(Config::Key::SDK)};
+  // Options, which only change how SDK is installed.
+  for (const auto& o : {"from", "segments"}) {
+    if (parse_result->count(o) != 0U && parse_result->count("set-up") == 0U) {
+      cerr << Text::format_message(Message::ERROR, "<b>--"s + o +
+              "<r> option requires <b>-s<r> (<b>--set-up<r>)") << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Zero if SDK isn't installed.
+  const auto sdk_api{m_sdk->get_api()};
 
   // --------------- +
   // Project related |
@@ -122,7 +146,7 @@ auto Apm::run(int& t_argc, char** t_argv) -> int {
       continue;
     }
 
-    if (!installed_sdk) {
+    if (sdk_api == 0U) {
       cerr << Text::format_message(Message::ERROR,
               SDK_NOT_INSTALLED_MSG) << endl;
       return EXIT_FAILURE;
@@ -153,7 +177,7 @@ auto Apm::run(int& t_argc, char** t_argv) -> int {
 
   if (parse_result->count("create") != 0U) {
     try {
-      return Project::create(project_dir, *installed_sdk,
+      return Project::create(project_dir, sdk_api,
              m_sdk->get_file_path(Sdk::File::PROJECT_TEMPLATE), m_term);
     } catch (const exception& e) {
       cerr << Text::format_message(Message::ERROR,
@@ -191,9 +215,16 @@ auto Apm::run(int& t_argc, char** t_argv) -> int {
   // ------------- +
 
   if (parse_result->count("set-up") != 0U) {
+    if (parse_result->count("segments") != 0U) {
+      m_sdk->set_download_segments(
+          (*parse_result)["segments"].as<unsigned short>());
+    }
     try {
-      return m_sdk->install(m_config, m_term,
-                            installed_sdk ? *installed_sdk : 0U);
+      if (parse_result->count("from") != 0U) {
+        return m_sdk->install_bundle(
+            (*parse_result)["from"].as<path>(), m_config, m_term);
+      }
+      return m_sdk->install(m_config, m_term);
     } catch (const exception& e) {
       cerr << Text::format_message(Message::ERROR,
               "Couldn't set up SDK: "s + e.what()) << endl;
@@ -201,6 +232,37 @@ auto Apm::run(int& t_argc, char** t_argv) -> int {
     }
   }
 
+  if (parse_result->count("verify-sdk") != 0U) {
+    if (sdk_api == 0U) {
+      cerr << Text::format_message(Message::ERROR,
+              SDK_NOT_INSTALLED_MSG) << endl;
+      return EXIT_FAILURE;
+    }
+    try {
+      return m_sdk->verify(m_term);
+    } catch (const exception& e) {
+      cerr << Text::format_message(Message::ERROR,
+              "Couldn't verify SDK: "s + e.what()) << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (parse_result->count("export-sdk") != 0U) {
+    if (sdk_api == 0U) {
+      cerr << Text::format_message(Message::ERROR,
+              SDK_NOT_INSTALLED_MSG) << endl;
+      return EXIT_FAILURE;
+    }
+    try {
+      return m_sdk->export_bundle(
+          (*parse_result)["export-sdk"].as<path>(), m_term);
+    } catch (const exception& e) {
+      cerr << Text::format_message(Message::ERROR,
+              "Couldn't export SDK: "s + e.what()) << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
   if (parse_result->count("set-jks") != 0U) {
     try {
       set_release_jks((*parse_result)["set-jks"].as<path>());
@@ -225,7 +287,7 @@ auto Apm::run(int& t_argc, char** t_argv) -> int {
   }
 
   cout << m_opts.help() << flush;
-  if (parse_result->count("help") == 0U && !installed_sdk) {
+  if (parse_result->count("help") == 0U && sdk_api == 0U) {
     cout << Text::format_message(Message::WARNING,
             SDK_NOT_INSTALLED_MSG) << endl;
   }
@@ -375,11 +437,16 @@ void Apm::request_theme() {
 void Apm::print_versions() const {
   cout << "APM version: <b>" APM_VERSION "<r>"_fmt << endl;
 
-  const optional sdk_api{m_config->get<unsigned short>(Config::Key::SDK)};
-  if (sdk_api) {
-    cout << Text::format_copy(
-            "API of SDK: <b>" + to_string(*sdk_api) + "<r>") << endl;
+  const auto apis{m_sdk->get_installed_apis()};
+  if (apis.empty()) {
+    return;
+  }
+  string apis_str;
+  for (const auto a : apis) {
+    apis_str += (apis_str.empty() ? "" : ", ") + to_string(a);
   }
+  cout << Text::format_copy("API of SDK: <b>" + to_string(m_sdk->get_api()) +
+          "<r> (installed: " + apis_str + ')') << endl;
 }
 
 auto Apm::instantiate_project(const path& t_root_dir) const -> Project {
@@ -0,0 +1,331 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "general/scope_guard.hpp"
+#include "dex_file.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+namespace {
+  constexpr string_view MAGIC_PREFIX{"dex\n"};
+  constexpr unsigned
+      MIN_VERSION{35U},
+      MAX_VERSION{39U};
+  // Sizes of identifier items indexed by pool.
+  constexpr EnumArray<DexFile::Pool, size_t> ID_ITEM_SIZES{4U, 4U, 12U, 8U, 8U};
+  constexpr size_t CLASS_DEF_ITEM_SIZE{32U};
+
+  [[noreturn]] void throw_malformed() {
+    throw runtime_error("malformed DEX file");
+  }
+}
+
+// ------ +
+// Reader |
+// ------ +
+
+DexFile::Reader::Reader(const string_view t_data, const size_t t_offset):
+    m_data(t_data), m_offset(t_offset) {
+  if (t_offset > t_data.size()) {
+    throw_malformed();
+  }
+}
+
+auto DexFile::Reader::read_u8() -> uint8_t {
+  return static_cast<uint8_t>(read(1U).front());
+}
+
+auto DexFile::Reader::read_u16() -> uint16_t {
+  const auto bytes{read(2U)};
+  return static_cast<uint16_t>(static_cast<uint8_t>(bytes[0]) |
+                               (static_cast<uint8_t>(bytes[1]) << 8U));
+}
+
+auto DexFile::Reader::read_u32() -> uint32_t {
+  const auto bytes{read(4U)};
+  uint32_t val{};
+  for (size_t i{}; i != bytes.size(); ++i) {
+    val |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[i])) << (i * 8U);
+  }
+  return val;
+}
+
+auto DexFile::Reader::read_uleb128() -> uint32_t {
+  // 32-bit value takes at most five bytes.
+  constexpr unsigned MAX_BYTES{5U};
+
+  uint32_t val{};
+  for (unsigned i{}; i != MAX_BYTES; ++i) {
+    const auto byte{read_u8()};
+    val |= static_cast<uint32_t>(byte & 0x7FU) << (i * 7U);
+    if ((byte & 0x80U) == 0U) {
+      return val;
+    }
+  }
+  throw_malformed();
+}
+
+auto DexFile::Reader::read_sleb128() -> int32_t {
+  constexpr unsigned MAX_BYTES{5U};
+
+  uint32_t val{};
+  for (unsigned i{}; i != MAX_BYTES; ++i) {
+    const auto byte{read_u8()};
+    val |= static_cast<uint32_t>(byte & 0x7FU) << (i * 7U);
+    if ((byte & 0x80U) == 0U) {
+      const auto bits_count{(i + 1U) * 7U};
+      // Extend the sign bit.
+      if (bits_count < 32U && (byte & 0x40U) != 0U) {
+        val |= ~uint32_t{} << bits_count;
+      }
+      return static_cast<int32_t>(val);
+    }
+  }
+  throw_malformed();
+}
+
+auto DexFile::Reader::read_uleb128p1() -> uint32_t {
+  return read_uleb128() - 1U;
+}
+
+auto DexFile::Reader::read(const size_t t_size) -> string_view {
+  if (t_size > m_data.size() - m_offset) {
+    throw_malformed();
+  }
+  const auto data{m_data.substr(m_offset, t_size)};
+  m_offset += t_size;
+  return data;
+}
+
+// ------- +
+// DexFile |
+// ------- +
+
+DexFile::DexFile(const path& t_path) {
+  const int fd{open(t_path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd == -1) {
+    throw runtime_error("failed to open \"" + t_path.string() + '"');
+  }
+  const ScopeGuard fd_guard([fd] { close(fd); });
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    throw runtime_error('"' + t_path.string() + "\" isn't a regular file");
+  }
+  if (static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+    throw_malformed();
+  }
+
+  m_mapping_size = static_cast<size_t>(st.st_size);
+  // Mapping avoids copying of data from the page cache.
+  void* const data{mmap(nullptr, m_mapping_size,
+                        PROT_READ, MAP_PRIVATE, fd, 0)};
+  if (data == MAP_FAILED) {
+    throw runtime_error("failed to map \"" + t_path.string() + '"');
+  }
+  m_data = {static_cast<const char*>(data), m_mapping_size};
+
+  // Destructor isn't called if the constructor throws an exception.
+  ScopeGuard map_guard([this] {
+    munmap(const_cast<char*>(m_data.data()), m_mapping_size);
+  });
+  parse_header();
+  map_guard = [] {};
+}
+
+DexFile::~DexFile() {
+  munmap(const_cast<char*>(m_data.data()), m_mapping_size);
+}
+
+auto DexFile::get_count(const Pool t_pool) const -> uint32_t {
+  return m_pools.at(static_cast<size_t>(t_pool)).size;
+}
+
+auto DexFile::get_string(const uint32_t t_idx) const -> string_view {
+  auto reader{get_reader(Reader(m_data, locate(
+      m_pools.at(static_cast<size_t>(Pool::STRING)), t_idx,
+      ID_ITEM_SIZES.get(Pool::STRING))).read_u32())};
+  // Skip length of the string in UTF-16 code units.
+  static_cast<void>(reader.read_uleb128());
+
+  const auto begin{reader.get_offset()};
+  const auto end{m_data.find('\0', begin)};
+  if (end == string_view::npos) {
+    throw_malformed();
+  }
+  return m_data.substr(begin, end - begin);
+}
+
+auto DexFile::get_type(const uint32_t t_idx) const -> uint32_t {
+  return Reader(m_data, locate(m_pools.at(static_cast<size_t>(Pool::TYPE)),
+                t_idx, ID_ITEM_SIZES.get(Pool::TYPE))).read_u32();
+}
+
+auto DexFile::get_proto(const uint32_t t_idx) const -> ProtoId {
+  Reader reader(m_data, locate(m_pools.at(static_cast<size_t>(Pool::PROTO)),
+                t_idx, ID_ITEM_SIZES.get(Pool::PROTO)));
+  ProtoId proto;
+  proto.shorty_idx = reader.read_u32();
+  proto.return_type_idx = reader.read_u32();
+  proto.params_off = reader.read_u32();
+  return proto;
+}
+
+auto DexFile::get_field(const uint32_t t_idx) const -> MemberId {
+  Reader reader(m_data, locate(m_pools.at(static_cast<size_t>(Pool::FIELD)),
+                t_idx, ID_ITEM_SIZES.get(Pool::FIELD)));
+  MemberId field;
+  field.class_idx = reader.read_u16();
+  field.type_idx = reader.read_u16();
+  field.name_idx = reader.read_u32();
+  return field;
+}
+
+auto DexFile::get_method(const uint32_t t_idx) const -> MemberId {
+  Reader reader(m_data, locate(m_pools.at(static_cast<size_t>(Pool::METHOD)),
+                t_idx, ID_ITEM_SIZES.get(Pool::METHOD)));
+  MemberId method;
+  method.class_idx = reader.read_u16();
+  method.type_idx = reader.read_u16();
+  method.name_idx = reader.read_u32();
+  return method;
+}
+
+auto DexFile::get_class_def(const uint32_t t_idx) const -> ClassDef {
+  Reader reader(m_data, locate(m_class_defs, t_idx, CLASS_DEF_ITEM_SIZE));
+  ClassDef def;
+  def.class_idx = reader.read_u32();
+  def.access_flags = reader.read_u32();
+  def.superclass_idx = reader.read_u32();
+  def.interfaces_off = reader.read_u32();
+  def.source_file_idx = reader.read_u32();
+  def.annotations_off = reader.read_u32();
+  def.class_data_off = reader.read_u32();
+  def.static_values_off = reader.read_u32();
+  return def;
+}
+
+auto DexFile::get_type_list(const uint32_t t_offset) const ->
+    vector<uint32_t> {
+  if (t_offset == 0U) {
+    return {};
+  }
+
+  auto reader{get_reader(t_offset)};
+  const auto size{reader.read_u32()};
+  // Each element takes two bytes.
+  if (size > (m_data.size() - reader.get_offset()) / 2U) {
+    throw_malformed();
+  }
+  vector<uint32_t> types(size);
+  for (auto& t : types) {
+    t = reader.read_u16();
+  }
+  return types;
+}
+
+auto DexFile::get_reader(const uint32_t t_offset) const -> Reader {
+  return {m_data, t_offset};
+}
+
+void DexFile::parse_header() {
+  auto reader{get_reader(0U)};
+  const auto magic{reader.read(8U)};
+  if (magic.substr(0U, MAGIC_PREFIX.size()) != MAGIC_PREFIX ||
+      magic.back() != '\0') {
+    throw runtime_error("not a DEX file");
+  }
+  const auto version_str{magic.substr(MAGIC_PREFIX.size(), 3U)};
+  for (const auto c : version_str) {
+    if (c < '0' || c > '9') {
+      throw runtime_error("not a DEX file");
+    }
+    m_version = m_version * 10U + static_cast<unsigned>(c - '0');
+  }
+  if (m_version < MIN_VERSION || m_version > MAX_VERSION) {
+    throw runtime_error("unsupported version of DEX file");
+  }
+
+  // Skip checksum and signature.
+  static_cast<void>(reader.read(24U));
+  const auto file_size{reader.read_u32()};
+  const auto header_size{reader.read_u32()};
+  if (reader.read_u32() != ENDIAN_CONSTANT) {
+    throw runtime_error("unsupported byte order of DEX file");
+  }
+  if (file_size > m_data.size() || header_size != HEADER_SIZE) {
+    throw_malformed();
+  }
+  m_data = m_data.substr(0U, file_size);
+
+  // Skip link section.
+  static_cast<void>(reader.read(8U));
+  const auto map_off{reader.read_u32()};
+  for (auto& p : m_pools) {
+    p.size = reader.read_u32();
+    p.offset = reader.read_u32();
+  }
+  m_class_defs.size = reader.read_u32();
+  m_class_defs.offset = reader.read_u32();
+
+  for (size_t p{}; p != m_pools.size(); ++p) {
+    const auto& pool{m_pools.at(p)};
+    if (pool.size != 0U) {
+      static_cast<void>(locate(pool, pool.size - 1U,
+                               ID_ITEM_SIZES.get(static_cast<Pool>(p))));
+    }
+  }
+  if (m_class_defs.size != 0U) {
+    static_cast<void>(locate(m_class_defs, m_class_defs.size - 1U,
+                             CLASS_DEF_ITEM_SIZE));
+  }
+  parse_map(map_off);
+}
+
+void DexFile::parse_map(const uint32_t t_offset) {
+  // Type (two bytes), unused (two bytes), size and offset.
+  constexpr size_t ITEM_SIZE{12U};
+
+  auto reader{get_reader(t_offset)};
+  const auto size{reader.read_u32()};
+  if (size > (m_data.size() - reader.get_offset()) / ITEM_SIZE) {
+    throw_malformed();
+  }
+
+  for (uint32_t i{}; i != size; ++i) {
+    const auto type{reader.read_u16()};
+    static_cast<void>(reader.read_u16());
+    const auto items_count{reader.read_u32()};
+    static_cast<void>(reader.read_u32());
+
+    if ((type == CALL_SITE_ID_ITEM || type == METHOD_HANDLE_ITEM) &&
+        items_count != 0U) {
+      m_has_method_handles = true;
+    }
+  }
+}
+
+auto DexFile::locate(const Section& t_section, const uint32_t t_idx,
+                     const size_t t_item_size) const -> size_t {
+  if (t_idx >= t_section.size) {
+    throw runtime_error("index is out of range");
+  }
+  const auto offset{static_cast<uint64_t>(t_section.offset) +
+                    static_cast<uint64_t>(t_idx) * t_item_size};
+  if (offset + t_item_size > m_data.size()) {
+    throw_malformed();
+  }
+  return static_cast<size_t>(offset);
+}
@@ -0,0 +1,1517 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#include <openssl/evp.h>
+#include <zlib.h>
+
+#include "dex_merger.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+using Pool = DexFile::Pool;
+using Reader = DexFile::Reader;
+
+namespace {
+  // Types of items in the map list.
+  enum class ItemType : uint16_t {
+    HEADER = 0x0000U,
+    // Identifiers follow in order of pools.
+    STRING_ID = 0x0001U,
+    CLASS_DEF = 0x0006U,
+    MAP_LIST = 0x1000U,
+    TYPE_LIST = 0x1001U,
+    ANNOTATION_SET_REF_LIST = 0x1002U,
+    ANNOTATION_SET = 0x1003U,
+    CLASS_DATA = 0x2000U,
+    CODE = 0x2001U,
+    STRING_DATA = 0x2002U,
+    DEBUG_INFO = 0x2003U,
+    ANNOTATION = 0x2004U,
+    ENCODED_ARRAY = 0x2005U,
+    ANNOTATIONS_DIRECTORY = 0x2006U
+  };
+
+  // Sizes of identifier items indexed by pool.
+  constexpr EnumArray<Pool, size_t> ID_ITEM_SIZES{4U, 4U, 12U, 8U, 8U};
+  constexpr size_t CLASS_DEF_ITEM_SIZE{32U};
+  constexpr uint32_t ENDIAN_CONSTANT{0x12345678U};
+  constexpr size_t
+      CHECKSUM_OFFSET{8U},
+      SIGNATURE_OFFSET{12U},
+      SIGNATURE_SIZE{20U},
+      // Offset of debug_info_off within a code item.
+      DEBUG_INFO_OFF_OFFSET{8U};
+
+  // Value types of encoded_value.
+  enum ValueType : uint8_t {
+    VALUE_METHOD_TYPE = 0x15U,
+    VALUE_METHOD_HANDLE = 0x16U,
+    VALUE_STRING = 0x17U,
+    VALUE_TYPE = 0x18U,
+    VALUE_FIELD = 0x19U,
+    VALUE_METHOD = 0x1AU,
+    VALUE_ENUM = 0x1BU,
+    VALUE_ARRAY = 0x1CU,
+    VALUE_ANNOTATION = 0x1DU,
+    VALUE_NULL = 0x1EU,
+    VALUE_BOOLEAN = 0x1FU
+  };
+
+  // Opcodes of the debug information state machine, which have arguments.
+  enum DebugOpcode : uint8_t {
+    DBG_END_SEQUENCE = 0x00U,
+    DBG_ADVANCE_PC = 0x01U,
+    DBG_ADVANCE_LINE = 0x02U,
+    DBG_START_LOCAL = 0x03U,
+    DBG_START_LOCAL_EXTENDED = 0x04U,
+    DBG_END_LOCAL = 0x05U,
+    DBG_RESTART_LOCAL = 0x06U,
+    DBG_SET_FILE = 0x09U
+  };
+
+  // Identifiers of pseudo-instructions (their opcode is nop).
+  enum PayloadIdent : uint16_t {
+    PACKED_SWITCH_PAYLOAD = 0x0100U,
+    SPARSE_SWITCH_PAYLOAD = 0x0200U,
+    FILL_ARRAY_DATA_PAYLOAD = 0x0300U
+  };
+
+  // Returns sizes of instructions in 16-bit code units indexed by opcode.
+  constexpr auto make_insn_sizes() {
+    struct Range {
+      uint8_t first;
+      uint8_t last;
+      uint8_t size;
+    };
+    constexpr array<Range, 28U> ranges{{
+      {0x02U, 0x02U, 2U}, {0x03U, 0x03U, 3U}, {0x05U, 0x05U, 2U},
+      {0x06U, 0x06U, 3U}, {0x08U, 0x08U, 2U}, {0x09U, 0x09U, 3U},
+      {0x13U, 0x13U, 2U}, {0x14U, 0x14U, 3U}, {0x15U, 0x16U, 2U},
+      {0x17U, 0x17U, 3U}, {0x18U, 0x18U, 5U}, {0x19U, 0x1AU, 2U},
+      {0x1BU, 0x1BU, 3U}, {0x1CU, 0x1CU, 2U}, {0x1FU, 0x20U, 2U},
+      {0x22U, 0x23U, 2U}, {0x24U, 0x26U, 3U}, {0x29U, 0x29U, 2U},
+      {0x2AU, 0x2CU, 3U}, {0x2DU, 0x3DU, 2U}, {0x44U, 0x6DU, 2U},
+      {0x6EU, 0x72U, 3U}, {0x74U, 0x78U, 3U}, {0x90U, 0xAFU, 2U},
+      {0xD0U, 0xE2U, 2U}, {0xFAU, 0xFBU, 4U}, {0xFCU, 0xFDU, 3U},
+      {0xFEU, 0xFFU, 2U}
+    }};
+
+    array<uint8_t, 0x100U> sizes{};
+    for (auto& s : sizes) {
+      s = 1U;
+    }
+    for (const auto& r : ranges) {
+      for (unsigned op{r.first}; op <= r.last; ++op) {
+        sizes.at(op) = r.size;
+      }
+    }
+    return sizes;
+  }
+  constexpr auto INSN_SIZES{make_insn_sizes()};
+
+  template<typename T> void append_le(string& t_data, const T t_val) {
+    static_assert(is_unsigned_v<T>, "T must be unsigned integer");
+    for (size_t i{}; i != sizeof(T); ++i) {
+      t_data += static_cast<char>((t_val >> (i * 8U)) & 0xFFU);
+    }
+  }
+
+  // Overwrites bytes starting from the position.
+  template<typename T>
+  void put_le(string& t_data, const size_t t_pos, const T t_val) {
+    static_assert(is_unsigned_v<T>, "T must be unsigned integer");
+    for (size_t i{}; i != sizeof(T); ++i) {
+      t_data.at(t_pos + i) = static_cast<char>((t_val >> (i * 8U)) & 0xFFU);
+    }
+  }
+
+  void append_uleb128(string& t_data, uint32_t t_val) {
+    do {
+      auto byte{static_cast<uint8_t>(t_val & 0x7FU)};
+      t_val >>= 7U;
+      if (t_val != 0U) {
+        byte |= 0x80U;
+      }
+      t_data += static_cast<char>(byte);
+    } while (t_val != 0U);
+  }
+
+  void append_sleb128(string& t_data, const int32_t t_val) {
+    auto val{static_cast<uint32_t>(t_val)};
+    const bool negative{t_val < 0};
+    for (;;) {
+      const auto byte{static_cast<uint8_t>(val & 0x7FU)};
+      // Arithmetic shift.
+      val = (val >> 7U) | (negative ? ~(~uint32_t{} >> 7U) : 0U);
+      // Stop when the rest bits are copies of the sign bit.
+      if ((val == 0U && (byte & 0x40U) == 0U) ||
+          (val == ~uint32_t{} && (byte & 0x40U) != 0U)) {
+        t_data += static_cast<char>(byte);
+        return;
+      }
+      t_data += static_cast<char>(byte | 0x80U);
+    }
+  }
+
+  void append_uleb128p1(string& t_data, const uint32_t t_val) {
+    append_uleb128(t_data, t_val + 1U);
+  }
+
+  // Writes little-endian unsigned integer using minimum number of bytes and
+  // returns the number.
+  auto append_min_le(string& t_data, uint64_t t_val) -> unsigned {
+    unsigned size{};
+    do {
+      t_data += static_cast<char>(t_val & 0xFFU);
+      t_val >>= 8U;
+      ++size;
+    } while (t_val != 0U);
+    return size;
+  }
+
+  // Decodes UTF-16 code unit of a MUTF-8 string and moves the position.
+  auto read_utf16_unit(const string_view t_str, size_t& t_pos) -> uint16_t {
+    const auto next_byte{[&] () -> uint8_t {
+      return t_pos == t_str.size() ?
+             0U : static_cast<uint8_t>(t_str[t_pos++]) & 0x3FU;
+    }};
+
+    const auto byte{static_cast<uint8_t>(t_str[t_pos++])};
+    if (byte < 0x80U) {
+      return byte;
+    }
+    if ((byte & 0xE0U) == 0xC0U) {
+      return static_cast<uint16_t>(((byte & 0x1FU) << 6U) | next_byte());
+    }
+    const auto high{static_cast<unsigned>(((byte & 0x0FU) << 6U) |
+                                          next_byte())};
+    return static_cast<uint16_t>((high << 6U) | next_byte());
+  }
+
+  /*
+   * Strings of a DEX file are sorted by UTF-16 code units, that differs
+   * from ordering of MUTF-8 bytes, since null character is encoded using
+   * two bytes.
+   */
+  auto is_mutf8_less(const string_view t_lhs, const string_view t_rhs) -> bool {
+    size_t lhs_pos{}, rhs_pos{};
+    while (lhs_pos != t_lhs.size() && rhs_pos != t_rhs.size()) {
+      const auto
+          lhs_unit{read_utf16_unit(t_lhs, lhs_pos)},
+          rhs_unit{read_utf16_unit(t_rhs, rhs_pos)};
+      if (lhs_unit != rhs_unit) {
+        return lhs_unit < rhs_unit;
+      }
+    }
+    return lhs_pos == t_lhs.size() && rhs_pos != t_rhs.size();
+  }
+
+  auto get_utf16_size(const string_view t_str) -> uint32_t {
+    // Each code unit is encoded by a leading byte and continuation bytes.
+    return static_cast<uint32_t>(count_if(t_str.cbegin(), t_str.cend(),
+        [] (const char c) {
+      return (static_cast<uint8_t>(c) & 0xC0U) != 0x80U;
+    }));
+  }
+
+  auto get_alignment(const ItemType t_type) -> size_t {
+    switch (t_type) {
+      case ItemType::TYPE_LIST:
+      case ItemType::ANNOTATION_SET_REF_LIST:
+      case ItemType::ANNOTATION_SET:
+      case ItemType::CODE:
+      case ItemType::ANNOTATIONS_DIRECTORY:
+      case ItemType::MAP_LIST:
+        return 4U;
+      default:
+        return 1U;
+    }
+  }
+
+  auto get_dex_name(const size_t t_idx) -> string {
+    return "classes" + (t_idx == 0U ? "" : to_string(t_idx + 1U)) + ".dex";
+  }
+
+  // Returns global index of a key adding it if it's missing.
+  template<typename K> auto add_unique(map<K, uint32_t>& t_indexes,
+      vector<const K*>& t_values, K t_key) -> uint32_t {
+    const auto [iter, inserted]{t_indexes.emplace(
+        move(t_key), static_cast<uint32_t>(t_values.size()))};
+    if (inserted) {
+      t_values.push_back(&iter->first);
+    }
+    return iter->second;
+  }
+
+  template<typename L> auto calc_ranks(const size_t t_count, const L& t_less) {
+    vector<uint32_t> order(t_count);
+    iota(order.begin(), order.end(), 0U);
+    sort(order.begin(), order.end(), t_less);
+
+    vector<uint32_t> ranks(t_count);
+    for (size_t i{}; i != t_count; ++i) {
+      ranks.at(order.at(i)) = static_cast<uint32_t>(i);
+    }
+    return ranks;
+  }
+}
+
+// State of a DEX file being written.
+struct DexMerger::Output {
+  struct MapItem {
+    ItemType type{};
+    uint32_t offset{};
+    uint32_t count{};
+  };
+
+  // Adds a data item to the end and returns its offset. Items of the same
+  // type must be added successively.
+  auto add_item(const ItemType t_type, const string_view t_bytes,
+                const bool t_deduplicate = false) -> uint32_t {
+    if (t_deduplicate) {
+      if (const auto iter{contents.find({t_type, string(t_bytes)})};
+          iter != contents.cend()) {
+        return iter->second;
+      }
+    }
+
+    const auto alignment{get_alignment(t_type)};
+    data.resize((data.size() + alignment - 1U) / alignment * alignment);
+    if (data.size() + t_bytes.size() > numeric_limits<uint32_t>::max()) {
+      throw runtime_error("DEX file is too large");
+    }
+    const auto offset{static_cast<uint32_t>(data.size())};
+    if (map.empty() || map.back().type != t_type) {
+      map.push_back({t_type, offset, 0U});
+    }
+    ++map.back().count;
+    data += t_bytes;
+
+    if (t_deduplicate) {
+      contents.emplace(make_pair(t_type, string(t_bytes)), offset);
+    }
+    return offset;
+  }
+
+  [[nodiscard]] auto get_local(const Pool t_pool,
+                               const uint32_t t_global_idx) const {
+    const auto idx{locals.at(static_cast<size_t>(t_pool)).at(t_global_idx)};
+    if (idx == DexFile::NO_INDEX) {
+      throw runtime_error("identifier isn't collected");
+    }
+    return idx;
+  }
+
+  // Offset of a copied item by index of an input file and the old offset.
+  [[nodiscard]] auto get_offset(const size_t t_input,
+                                const uint32_t t_offset) const {
+    return t_offset == 0U ? 0U : offsets.at({t_input, t_offset});
+  }
+
+  vector<const Class*> classes;
+  // Class definitions in order of classes.
+  vector<DexFile::ClassDef> class_defs;
+
+  // Global indexes of identifiers in order of the file.
+  pools_t<vector<uint32_t>> globals;
+  // Indexes of identifiers in the file by global indexes.
+  pools_t<vector<uint32_t>> locals;
+  pools_t<uint32_t> ids_offsets{};
+  uint32_t class_defs_offset{};
+  uint32_t map_offset{};
+
+  unsigned version{};
+  string data;
+  vector<MapItem> map;
+  // Offsets of copied items by index of an input file and the old offset.
+  std::map<pair<size_t, uint32_t>, uint32_t> offsets;
+  // Offsets of deduplicated items by their type and content.
+  std::map<pair<ItemType, string>, uint32_t> contents;
+};
+
+DexMerger::DexMerger(const uint32_t t_max_ids_count):
+    m_max_ids_count(t_max_ids_count) {}
+
+void DexMerger::add(const path& t_dex_path) {
+  try {
+    Input input;
+    input.dex = make_unique<const DexFile>(t_dex_path);
+    if (input.dex->has_method_handles()) {
+      throw runtime_error("call sites and method handles aren't supported");
+    }
+    intern(input);
+
+    const auto input_idx{m_inputs.size()};
+    vector<Class> classes;
+    set<uint32_t> types;
+    for (uint32_t c{}; c != input.dex->get_class_defs_count(); ++c) {
+      auto cls{read_class(input_idx, input, c)};
+      if (m_class_indexes.count(cls.type) != 0U ||
+          !types.insert(cls.type).second) {
+        throw runtime_error("class " + *m_strings.at(m_types.at(cls.type)) +
+                            " is already defined");
+      }
+      classes.push_back(move(cls));
+    }
+
+    m_version = max(m_version, input.dex->get_version());
+    m_inputs.push_back(move(input));
+    for (auto& c : classes) {
+      m_class_indexes.emplace(c.type, m_classes.size());
+      m_classes.push_back(move(c));
+    }
+  } catch (const runtime_error& e) {
+    throw runtime_error("failed to add \"" + t_dex_path.string() +
+                        "\" (" + e.what() + ')');
+  }
+}
+
+auto DexMerger::write(const path& t_output_dir) const -> vector<path> {
+  const auto ranks{make_ranks()};
+  const auto dexes{split(ranks)};
+
+  vector<path> paths;
+  for (size_t i{}; i != dexes.size(); ++i) {
+    paths.push_back(t_output_dir / get_dex_name(i));
+    write_dex(dexes.at(i), ranks, paths.back());
+  }
+
+  // Remove stale files starting from the next one.
+  error_code ec;
+  auto next_idx{dexes.size()};
+  while (remove(t_output_dir / get_dex_name(next_idx), ec)) {
+    ++next_idx;
+  }
+  return paths;
+}
+
+// ------------------ +
+// Global identifiers |
+// ------------------ +
+
+auto DexMerger::get_global(const Input& t_input,
+    const Pool t_pool, const uint32_t t_idx) -> uint32_t {
+  const auto& globals{t_input.globals.at(static_cast<size_t>(t_pool))};
+  if (t_idx >= globals.size()) {
+    throw runtime_error("index is out of range");
+  }
+  return globals.at(t_idx);
+}
+
+void DexMerger::collect(pools_t<vector<uint32_t>>& t_refs,
+    const Pool t_pool, const uint32_t t_global_idx) const {
+  const auto add{[&t_refs] (const Pool pool, const uint32_t idx) {
+    t_refs.at(static_cast<size_t>(pool)).push_back(idx);
+  }};
+
+  add(t_pool, t_global_idx);
+  switch (t_pool) {
+    case Pool::STRING:
+      break;
+    case Pool::TYPE:
+      add(Pool::STRING, m_types.at(t_global_idx));
+      break;
+    case Pool::PROTO: {
+      const auto& proto{*m_protos.at(t_global_idx)};
+      add(Pool::STRING, proto.shorty);
+      collect(t_refs, Pool::TYPE, proto.return_type);
+      for (const auto p : proto.params) {
+        collect(t_refs, Pool::TYPE, p);
+      }
+      break;
+    }
+    case Pool::FIELD:
+    case Pool::METHOD: {
+      const auto& [class_type, type, name]{*(t_pool == Pool::FIELD ?
+          m_fields : m_methods).at(t_global_idx)};
+      collect(t_refs, Pool::TYPE, class_type);
+      collect(t_refs, t_pool == Pool::FIELD ? Pool::TYPE : Pool::PROTO, type);
+      add(Pool::STRING, name);
+      break;
+    }
+    case Pool::_COUNT:
+      break;
+  }
+}
+
+void DexMerger::intern(Input& t_input) {
+  const auto& dex{*t_input.dex};
+  const auto get_globals{[&t_input] (const Pool pool) -> auto& {
+    return t_input.globals.at(static_cast<size_t>(pool));
+  }};
+  const auto global{[&t_input] (const Pool pool, const uint32_t idx) {
+    return get_global(t_input, pool, idx);
+  }};
+
+  for (uint32_t i{}; i != dex.get_count(Pool::STRING); ++i) {
+    const auto str{dex.get_string(i)};
+    auto iter{m_string_indexes.find(str)};
+    if (iter == m_string_indexes.cend()) {
+      iter = m_string_indexes.emplace(
+             str, static_cast<uint32_t>(m_strings.size())).first;
+      m_strings.push_back(&iter->first);
+    }
+    get_globals(Pool::STRING).push_back(iter->second);
+  }
+
+  for (uint32_t i{}; i != dex.get_count(Pool::TYPE); ++i) {
+    const auto [iter, inserted]{m_type_indexes.emplace(
+        global(Pool::STRING, dex.get_type(i)),
+        static_cast<uint32_t>(m_types.size()))};
+    if (inserted) {
+      m_types.push_back(iter->first);
+    }
+    get_globals(Pool::TYPE).push_back(iter->second);
+  }
+
+  for (uint32_t i{}; i != dex.get_count(Pool::PROTO); ++i) {
+    const auto proto_id{dex.get_proto(i)};
+    Proto proto;
+    proto.shorty = global(Pool::STRING, proto_id.shorty_idx);
+    proto.return_type = global(Pool::TYPE, proto_id.return_type_idx);
+    for (const auto t : dex.get_type_list(proto_id.params_off)) {
+      proto.params.push_back(global(Pool::TYPE, t));
+    }
+    get_globals(Pool::PROTO).push_back(
+        add_unique(m_proto_indexes, m_protos, move(proto)));
+  }
+
+  for (uint32_t i{}; i != dex.get_count(Pool::FIELD); ++i) {
+    const auto field{dex.get_field(i)};
+    get_globals(Pool::FIELD).push_back(add_unique(m_field_indexes, m_fields,
+        Member{global(Pool::TYPE, field.class_idx),
+               global(Pool::TYPE, field.type_idx),
+               global(Pool::STRING, field.name_idx)}));
+  }
+
+  for (uint32_t i{}; i != dex.get_count(Pool::METHOD); ++i) {
+    const auto method{dex.get_method(i)};
+    get_globals(Pool::METHOD).push_back(add_unique(m_method_indexes, m_methods,
+        Member{global(Pool::TYPE, method.class_idx),
+               global(Pool::PROTO, method.type_idx),
+               global(Pool::STRING, method.name_idx)}));
+  }
+}
+
+auto DexMerger::read_class(const size_t t_input_idx, const Input& t_input,
+                           const uint32_t t_class_def_idx) const -> Class {
+  const auto& dex{*t_input.dex};
+  Class cls;
+  cls.input = t_input_idx;
+  cls.def = dex.get_class_def(t_class_def_idx);
+
+  // Items are copied to find out referenced identifiers.
+  const function<remap_t> remap{[&] (const Pool pool, const uint32_t idx) {
+    collect(cls.refs, pool, get_global(t_input, pool, idx));
+    return idx;
+  }};
+  string scratch;
+
+  cls.type = get_global(t_input, Pool::TYPE, cls.def.class_idx);
+  remap(Pool::TYPE, cls.def.class_idx);
+  if (cls.def.superclass_idx != DexFile::NO_INDEX) {
+    cls.superclass = get_global(t_input, Pool::TYPE, cls.def.superclass_idx);
+    remap(Pool::TYPE, cls.def.superclass_idx);
+  }
+  for (const auto t : dex.get_type_list(cls.def.interfaces_off)) {
+    cls.interfaces.push_back(get_global(t_input, Pool::TYPE, t));
+    remap(Pool::TYPE, t);
+  }
+  if (cls.def.source_file_idx != DexFile::NO_INDEX) {
+    remap(Pool::STRING, cls.def.source_file_idx);
+  }
+
+  if (cls.def.class_data_off != 0U) {
+    cls.data = read_class_data(dex, cls.def.class_data_off);
+    for (size_t l{}; l != cls.data.size(); ++l) {
+      for (const auto& m : cls.data.at(l)) {
+        if (l < FIELD_LISTS_COUNT) {
+          remap(Pool::FIELD, m.idx);
+          continue;
+        }
+        remap(Pool::METHOD, m.idx);
+        if (m.code_off == 0U) {
+          continue;
+        }
+
+        auto reader{dex.get_reader(m.code_off)};
+        if (const auto debug_info_off{copy_code(reader, remap, scratch)};
+            debug_info_off != 0U) {
+          reader = dex.get_reader(debug_info_off);
+          copy_debug_info(reader, remap, scratch);
+        }
+        scratch.clear();
+      }
+    }
+  }
+
+  if (cls.def.annotations_off != 0U) {
+    cls.annotations = read_annotations(dex, cls.def.annotations_off);
+    for (const auto& [idx, offset] : cls.annotations.fields) {
+      remap(Pool::FIELD, idx);
+    }
+    for (const auto* const list :
+         {&cls.annotations.methods, &cls.annotations.params}) {
+      for (const auto& [idx, offset] : *list) {
+        remap(Pool::METHOD, idx);
+      }
+    }
+
+    for (const auto s : get_annotation_sets(dex, cls.annotations)) {
+      for (const auto a : read_offsets(dex, s)) {
+        auto reader{dex.get_reader(a)};
+        // Skip visibility.
+        static_cast<void>(reader.read_u8());
+        copy_encoded_annotation(reader, remap, scratch);
+        scratch.clear();
+      }
+    }
+  }
+
+  if (cls.def.static_values_off != 0U) {
+    auto reader{dex.get_reader(cls.def.static_values_off)};
+    copy_encoded_array(reader, remap, scratch);
+  }
+
+  for (auto& r : cls.refs) {
+    sort(r.begin(), r.end());
+    r.erase(unique(r.begin(), r.end()), r.end());
+  }
+  return cls;
+}
+
+// ------------------ +
+// Write output files |
+// ------------------ +
+
+auto DexMerger::make_ranks() const -> ranks_t {
+  ranks_t ranks;
+  const auto get_ranks{[&ranks] (const Pool pool) -> auto& {
+    return ranks.at(static_cast<size_t>(pool));
+  }};
+
+  const auto& strings{get_ranks(Pool::STRING) = ::calc_ranks(
+      m_strings.size(), [this] (const uint32_t lhs, const uint32_t rhs) {
+    return is_mutf8_less(*m_strings.at(lhs), *m_strings.at(rhs));
+  })};
+  const auto& types{get_ranks(Pool::TYPE) = ::calc_ranks(m_types.size(),
+      [&] (const uint32_t lhs, const uint32_t rhs) {
+    return strings.at(m_types.at(lhs)) < strings.at(m_types.at(rhs));
+  })};
+
+  const auto& protos{get_ranks(Pool::PROTO) = ::calc_ranks(m_protos.size(),
+      [&] (const uint32_t lhs, const uint32_t rhs) {
+    const auto &lhs_proto{*m_protos.at(lhs)}, &rhs_proto{*m_protos.at(rhs)};
+    if (lhs_proto.return_type != rhs_proto.return_type) {
+      return types.at(lhs_proto.return_type) < types.at(rhs_proto.return_type);
+    }
+    return lexicographical_compare(
+        lhs_proto.params.cbegin(), lhs_proto.params.cend(),
+        rhs_proto.params.cbegin(), rhs_proto.params.cend(),
+        [&types] (const uint32_t lhs_type, const uint32_t rhs_type) {
+      return types.at(lhs_type) < types.at(rhs_type);
+    });
+  })};
+
+  // Members are sorted by class, name and type (or prototype).
+  const auto make_member_ranks{[&] (const vector<const Member*>& members,
+                                    const vector<uint32_t>& type_ranks) {
+    return ::calc_ranks(members.size(),
+        [&] (const uint32_t lhs, const uint32_t rhs) {
+      const auto& [lhs_class, lhs_type, lhs_name]{*members.at(lhs)};
+      const auto& [rhs_class, rhs_type, rhs_name]{*members.at(rhs)};
+      return make_tuple(types.at(lhs_class), strings.at(lhs_name),
+                        type_ranks.at(lhs_type)) <
+             make_tuple(types.at(rhs_class), strings.at(rhs_name),
+                        type_ranks.at(rhs_type));
+    });
+  }};
+  get_ranks(Pool::FIELD) = make_member_ranks(m_fields, types);
+  get_ranks(Pool::METHOD) = make_member_ranks(m_methods, protos);
+  return ranks;
+}
+
+auto DexMerger::split(const ranks_t& t_ranks) const ->
+    vector<vector<const Class*>> {
+  const pools_t<size_t> globals_counts{m_strings.size(), m_types.size(),
+      m_protos.size(), m_fields.size(), m_methods.size()};
+
+  vector<const Class*> classes;
+  for (const auto& c : m_classes) {
+    classes.push_back(&c);
+  }
+  // Make output independent of order of inputs.
+  const auto& type_ranks{t_ranks.at(static_cast<size_t>(Pool::TYPE))};
+  sort(classes.begin(), classes.end(),
+       [&type_ranks] (const Class* const lhs, const Class* const rhs) {
+    return type_ranks.at(lhs->type) < type_ranks.at(rhs->type);
+  });
+
+  vector<vector<const Class*>> dexes;
+  // Identifiers of the last output file.
+  pools_t<vector<bool>> used;
+  pools_t<size_t> counts{};
+
+  for (const auto* const c : classes) {
+    pools_t<size_t> new_counts{};
+    bool fits{!dexes.empty()};
+    for (size_t p{}; p != used.size() && fits; ++p) {
+      for (const auto r : c->refs.at(p)) {
+        new_counts.at(p) += used.at(p).at(r) ? 0U : 1U;
+      }
+      fits = counts.at(p) + new_counts.at(p) <= m_max_ids_count;
+    }
+
+    if (!fits) {
+      dexes.emplace_back();
+      for (size_t p{}; p != used.size(); ++p) {
+        used.at(p).assign(globals_counts.at(p), false);
+        counts.at(p) = 0U;
+        new_counts.at(p) = c->refs.at(p).size();
+        if (new_counts.at(p) > m_max_ids_count) {
+          throw runtime_error("class " + *m_strings.at(m_types.at(c->type)) +
+                              " references too many identifiers");
+        }
+      }
+    }
+
+    for (size_t p{}; p != used.size(); ++p) {
+      for (const auto r : c->refs.at(p)) {
+        used.at(p).at(r) = true;
+      }
+      counts.at(p) += new_counts.at(p);
+    }
+    dexes.back().push_back(c);
+  }
+  return dexes;
+}
+
+auto DexMerger::sort_classes(const vector<const Class*>& t_classes) const ->
+    vector<const Class*> {
+  map<uint32_t, const Class*> classes_by_types;
+  for (const auto* const c : t_classes) {
+    classes_by_types.emplace(c->type, c);
+  }
+
+  vector<const Class*> sorted;
+  set<const Class*> visited;
+  const function<void(const Class*)> visit{[&] (const Class* const cls) {
+    if (!visited.insert(cls).second) {
+      return;
+    }
+    const auto visit_type{[&] (const uint32_t type) {
+      if (const auto iter{classes_by_types.find(type)};
+          iter != classes_by_types.cend()) {
+        visit(iter->second);
+      }
+    }};
+
+    visit_type(cls->superclass);
+    for (const auto i : cls->interfaces) {
+      visit_type(i);
+    }
+    sorted.push_back(cls);
+  }};
+
+  for (const auto* const c : t_classes) {
+    visit(c);
+  }
+  return sorted;
+}
+
+void DexMerger::write_dex(const vector<const Class*>& t_classes,
+    const ranks_t& t_ranks, const path& t_path) const {
+  Output output;
+  output.version = m_version;
+  output.classes = sort_classes(t_classes);
+
+  write_ids(output, t_ranks);
+  write_code(output);
+  write_class_data(output);
+  write_annotations(output);
+  write_static_values(output);
+  write_class_defs(output);
+  write_map(output);
+  write_header(output);
+
+  ofstream ofs(t_path, ios::binary | ios::trunc);
+  ofs.write(output.data.data(), static_cast<streamsize>(output.data.size()));
+  ofs.close();
+  if (!ofs) {
+    throw runtime_error("failed to write \"" + t_path.string() + '"');
+  }
+}
+
+void DexMerger::write_ids(Output& t_output, const ranks_t& t_ranks) const {
+  const pools_t<size_t> globals_counts{m_strings.size(), m_types.size(),
+      m_protos.size(), m_fields.size(), m_methods.size()};
+
+  // Assign indexes to referenced identifiers in sorted order.
+  for (size_t p{}; p != size<Pool>(); ++p) {
+    auto& globals{t_output.globals.at(p)};
+    vector<bool> used(globals_counts.at(p));
+    for (const auto* const c : t_output.classes) {
+      for (const auto r : c->refs.at(p)) {
+        if (!used.at(r)) {
+          used.at(r) = true;
+          globals.push_back(r);
+        }
+      }
+    }
+
+    const auto& ranks{t_ranks.at(p)};
+    sort(globals.begin(), globals.end(),
+         [&ranks] (const uint32_t lhs, const uint32_t rhs) {
+      return ranks.at(lhs) < ranks.at(rhs);
+    });
+    auto& locals{t_output.locals.at(p)};
+    locals.assign(globals_counts.at(p), DexFile::NO_INDEX);
+    for (size_t i{}; i != globals.size(); ++i) {
+      locals.at(globals.at(i)) = static_cast<uint32_t>(i);
+    }
+  }
+
+  // Reserve space for the header and identifiers.
+  t_output.map.push_back({ItemType::HEADER, 0U, 1U});
+  size_t offset{DexFile::HEADER_SIZE};
+  for (size_t p{}; p != size<Pool>(); ++p) {
+    const auto count{static_cast<uint32_t>(t_output.globals.at(p).size())};
+    if (count != 0U) {
+      t_output.ids_offsets.at(p) = static_cast<uint32_t>(offset);
+      t_output.map.push_back({static_cast<ItemType>(
+          static_cast<uint16_t>(ItemType::STRING_ID) + p),
+          static_cast<uint32_t>(offset), count});
+    }
+    offset += count * ID_ITEM_SIZES.get(static_cast<Pool>(p));
+  }
+  t_output.class_defs_offset = static_cast<uint32_t>(offset);
+  t_output.map.push_back({ItemType::CLASS_DEF, static_cast<uint32_t>(offset),
+                          static_cast<uint32_t>(t_output.classes.size())});
+  offset += t_output.classes.size() * CLASS_DEF_ITEM_SIZE;
+  t_output.data.resize(offset);
+
+  const auto get_globals{[&t_output] (const Pool pool) -> const auto& {
+    return t_output.globals.at(static_cast<size_t>(pool));
+  }};
+  const auto get_id_offset{[&t_output] (const Pool pool, const size_t idx) {
+    return t_output.ids_offsets.at(static_cast<size_t>(pool)) +
+           idx * ID_ITEM_SIZES.get(pool);
+  }};
+  const auto add_type_list{[&t_output] (const vector<uint32_t>& types) {
+    if (types.empty()) {
+      return 0U;
+    }
+    string bytes;
+    append_le(bytes, static_cast<uint32_t>(types.size()));
+    for (const auto t : types) {
+      append_le(bytes, static_cast<uint16_t>(
+                t_output.get_local(Pool::TYPE, t)));
+    }
+    return t_output.add_item(ItemType::TYPE_LIST, bytes, true);
+  }};
+
+  const auto& strings{get_globals(Pool::STRING)};
+  for (size_t i{}; i != strings.size(); ++i) {
+    const auto& str{*m_strings.at(strings.at(i))};
+    string bytes;
+    append_uleb128(bytes, get_utf16_size(str));
+    bytes += str;
+    bytes += '\0';
+    put_le(t_output.data, get_id_offset(Pool::STRING, i),
+           t_output.add_item(ItemType::STRING_DATA, bytes));
+  }
+
+  const auto& types{get_globals(Pool::TYPE)};
+  for (size_t i{}; i != types.size(); ++i) {
+    put_le(t_output.data, get_id_offset(Pool::TYPE, i),
+           t_output.get_local(Pool::STRING, m_types.at(types.at(i))));
+  }
+
+  const auto& protos{get_globals(Pool::PROTO)};
+  for (size_t i{}; i != protos.size(); ++i) {
+    const auto& proto{*m_protos.at(protos.at(i))};
+    const auto id_offset{get_id_offset(Pool::PROTO, i)};
+    put_le(t_output.data, id_offset,
+           t_output.get_local(Pool::STRING, proto.shorty));
+    put_le(t_output.data, id_offset + 4U,
+           t_output.get_local(Pool::TYPE, proto.return_type));
+    put_le(t_output.data, id_offset + 8U, add_type_list(proto.params));
+  }
+
+  for (const auto pool : {Pool::FIELD, Pool::METHOD}) {
+    const auto& members{get_globals(pool)};
+    for (size_t i{}; i != members.size(); ++i) {
+      const auto& [class_type, type, name]{*(pool == Pool::FIELD ?
+          m_fields : m_methods).at(members.at(i))};
+      const auto id_offset{get_id_offset(pool, i)};
+      put_le(t_output.data, id_offset, static_cast<uint16_t>(
+             t_output.get_local(Pool::TYPE, class_type)));
+      put_le(t_output.data, id_offset + 2U, static_cast<uint16_t>(
+             t_output.get_local(pool == Pool::FIELD ?
+                                Pool::TYPE : Pool::PROTO, type)));
+      put_le(t_output.data, id_offset + 4U,
+             t_output.get_local(Pool::STRING, name));
+    }
+  }
+
+  for (const auto* const c : t_output.classes) {
+    const auto& input{m_inputs.at(c->input)};
+    auto def{c->def};
+    def.class_idx = t_output.get_local(Pool::TYPE, c->type);
+    if (c->superclass != DexFile::NO_INDEX) {
+      def.superclass_idx = t_output.get_local(Pool::TYPE, c->superclass);
+    }
+    def.interfaces_off = add_type_list(c->interfaces);
+    if (def.source_file_idx != DexFile::NO_INDEX) {
+      def.source_file_idx = t_output.get_local(Pool::STRING,
+          get_global(input, Pool::STRING, def.source_file_idx));
+    }
+    // Offsets of other items are assigned later.
+    def.annotations_off = def.class_data_off = def.static_values_off = 0U;
+    t_output.class_defs.push_back(def);
+  }
+}
+
+void DexMerger::write_code(Output& t_output) const {
+  // Debug information is written first, so offsets are known for code items.
+  for (const auto is_code : {false, true}) {
+    for (const auto* const c : t_output.classes) {
+      const auto& dex{*m_inputs.at(c->input).dex};
+      const auto remap{make_remap(t_output, c->input)};
+
+      for (size_t l{FIELD_LISTS_COUNT}; l != c->data.size(); ++l) {
+        for (const auto& m : c->data.at(l)) {
+          if (m.code_off == 0U) {
+            continue;
+          }
+          auto reader{dex.get_reader(m.code_off)};
+          string bytes;
+
+          if (is_code) {
+            if (t_output.offsets.count({c->input, m.code_off}) != 0U) {
+              continue;
+            }
+            const auto debug_info_off{copy_code(reader, remap, bytes)};
+            put_le(bytes, DEBUG_INFO_OFF_OFFSET,
+                   t_output.get_offset(c->input, debug_info_off));
+            t_output.offsets.emplace(make_pair(c->input, m.code_off),
+                t_output.add_item(ItemType::CODE, bytes));
+            continue;
+          }
+
+          static_cast<void>(reader.read(DEBUG_INFO_OFF_OFFSET));
+          const auto debug_info_off{reader.read_u32()};
+          if (debug_info_off == 0U ||
+              t_output.offsets.count({c->input, debug_info_off}) != 0U) {
+            continue;
+          }
+          reader = dex.get_reader(debug_info_off);
+          copy_debug_info(reader, remap, bytes);
+          t_output.offsets.emplace(make_pair(c->input, debug_info_off),
+              t_output.add_item(ItemType::DEBUG_INFO, bytes));
+        }
+      }
+    }
+  }
+}
+
+void DexMerger::write_class_data(Output& t_output) const {
+  for (size_t i{}; i != t_output.classes.size(); ++i) {
+    const auto* const c{t_output.classes.at(i)};
+    if (c->def.class_data_off == 0U) {
+      continue;
+    }
+
+    const auto remap{make_remap(t_output, c->input)};
+    string bytes;
+    for (const auto& l : c->data) {
+      append_uleb128(bytes, static_cast<uint32_t>(l.size()));
+    }
+    for (size_t l{}; l != c->data.size(); ++l) {
+      const auto is_method{l >= FIELD_LISTS_COUNT};
+      // Indexes are encoded as differences from previous ones.
+      uint32_t prev_idx{};
+      for (const auto& m : c->data.at(l)) {
+        const auto idx{remap(is_method ? Pool::METHOD : Pool::FIELD, m.idx)};
+        append_uleb128(bytes, idx - prev_idx);
+        prev_idx = idx;
+        append_uleb128(bytes, m.access_flags);
+        if (is_method) {
+          append_uleb128(bytes, t_output.get_offset(c->input, m.code_off));
+        }
+      }
+    }
+    t_output.class_defs.at(i).class_data_off =
+        t_output.add_item(ItemType::CLASS_DATA, bytes);
+  }
+}
+
+void DexMerger::write_annotations(Output& t_output) const {
+  const auto for_each_class{[&] (const auto& fun) {
+    for (size_t i{}; i != t_output.classes.size(); ++i) {
+      const auto* const c{t_output.classes.at(i)};
+      if (c->def.annotations_off != 0U) {
+        fun(i, *c, *m_inputs.at(c->input).dex);
+      }
+    }
+  }};
+  const auto is_copied{[&t_output] (const size_t input, const uint32_t off) {
+    return t_output.offsets.count({input, off}) != 0U;
+  }};
+  // Lists of offsets of items copied previously.
+  const auto copy_offsets{[&t_output] (const DexFile& dex,
+      const size_t input, const uint32_t offset, const ItemType type) {
+    const auto offsets{read_offsets(dex, offset)};
+    string bytes;
+    append_le(bytes, static_cast<uint32_t>(offsets.size()));
+    for (const auto o : offsets) {
+      append_le(bytes, t_output.get_offset(input, o));
+    }
+    t_output.offsets.emplace(make_pair(input, offset),
+                             t_output.add_item(type, bytes, true));
+  }};
+
+  for_each_class([&] (size_t, const Class& cls, const DexFile& dex) {
+    const auto remap{make_remap(t_output, cls.input)};
+    for (const auto s : get_annotation_sets(dex, cls.annotations)) {
+      for (const auto a : read_offsets(dex, s)) {
+        if (is_copied(cls.input, a)) {
+          continue;
+        }
+        auto reader{dex.get_reader(a)};
+        string bytes(1U, static_cast<char>(reader.read_u8()));
+        copy_encoded_annotation(reader, remap, bytes);
+        t_output.offsets.emplace(make_pair(cls.input, a),
+            t_output.add_item(ItemType::ANNOTATION, bytes, true));
+      }
+    }
+  });
+
+  for_each_class([&] (size_t, const Class& cls, const DexFile& dex) {
+    for (const auto s : get_annotation_sets(dex, cls.annotations)) {
+      if (!is_copied(cls.input, s)) {
+        copy_offsets(dex, cls.input, s, ItemType::ANNOTATION_SET);
+      }
+    }
+  });
+
+  for_each_class([&] (size_t, const Class& cls, const DexFile& dex) {
+    for (const auto& [idx, offset] : cls.annotations.params) {
+      if (!is_copied(cls.input, offset)) {
+        copy_offsets(dex, cls.input, offset,
+                     ItemType::ANNOTATION_SET_REF_LIST);
+      }
+    }
+  });
+
+  for_each_class([&] (const size_t i, const Class& cls, const DexFile&) {
+    const auto remap{make_remap(t_output, cls.input)};
+    const auto& annotations{cls.annotations};
+    string bytes;
+    append_le(bytes, t_output.get_offset(
+              cls.input, annotations.class_annotations_off));
+    for (const auto* const list :
+         {&annotations.fields, &annotations.methods, &annotations.params}) {
+      append_le(bytes, static_cast<uint32_t>(list->size()));
+    }
+    for (const auto* const list :
+         {&annotations.fields, &annotations.methods, &annotations.params}) {
+      const auto pool{list == &annotations.fields ? Pool::FIELD : Pool::METHOD};
+      for (const auto& [idx, offset] : *list) {
+        append_le(bytes, remap(pool, idx));
+        append_le(bytes, t_output.get_offset(cls.input, offset));
+      }
+    }
+    t_output.class_defs.at(i).annotations_off =
+        t_output.add_item(ItemType::ANNOTATIONS_DIRECTORY, bytes);
+  });
+}
+
+void DexMerger::write_static_values(Output& t_output) const {
+  for (size_t i{}; i != t_output.classes.size(); ++i) {
+    const auto* const c{t_output.classes.at(i)};
+    if (c->def.static_values_off == 0U) {
+      continue;
+    }
+
+    auto reader{m_inputs.at(c->input).dex->get_reader(
+                c->def.static_values_off)};
+    string bytes;
+    copy_encoded_array(reader, make_remap(t_output, c->input), bytes);
+    t_output.class_defs.at(i).static_values_off =
+        t_output.add_item(ItemType::ENCODED_ARRAY, bytes, true);
+  }
+}
+
+void DexMerger::write_class_defs(Output& t_output) {
+  for (size_t i{}; i != t_output.class_defs.size(); ++i) {
+    const auto& def{t_output.class_defs.at(i)};
+    auto offset{t_output.class_defs_offset + i * CLASS_DEF_ITEM_SIZE};
+    for (const auto field : {def.class_idx, def.access_flags,
+         def.superclass_idx, def.interfaces_off, def.source_file_idx,
+         def.annotations_off, def.class_data_off, def.static_values_off}) {
+      put_le(t_output.data, offset, field);
+      offset += sizeof(field);
+    }
+  }
+}
+
+void DexMerger::write_map(Output& t_output) {
+  // Type (two bytes), unused (two bytes), size and offset.
+  constexpr size_t ITEM_SIZE{12U};
+
+  auto& data{t_output.data};
+  data.resize((data.size() + 3U) / 4U * 4U);
+  t_output.map_offset = static_cast<uint32_t>(data.size());
+  t_output.map.push_back({ItemType::MAP_LIST, t_output.map_offset, 1U});
+
+  string bytes;
+  append_le(bytes, static_cast<uint32_t>(t_output.map.size()));
+  for (const auto& i : t_output.map) {
+    append_le(bytes, static_cast<uint16_t>(i.type));
+    append_le(bytes, uint16_t{});
+    append_le(bytes, i.count);
+    append_le(bytes, i.offset);
+  }
+  if (data.size() + t_output.map.size() * ITEM_SIZE + 4U >
+      numeric_limits<uint32_t>::max()) {
+    throw runtime_error("DEX file is too large");
+  }
+  data += bytes;
+}
+
+void DexMerger::write_header(Output& t_output) {
+  auto& data{t_output.data};
+  const auto data_offset{static_cast<uint32_t>(t_output.class_defs_offset +
+      t_output.classes.size() * CLASS_DEF_ITEM_SIZE)};
+
+  string header("dex\n0" + to_string(t_output.version) + '\0');
+  // Checksum and signature are calculated later.
+  header.resize(SIGNATURE_OFFSET + SIGNATURE_SIZE);
+  append_le(header, static_cast<uint32_t>(data.size()));
+  append_le(header, static_cast<uint32_t>(DexFile::HEADER_SIZE));
+  append_le(header, ENDIAN_CONSTANT);
+  // Link section isn't used.
+  append_le(header, uint64_t{});
+  append_le(header, t_output.map_offset);
+  for (size_t p{}; p != size<Pool>(); ++p) {
+    append_le(header, static_cast<uint32_t>(t_output.globals.at(p).size()));
+    append_le(header, t_output.ids_offsets.at(p));
+  }
+  append_le(header, static_cast<uint32_t>(t_output.classes.size()));
+  append_le(header, t_output.classes.empty() ? 0U : t_output.class_defs_offset);
+  append_le(header, static_cast<uint32_t>(data.size() - data_offset));
+  append_le(header, data_offset);
+  data.replace(0U, header.size(), header);
+
+  // Signature is SHA-1 of the rest of the file.
+  constexpr auto SIGNED_OFFSET{SIGNATURE_OFFSET + SIGNATURE_SIZE};
+  array<unsigned char, EVP_MAX_MD_SIZE> signature{};
+  unsigned signature_size{};
+  if (EVP_Digest(data.data() + SIGNED_OFFSET, data.size() - SIGNED_OFFSET,
+                 signature.data(), &signature_size, EVP_sha1(),
+                 nullptr) != 1 || signature_size != SIGNATURE_SIZE) {
+    throw runtime_error("failed to calculate signature of DEX file");
+  }
+  copy_n(signature.cbegin(), SIGNATURE_SIZE,
+         data.begin() + static_cast<ptrdiff_t>(SIGNATURE_OFFSET));
+
+  // Checksum covers everything except the magic and itself.
+  const auto checksum{adler32(adler32(0UL, Z_NULL, 0U),
+      reinterpret_cast<const Bytef*>(data.data() + SIGNATURE_OFFSET),
+      static_cast<uInt>(data.size() - SIGNATURE_OFFSET))};
+  put_le(data, CHECKSUM_OFFSET, static_cast<uint32_t>(checksum));
+}
+
+auto DexMerger::make_remap(const Output& t_output, const size_t t_input) const
+    -> function<remap_t> {
+  return [&t_output, &input = m_inputs.at(t_input)] (
+      const Pool pool, const uint32_t idx) {
+    return t_output.get_local(pool, get_global(input, pool, idx));
+  };
+}
+
+// ------------------ +
+// Read input classes |
+// ------------------ +
+
+auto DexMerger::read_class_data(const DexFile& t_dex,
+                                const uint32_t t_offset) -> ClassData {
+  auto reader{t_dex.get_reader(t_offset)};
+  array<uint32_t, tuple_size_v<ClassData>> sizes{};
+  for (auto& s : sizes) {
+    s = reader.read_uleb128();
+  }
+
+  ClassData data;
+  for (size_t l{}; l != data.size(); ++l) {
+    uint32_t idx{};
+    // Sizes aren't trusted, so members are added as they are read.
+    for (uint32_t i{}; i != sizes.at(l); ++i) {
+      EncodedMember member;
+      idx += reader.read_uleb128();
+      member.idx = idx;
+      member.access_flags = reader.read_uleb128();
+      if (l >= FIELD_LISTS_COUNT) {
+        member.code_off = reader.read_uleb128();
+      }
+      data.at(l).push_back(member);
+    }
+  }
+  return data;
+}
+
+auto DexMerger::read_annotations(const DexFile& t_dex,
+                                 const uint32_t t_offset) ->
+    AnnotationsDirectory {
+  auto reader{t_dex.get_reader(t_offset)};
+  AnnotationsDirectory annotations;
+  annotations.class_annotations_off = reader.read_u32();
+
+  array<uint32_t, 3U> sizes{};
+  for (auto& s : sizes) {
+    s = reader.read_u32();
+  }
+  const array lists{
+      &annotations.fields, &annotations.methods, &annotations.params};
+  for (size_t l{}; l != lists.size(); ++l) {
+    for (uint32_t i{}; i != sizes.at(l); ++i) {
+      const auto idx{reader.read_u32()};
+      lists.at(l)->emplace_back(idx, reader.read_u32());
+    }
+  }
+  return annotations;
+}
+
+auto DexMerger::read_offsets(const DexFile& t_dex,
+                             const uint32_t t_offset) -> vector<uint32_t> {
+  auto reader{t_dex.get_reader(t_offset)};
+  vector<uint32_t> offsets;
+  for (auto size{reader.read_u32()}; size != 0U; --size) {
+    offsets.push_back(reader.read_u32());
+  }
+  return offsets;
+}
+
+auto DexMerger::get_annotation_sets(const DexFile& t_dex,
+    const AnnotationsDirectory& t_annotations) -> vector<uint32_t> {
+  vector<uint32_t> sets;
+  if (t_annotations.class_annotations_off != 0U) {
+    sets.push_back(t_annotations.class_annotations_off);
+  }
+  for (const auto* const list :
+       {&t_annotations.fields, &t_annotations.methods}) {
+    for (const auto& [idx, offset] : *list) {
+      sets.push_back(offset);
+    }
+  }
+  for (const auto& [idx, offset] : t_annotations.params) {
+    for (const auto s : read_offsets(t_dex, offset)) {
+      if (s != 0U) {
+        sets.push_back(s);
+      }
+    }
+  }
+  return sets;
+}
+
+// ---------- +
+// Copy items |
+// ---------- +
+
+auto DexMerger::copy_code(Reader& t_reader,
+    const function<remap_t>& t_remap, string& t_out) -> uint32_t {
+  // Try item consists of start address, instructions count and handler offset.
+  constexpr size_t TRY_ITEM_SIZE{8U};
+
+  // Sizes of registers, incoming and outgoing arguments.
+  t_out += t_reader.read(6U);
+  const auto tries_size{t_reader.read_u16()};
+  append_le(t_out, tries_size);
+  const auto debug_info_off{t_reader.read_u32()};
+  append_le(t_out, uint32_t{});
+  const auto insns_size{t_reader.read_u32()};
+  append_le(t_out, insns_size);
+  copy_insns(t_reader, insns_size, t_remap, t_out);
+
+  if (tries_size == 0U) {
+    return debug_info_off;
+  }
+  if (insns_size % 2U != 0U) {
+    static_cast<void>(t_reader.read_u16());
+    append_le(t_out, uint16_t{});
+  }
+
+  const auto tries_offset{t_out.size()};
+  t_out += t_reader.read(tries_size * TRY_ITEM_SIZE);
+  const auto handler_offsets{copy_handlers(t_reader, t_remap, t_out)};
+  for (size_t t{}; t != tries_size; ++t) {
+    // Handler offset is the last field.
+    const auto pos{tries_offset + (t + 1U) * TRY_ITEM_SIZE - 2U};
+    const auto old_offset{static_cast<uint16_t>(
+        static_cast<uint8_t>(t_out.at(pos)) |
+        (static_cast<uint8_t>(t_out.at(pos + 1U)) << 8U))};
+
+    const auto iter{handler_offsets.find(old_offset)};
+    if (iter == handler_offsets.cend() ||
+        iter->second > numeric_limits<uint16_t>::max()) {
+      throw runtime_error("invalid offset of exception handler");
+    }
+    put_le(t_out, pos, static_cast<uint16_t>(iter->second));
+  }
+  return debug_info_off;
+}
+
+void DexMerger::copy_insns(Reader& t_reader, const uint32_t t_units_count,
+    const function<remap_t>& t_remap, string& t_out) {
+  // Each code unit takes two bytes.
+  const auto data{t_reader.read(static_cast<size_t>(t_units_count) * 2U)};
+  vector<uint16_t> insns(t_units_count);
+  for (size_t i{}; i != insns.size(); ++i) {
+    insns.at(i) = static_cast<uint16_t>(
+        static_cast<uint8_t>(data[i * 2U]) |
+        (static_cast<uint8_t>(data[i * 2U + 1U]) << 8U));
+  }
+
+  const auto remap_unit{[&] (const Pool pool, uint16_t& unit) {
+    const auto idx{t_remap(pool, unit)};
+    if (idx > numeric_limits<uint16_t>::max()) {
+      throw runtime_error("index doesn't fit an instruction");
+    }
+    unit = static_cast<uint16_t>(idx);
+  }};
+
+  for (size_t pos{}; pos < insns.size();) {
+    const auto unit{insns.at(pos)};
+    const auto opcode{static_cast<uint8_t>(unit & 0xFFU)};
+    uint64_t size{INSN_SIZES.at(opcode)};
+    const auto get_unit{[&insns, pos] (const size_t i) -> uint64_t {
+      return pos + i < insns.size() ? insns.at(pos + i) : 0U;
+    }};
+
+    switch (unit) {
+      case PACKED_SWITCH_PAYLOAD:
+        size = get_unit(1U) * 2U + 4U;
+        break;
+      case SPARSE_SWITCH_PAYLOAD:
+        size = get_unit(1U) * 4U + 2U;
+        break;
+      case FILL_ARRAY_DATA_PAYLOAD:
+        size = (get_unit(1U) * (get_unit(2U) | (get_unit(3U) << 16U)) + 1U) /
+               2U + 4U;
+        break;
+      default:
+        break;
+    }
+    if (size > insns.size() - pos) {
+      throw runtime_error("instruction is truncated");
+    }
+
+    if (opcode == 0x1AU) {
+      remap_unit(Pool::STRING, insns.at(pos + 1U));
+    } else if (opcode == 0x1BU) {
+      // const-string/jumbo uses 32-bit index.
+      const auto idx{t_remap(Pool::STRING, static_cast<uint32_t>(
+          insns.at(pos + 1U) | (insns.at(pos + 2U) << 16U)))};
+      insns.at(pos + 1U) = static_cast<uint16_t>(idx & 0xFFFFU);
+      insns.at(pos + 2U) = static_cast<uint16_t>(idx >> 16U);
+    } else if (opcode == 0x1CU || opcode == 0x1FU || opcode == 0x20U ||
+               (opcode >= 0x22U && opcode <= 0x25U)) {
+      remap_unit(Pool::TYPE, insns.at(pos + 1U));
+    } else if (opcode >= 0x52U && opcode <= 0x6DU) {
+      remap_unit(Pool::FIELD, insns.at(pos + 1U));
+    } else if ((opcode >= 0x6EU && opcode <= 0x72U) ||
+               (opcode >= 0x74U && opcode <= 0x78U)) {
+      remap_unit(Pool::METHOD, insns.at(pos + 1U));
+    } else if (opcode == 0xFAU || opcode == 0xFBU) {
+      // invoke-polymorphic refers to a method and a prototype.
+      remap_unit(Pool::METHOD, insns.at(pos + 1U));
+      remap_unit(Pool::PROTO, insns.at(pos + 3U));
+    } else if (opcode == 0xFFU) {
+      remap_unit(Pool::PROTO, insns.at(pos + 1U));
+    } else if (opcode >= 0xFCU) {
+      throw runtime_error("call sites and method handles aren't supported");
+    }
+    pos += size;
+  }
+
+  for (const auto i : insns) {
+    append_le(t_out, i);
+  }
+}
+
+auto DexMerger::copy_handlers(Reader& t_reader,
+    const function<remap_t>& t_remap, string& t_out) ->
+    map<uint32_t, uint32_t> {
+  const auto
+      in_start{t_reader.get_offset()},
+      out_start{t_out.size()};
+  const auto handlers_count{t_reader.read_uleb128()};
+  append_uleb128(t_out, handlers_count);
+
+  map<uint32_t, uint32_t> offsets;
+  for (uint32_t h{}; h != handlers_count; ++h) {
+    offsets.emplace(t_reader.get_offset() - in_start, t_out.size() - out_start);
+    const auto size{t_reader.read_sleb128()};
+    append_sleb128(t_out, size);
+
+    // Non-positive size means there is a catch-all handler.
+    const auto pairs_count{size < 0 ? -static_cast<int64_t>(size) : size};
+    for (int64_t p{}; p != pairs_count; ++p) {
+      append_uleb128(t_out, t_remap(Pool::TYPE, t_reader.read_uleb128()));
+      append_uleb128(t_out, t_reader.read_uleb128());
+    }
+    if (size <= 0) {
+      append_uleb128(t_out, t_reader.read_uleb128());
+    }
+  }
+  return offsets;
+}
+
+void DexMerger::copy_debug_info(Reader& t_reader,
+    const function<remap_t>& t_remap, string& t_out) {
+  const auto copy_uleb128{[&] {
+    append_uleb128(t_out, t_reader.read_uleb128());
+  }};
+  const auto copy_index{[&] (const Pool pool) {
+    const auto idx{t_reader.read_uleb128p1()};
+    append_uleb128p1(t_out,
+        idx == DexFile::NO_INDEX ? idx : t_remap(pool, idx));
+  }};
+
+  // Starting line.
+  copy_uleb128();
+  const auto params_count{t_reader.read_uleb128()};
+  append_uleb128(t_out, params_count);
+  for (uint32_t p{}; p != params_count; ++p) {
+    copy_index(Pool::STRING);
+  }
+
+  for (;;) {
+    const auto opcode{t_reader.read_u8()};
+    t_out += static_cast<char>(opcode);
+    switch (opcode) {
+      case DBG_END_SEQUENCE:
+        return;
+      case DBG_ADVANCE_PC:
+      case DBG_END_LOCAL:
+      case DBG_RESTART_LOCAL:
+        copy_uleb128();
+        break;
+      case DBG_ADVANCE_LINE:
+        append_sleb128(t_out, t_reader.read_sleb128());
+        break;
+      case DBG_START_LOCAL:
+      case DBG_START_LOCAL_EXTENDED:
+        // Register, name, type and signature.
+        copy_uleb128();
+        copy_index(Pool::STRING);
+        copy_index(Pool::TYPE);
+        if (opcode == DBG_START_LOCAL_EXTENDED) {
+          copy_index(Pool::STRING);
+        }
+        break;
+      case DBG_SET_FILE:
+        copy_index(Pool::STRING);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void DexMerger::copy_encoded_value(Reader& t_reader,
+    const function<remap_t>& t_remap, string& t_out) {
+  const auto header{t_reader.read_u8()};
+  const auto type{static_cast<uint8_t>(header & 0x1FU)};
+  const auto arg{static_cast<unsigned>(header >> 5U)};
+
+  Pool pool{};
+  switch (type) {
+    case VALUE_METHOD_TYPE:
+      pool = Pool::PROTO;
+      break;
+    case VALUE_STRING:
+      pool = Pool::STRING;
+      break;
+    case VALUE_TYPE:
+      pool = Pool::TYPE;
+      break;
+    case VALUE_FIELD:
+    case VALUE_ENUM:
+      pool = Pool::FIELD;
+      break;
+    case VALUE_METHOD:
+      pool = Pool::METHOD;
+      break;
+    case VALUE_METHOD_HANDLE:
+      throw runtime_error("call sites and method handles aren't supported");
+    case VALUE_ARRAY:
+      t_out += static_cast<char>(header);
+      copy_encoded_array(t_reader, t_remap, t_out);
+      return;
+    case VALUE_ANNOTATION:
+      t_out += static_cast<char>(header);
+      copy_encoded_annotation(t_reader, t_remap, t_out);
+      return;
+    case VALUE_NULL:
+    case VALUE_BOOLEAN:
+      t_out += static_cast<char>(header);
+      return;
+    default:
+      // Numbers are copied as is.
+      t_out += static_cast<char>(header);
+      t_out += t_reader.read(arg + 1U);
+      return;
+  }
+
+  // Index takes (arg + 1) bytes.
+  const auto bytes{t_reader.read(arg + 1U)};
+  uint64_t idx{};
+  for (size_t i{}; i != bytes.size(); ++i) {
+    idx |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (i * 8U);
+  }
+  if (idx > numeric_limits<uint32_t>::max()) {
+    throw runtime_error("index is out of range");
+  }
+
+  const auto header_pos{t_out.size()};
+  t_out += '\0';
+  const auto size{append_min_le(t_out,
+                  t_remap(pool, static_cast<uint32_t>(idx)))};
+  t_out.at(header_pos) = static_cast<char>(((size - 1U) << 5U) | type);
+}
+
+void DexMerger::copy_encoded_array(Reader& t_reader,
+    const function<remap_t>& t_remap, string& t_out) {
+  const auto size{t_reader.read_uleb128()};
+  append_uleb128(t_out, size);
+  for (uint32_t i{}; i != size; ++i) {
+    copy_encoded_value(t_reader, t_remap, t_out);
+  }
+}
+
+void DexMerger::copy_encoded_annotation(Reader& t_reader,
+    const function<remap_t>& t_remap, string& t_out) {
+  append_uleb128(t_out, t_remap(Pool::TYPE, t_reader.read_uleb128()));
+  const auto size{t_reader.read_uleb128()};
+  append_uleb128(t_out, size);
+  for (uint32_t i{}; i != size; ++i) {
+    // Name of an element.
+    append_uleb128(t_out, t_remap(Pool::STRING, t_reader.read_uleb128()));
+    copy_encoded_value(t_reader, t_remap, t_out);
+  }
+}
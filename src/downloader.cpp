@@ -0,0 +1,435 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cpr/callback.h>
+#include <cpr/status_codes.h>
+
+#include "downloader.hpp"
+#include "general/scope_guard.hpp"
+#include "sha256.hpp"
+
+using namespace std;
+using namespace chrono;
+using namespace filesystem;
+using namespace cpr;
+
+Downloader::Downloader(HttpClient t_client, path t_cache_dir,
+    const unsigned short t_segments_count, const uint64_t t_min_segment_size):
+    m_client(move(t_client)), m_cache_dir(move(t_cache_dir)),
+    m_segments_count(t_segments_count),
+    m_min_segment_size(t_min_segment_size) {}
+
+auto Downloader::fetch(const Url& t_url, const string_view t_sha256,
+    const function<progress_callback_t>& t_callback) const -> path {
+  if (auto blob_path{find(t_sha256)}; !blob_path.empty()) {
+    return blob_path;
+  }
+
+  const auto partial_dir{m_cache_dir / PARTIAL_SUBDIR_NAME};
+  create_directories(partial_dir);
+  // Checksum identifies a file, so partial data can't be mixed up.
+  const auto partial_path{partial_dir /
+      (string(t_sha256) + string(PARTIAL_FILE_EXTENSION))};
+  const auto state_path{partial_dir /
+      (string(t_sha256) + string(STATE_FILE_EXTENSION))};
+
+  string sha256;
+  for (bool restarted{};; restarted = true) {
+    const auto remote{get_remote(t_url)};
+    if (!remote.ranges_supported) {
+      remove(state_path);
+      sha256 = download_entirely(remote.url, partial_path, t_callback);
+      break;
+    }
+
+    auto state{load_state(state_path)};
+    if (state.validator != remote.validator || state.size != remote.size ||
+        state.segments.empty() || !exists(partial_path)) {
+      state = {remote.validator, remote.size, split(remote.size)};
+      // Segments are written at their offsets, so allocate entire file.
+      if (!ofstream(partial_path, ios::binary | ios::trunc)) {
+        throw runtime_error("failed to create partial file");
+      }
+      resize_file(partial_path, remote.size);
+      save_state(state_path, state);
+    }
+
+    sha256 = download_segments(
+        remote, state, partial_path, state_path, t_callback);
+    if (!sha256.empty()) {
+      break;
+    }
+    // Remote file has been changed, so the partial data is useless.
+    if (restarted) {
+      throw runtime_error("remote file is changing while downloading");
+    }
+    remove(state_path);
+  }
+
+  if (sha256 != t_sha256) {
+    error_code err;
+    // Ignore errors, since it's already failed state.
+    remove(partial_path, err);
+    remove(state_path, err);
+    throw runtime_error("invalid checksum");
+  }
+  remove(state_path);
+
+  // Both directories are located in the cache, so it's just renaming.
+  auto blob_path{get_blob_path(t_sha256)};
+  create_directories(blob_path.parent_path());
+  rename(partial_path, blob_path);
+  return blob_path;
+}
+
+void Downloader::download(const Url& t_url, const string_view t_sha256,
+    const path& t_output_path,
+    const function<progress_callback_t>& t_callback) const {
+  copy_file(fetch(t_url, t_sha256, t_callback),
+            t_output_path, copy_options::overwrite_existing);
+}
+
+auto Downloader::find(const string_view t_sha256) const -> path {
+  // Blobs are verified before they're moved to the cache.
+  auto blob_path{get_blob_path(t_sha256)};
+  return exists(blob_path) ? blob_path : path();
+}
+
+auto Downloader::get_remote(const Url& t_url) const -> Remote {
+  Remote remote;
+  remote.url = t_url;
+  const auto head{m_client.head(t_url)};
+  // Let the download request report the failure.
+  if (head.status_code != status::HTTP_OK) {
+    return remote;
+  }
+  // Avoid following redirects on every request.
+  if (!head.url.empty()) {
+    remote.url = head.url;
+  }
+
+  // Header map is case-insensitive.
+  const auto& header{head.header};
+  const auto
+      ranges_iter{header.find("accept-ranges")},
+      length_iter{header.find("content-length")};
+  if (ranges_iter == header.cend() || ranges_iter->second != "bytes" ||
+      length_iter == header.cend()) {
+    return remote;
+  }
+  try {
+    remote.size = stoull(length_iter->second);
+  } catch (const exception&) {
+    return remote;
+  }
+  remote.ranges_supported = true;
+
+  // Weak entity tags can't be used in the If-Range header.
+  if (const auto iter{header.find("etag")};
+      iter != header.cend() && iter->second.rfind("W/", 0U) != 0U) {
+    remote.validator = iter->second;
+  } else if (const auto iter{header.find("last-modified")};
+             iter != header.cend()) {
+    remote.validator = iter->second;
+  }
+  return remote;
+}
+
+auto Downloader::load_state(const path& t_path) -> State {
+  ifstream ifs(t_path);
+  State state;
+  if (!getline(ifs, state.validator) || !(ifs >> state.size)) {
+    return {};
+  }
+
+  Segment segment;
+  while (ifs >> segment.first >> segment.last >> segment.pos) {
+    if (segment.first > segment.pos || segment.pos > segment.last ||
+        segment.last > state.size) {
+      return {};
+    }
+    state.segments.push_back(segment);
+  }
+  return ifs.eof() ? state : State{};
+}
+
+auto Downloader::save_state(const path& t_path, const State& t_state) -> bool {
+  // Replace the file atomically, so it won't be left half-written.
+  auto tmp_path{t_path};
+  tmp_path += ".tmp";
+  {
+    ofstream ofs(tmp_path, ios::trunc);
+    ofs << t_state.validator << '\n' << t_state.size << '\n';
+    for (const auto& s : t_state.segments) {
+      ofs << s.first << ' ' << s.last << ' ' << s.pos << '\n';
+    }
+    if (!ofs) {
+      return false;
+    }
+  }
+  error_code err;
+  rename(tmp_path, t_path, err);
+  return !err;
+}
+
+auto Downloader::split(const uint64_t t_size) const -> vector<Segment> {
+  const auto count{clamp<uint64_t>(t_size / max<uint64_t>(
+      m_min_segment_size, 1U), 1U, max<uint64_t>(m_segments_count, 1U))};
+  const auto segment_size{t_size / count};
+
+  vector<Segment> segments;
+  for (uint64_t i{}; i != count; ++i) {
+    const auto first{i * segment_size};
+    // The last segment also takes the remainder.
+    const auto last{i + 1U == count ? t_size : first + segment_size};
+    segments.push_back({first, last, first});
+  }
+  return segments;
+}
+
+auto Downloader::download_segments(const Remote& t_remote, State& t_state,
+    const path& t_partial_path, const path& t_state_path,
+    const function<progress_callback_t>& t_callback) const -> string {
+  const int fd{open(t_partial_path.c_str(), O_RDWR | O_CLOEXEC)};
+  if (fd == -1) {
+    throw runtime_error("failed to open partial file");
+  }
+  const ScopeGuard fd_guard([fd] { close(fd); });
+
+  // Following variables are guarded by the mutex.
+  mutex state_mutex;
+  uint64_t downloaded{};
+  auto prev_save{steady_clock::now()};
+  string error;
+  bool changed{};
+
+  for (const auto& s : t_state.segments) {
+    downloaded += s.pos - s.first;
+  }
+  if (t_callback) {
+    t_callback(downloaded, t_state.size);
+  }
+
+  // Set when any segment fails, so the others stop too.
+  atomic_bool aborted{};
+  const auto fail{[&] (string msg) {
+    const lock_guard lock(state_mutex);
+    if (error.empty()) {
+      error = move(msg);
+    }
+    aborted = true;
+  }};
+
+  /*
+   * Data is hashed in order of offsets while it's downloaded. Following
+   * variables are guarded by the hash mutex, which is only tried to be locked
+   * by writers, so hashing never stalls transfers.
+   */
+  mutex hash_mutex;
+  Sha256 sha256;
+  uint64_t hashed{};
+  // Reads back and hashes data, which is written but not hashed yet: data of
+  // previous attempts and data of a segment, which is after the hashed one.
+  const auto hash_written{[&] {
+    vector<char> buf;
+    for (;;) {
+      uint64_t available{hashed};
+      {
+        const lock_guard lock(state_mutex);
+        for (const auto& s : t_state.segments) {
+          if (s.first <= hashed && hashed < s.last) {
+            available = s.pos;
+            break;
+          }
+        }
+      }
+      if (available <= hashed) {
+        return true;
+      }
+
+      buf.resize(static_cast<size_t>(
+          min<uint64_t>(available - hashed, READ_BUFFER_SIZE)));
+      const auto result{pread(fd, buf.data(), buf.size(),
+                              static_cast<off_t>(hashed))};
+      if (result == -1 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0 ||
+          !sha256.update(buf.data(), static_cast<size_t>(result))) {
+        return false;
+      }
+      hashed += static_cast<uint64_t>(result);
+    }
+  }};
+
+  const auto fetch{[&] (Segment& segment) {
+    long status_code{};
+    // Server ignores the range if the file has been changed since validator
+    // was retrieved, so status must be known before writing anything.
+    const auto header_callback{HttpClient::make_status_callback(status_code)};
+
+    const WriteCallback write_callback([&] (const string& data) {
+      if (aborted || status_code != status::HTTP_PARTIAL_CONTENT) {
+        return false;
+      }
+      if (data.size() > segment.last - segment.pos) {
+        fail("server sent more data than requested");
+        return false;
+      }
+
+      for (size_t written{}; written != data.size();) {
+        const auto result{pwrite(fd, data.data() + written,
+            data.size() - written, static_cast<off_t>(segment.pos + written))};
+        if (result == -1) {
+          if (errno == EINTR) {
+            continue;
+          }
+          fail("failed to write partial file");
+          return false;
+        }
+        written += static_cast<size_t>(result);
+      }
+
+      uint64_t write_pos{};
+      {
+        const lock_guard lock(state_mutex);
+        write_pos = segment.pos;
+        segment.pos += data.size();
+        downloaded += data.size();
+        if (t_callback) {
+          t_callback(downloaded, t_state.size);
+        }
+        if (const auto now{steady_clock::now()};
+            now - prev_save >= STATE_SAVE_INTERVAL) {
+          prev_save = now;
+          save_state(t_state_path, t_state);
+        }
+      }
+
+      // Data, which isn't hashed here, will be read back later.
+      if (unique_lock lock(hash_mutex, try_to_lock); lock) {
+        if (hashed == write_pos) {
+          if (!sha256.update(data.data(), data.size())) {
+            fail("failed to hash partial file");
+            return false;
+          }
+          hashed += data.size();
+        }
+        if (!hash_written()) {
+          fail("failed to hash partial file");
+          return false;
+        }
+      }
+      return true;
+    });
+
+    // Last position is inclusive.
+    Header header{{"Range", "bytes=" + to_string(segment.pos) + '-' +
+                  to_string(segment.last - 1U)}};
+    if (!t_remote.validator.empty()) {
+      header.emplace("If-Range", t_remote.validator);
+    }
+    const auto response{m_client.download(
+        write_callback, t_remote.url, header, header_callback)};
+
+    if (response.status_code == status::HTTP_OK) {
+      const lock_guard lock(state_mutex);
+      changed = true;
+      aborted = true;
+    } else if (response.error) {
+      fail(response.error.message);
+    } else if (response.status_code != status::HTTP_PARTIAL_CONTENT) {
+      fail("status code " + to_string(response.status_code));
+    } else if (segment.pos != segment.last) {
+      fail("transfer is incomplete");
+    }
+  }};
+
+  vector<future<void>> results;
+  for (auto& s : t_state.segments) {
+    if (s.pos != s.last) {
+      results.push_back(async(launch::async, fetch, ref(s)));
+    }
+  }
+  for (auto& r : results) {
+    r.get();
+  }
+
+  // Preserve the progress for the next attempt.
+  save_state(t_state_path, t_state);
+  if (changed) {
+    return {};
+  }
+  if (!error.empty()) {
+    throw runtime_error(error);
+  }
+  if (!hash_written() || hashed != t_state.size) {
+    throw runtime_error("failed to hash partial file");
+  }
+  auto digest{sha256.finish()};
+  if (digest.empty()) {
+    throw runtime_error("failed to hash partial file");
+  }
+  return digest;
+}
+
+auto Downloader::download_entirely(const Url& t_url,
+    const path& t_partial_path,
+    const function<progress_callback_t>& t_callback) const -> string {
+  ofstream ofs(t_partial_path, ios::binary | ios::trunc);
+  if (!ofs) {
+    throw runtime_error("failed to create partial file");
+  }
+
+  Sha256 sha256;
+  bool hash_failed{};
+  const WriteCallback write_callback([&] (const string& data) {
+    ofs.write(data.data(), static_cast<streamsize>(data.size()));
+    hash_failed = hash_failed || !sha256.update(data.data(), data.size());
+    return ofs && !hash_failed;
+  });
+  const ProgressCallback progress_callback([&t_callback]
+      (const size_t download_total, const size_t downloaded,
+      size_t /* upload_total */, size_t /* uploaded */) {
+    if (t_callback) {
+      t_callback(downloaded, download_total);
+    }
+    return true;
+  });
+
+  const auto response{
+      m_client.download(write_callback, t_url, progress_callback)};
+  if (!ofs) {
+    throw runtime_error("failed to write partial file");
+  }
+  if (hash_failed) {
+    throw runtime_error("failed to hash partial file");
+  }
+  if (response.error) {
+    throw runtime_error(response.error.message);
+  }
+  if (response.status_code != status::HTTP_OK) {
+    throw runtime_error("status code " + to_string(response.status_code));
+  }
+  auto digest{sha256.finish()};
+  if (digest.empty()) {
+    throw runtime_error("failed to hash partial file");
+  }
+  return digest;
+}
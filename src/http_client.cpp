@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include "http_client.hpp"
+
+using namespace std;
+using namespace cpr;
+
+HttpClient::Share::Share(): handle(curl_share_init()) {
+  if (handle == nullptr) {
+    throw runtime_error("failed to initialize HTTP share");
+  }
+}
+
+HttpClient::Share::~Share() {
+  curl_share_cleanup(handle);
+}
+
+HttpClient::HttpClient(): m_share(make_shared<Share>()) {
+  auto* const handle{m_share->handle};
+  if (curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, lock) != CURLSHE_OK ||
+      curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, unlock) != CURLSHE_OK ||
+      curl_share_setopt(handle,
+                        CURLSHOPT_USERDATA, m_share.get()) != CURLSHE_OK) {
+    throw runtime_error("failed to set HTTP share locks");
+  }
+
+  // Ignore failures, since it only affects performance.
+  for (const auto d : {CURL_LOCK_DATA_DNS, CURL_LOCK_DATA_SSL_SESSION,
+                       CURL_LOCK_DATA_CONNECT}) {
+    curl_share_setopt(handle, CURLSHOPT_SHARE, d);
+  }
+}
+
+void HttpClient::lock(CURL* /* handle */, const curl_lock_data t_data,
+                      curl_lock_access /* access */, void* const t_share) {
+  static_cast<Share*>(t_share)->mutexes.at(t_data).lock();
+}
+
+void HttpClient::unlock(CURL* /* handle */,
+                        const curl_lock_data t_data, void* const t_share) {
+  static_cast<Share*>(t_share)->mutexes.at(t_data).unlock();
+}
+
+void HttpClient::prepare(Session& t_session) const {
+  auto* const handle{t_session.GetCurlHolder()->handle};
+  curl_easy_setopt(handle, CURLOPT_SHARE, m_share->handle);
+  // Connections are kept open between requests, so detect dead ones.
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  // If the server doesn't support HTTP/2, then HTTP/1.1 will be used.
+  curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  if (m_compression) {
+    // Empty string means all encodings supported by libcurl.
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+  }
+}
+
+auto HttpClient::make_status_callback(long& t_status_code) -> HeaderCallback {
+  return HeaderCallback([&t_status_code] (const string& line) {
+    if (line.rfind("HTTP/", 0U) == 0U) {
+      const auto space_pos{line.find(' ')};
+      t_status_code = space_pos == string::npos ? 0L :
+          strtol(line.c_str() + space_pos + 1U, nullptr, 10);
+    }
+    return true;
+  });
+}
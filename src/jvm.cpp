@@ -16,15 +16,17 @@ using namespace jni;
 using namespace jvm_tools;
 using Jar = Sdk::Jar;
 
-Jvm::Jvm(const flags_t t_init_tools, const shared_ptr<const Sdk> t_sdk) {
+Jvm::Jvm(const flags_t t_init_tools, const shared_ptr<const Sdk> t_sdk,
+         const unsigned short t_sdk_api) {
   const auto heap_opts{get_heap_opts()};
   string classpath{"-Djava.class.path=" +
-                   t_sdk->get_jar_path(Jar::APM_JNI).string()};
+                   t_sdk->get_jar_path(Jar::APM_JNI, true, t_sdk_api).string()};
   if ((t_init_tools & D8) != flags_t{}) {
-    classpath += ':' + t_sdk->get_jar_path(Jar::D8).string();
+    classpath += ':' + t_sdk->get_jar_path(Jar::D8, true, t_sdk_api).string();
   }
   if ((t_init_tools & APKSIGNER) != flags_t{}) {
-    classpath += ':' + t_sdk->get_jar_path(Jar::APKSIGNER).string();
+    classpath += ':' +
+        t_sdk->get_jar_path(Jar::APKSIGNER, true, t_sdk_api).string();
   }
 
   array str_opts{heap_opts.first, heap_opts.second, classpath};
@@ -56,7 +58,7 @@ Jvm::Jvm(const flags_t t_init_tools, const shared_ptr<const Sdk> t_sdk) {
   }
   if ((t_init_tools & (D8 | APKSIGNER)) != flags_t{}) {
     safe_java_exec<void>([&] {
-      this->init_android_tools(t_init_tools, t_sdk);
+      this->init_android_tools(t_init_tools, t_sdk, t_sdk_api);
     }, "failed to initialize Android tools");
   }
 }
@@ -115,7 +117,7 @@ void Jvm::init_javac() {
 }
 
 void Jvm::init_android_tools(const flags_t t_tools,
-                             const shared_ptr<const Sdk> t_sdk) {
+    const shared_ptr<const Sdk> t_sdk, const unsigned short t_sdk_api) {
   const auto tool{Class<Tool>::Find(*m_env)};
   // Constructor takes path of a JAR file that must
   // contain Manifest file with the “Main-Class” attribute.
@@ -126,12 +128,12 @@ void Jvm::init_android_tools(const flags_t t_tools,
 
   // Don't require file existence since the constructor already checked it.
   if ((t_tools & D8) != flags_t{}) {
-    m_d8_obj = tool.New(*m_env, tool_init,
-               Make<String>(*m_env, t_sdk->get_jar_path(Jar::D8, false)));
+    m_d8_obj = tool.New(*m_env, tool_init, Make<String>(*m_env,
+        t_sdk->get_jar_path(Jar::D8, false, t_sdk_api)));
   }
   if ((t_tools & APKSIGNER) != flags_t{}) {
-    m_apksigner_obj = tool.New(*m_env, tool_init,
-        Make<String>(*m_env, t_sdk->get_jar_path(Jar::APKSIGNER, false)));
+    m_apksigner_obj = tool.New(*m_env, tool_init, Make<String>(*m_env,
+        t_sdk->get_jar_path(Jar::APKSIGNER, false, t_sdk_api)));
   }
 }
 
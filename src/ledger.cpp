@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "ledger.hpp"
+#include "utils.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+Ledger::Ledger(path t_path): m_path(move(t_path)) {
+  if (!load()) {
+    m_components.clear();
+  }
+}
+
+auto Ledger::is_up_to_date(const string_view t_component,
+                           const string_view t_sha256) const -> bool {
+  const lock_guard lock(m_mutex);
+  const auto iter{m_components.find(t_component)};
+  if (iter == m_components.cend() || iter->second.sha256 != t_sha256) {
+    return false;
+  }
+  for (const auto& f : iter->second.files) {
+    if (!check_file(f)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto Ledger::record(const string_view t_component, const string_view t_sha256,
+                    const vector<path>& t_files) -> bool {
+  Component component{string(t_sha256), {}};
+  const auto base_dir{m_path.parent_path()};
+  error_code err;
+
+  for (const auto& p : t_files) {
+    File file;
+    file.path = p.lexically_relative(base_dir);
+    file.size = file_size(p, err);
+    if (!err) {
+      file.mod_time = last_write_time(p, err).time_since_epoch().count();
+    }
+    if (!err) {
+      file.sha256 = Utils::calc_sha256(p);
+    }
+    if (err || file.path.empty() || file.sha256.empty()) {
+      forget(t_component);
+      return false;
+    }
+    component.files.push_back(move(file));
+  }
+
+  const lock_guard lock(m_mutex);
+  m_components.insert_or_assign(string(t_component), move(component));
+  return true;
+}
+
+void Ledger::forget(const string_view t_component) {
+  const lock_guard lock(m_mutex);
+  if (const auto iter{m_components.find(t_component)};
+      iter != m_components.cend()) {
+    m_components.erase(iter);
+  }
+}
+
+auto Ledger::is_recorded(const path& t_path) const -> bool {
+  const auto file_path{t_path.lexically_relative(m_path.parent_path())};
+  const lock_guard lock(m_mutex);
+  return any_of(m_components.cbegin(), m_components.cend(),
+      [&file_path] (const auto& c) {
+    const auto& files{c.second.files};
+    return any_of(files.cbegin(), files.cend(),
+        [&file_path] (const File& f) { return f.path == file_path; });
+  });
+}
+
+auto Ledger::get_files() const -> vector<path> {
+  vector<path> files;
+  const lock_guard lock(m_mutex);
+  for (const auto& c : m_components) {
+    for (const auto& f : c.second.files) {
+      files.push_back(f.path);
+    }
+  }
+  return files;
+}
+
+auto Ledger::find_duplicates() const -> vector<vector<path>> {
+  // Paths are sorted, so the first one of a group is always the same.
+  map<pair<uintmax_t, string_view>, set<path>> groups;
+  const lock_guard lock(m_mutex);
+  for (const auto& c : m_components) {
+    for (const auto& f : c.second.files) {
+      if (f.size != 0U && check_file(f)) {
+        groups[{f.size, f.sha256}].insert(f.path);
+      }
+    }
+  }
+
+  vector<vector<path>> duplicates;
+  for (const auto& g : groups) {
+    if (g.second.size() > 1U) {
+      duplicates.emplace_back(g.second.cbegin(), g.second.cend());
+    }
+  }
+  return duplicates;
+}
+
+void Ledger::merge(const Ledger& t_other) {
+  if (&t_other == this) {
+    return;
+  }
+  const scoped_lock lock(m_mutex, t_other.m_mutex);
+  for (const auto& c : t_other.m_components) {
+    m_components.insert_or_assign(c.first, c.second);
+  }
+}
+
+auto Ledger::refresh_metadata(const vector<path>& t_files) -> bool {
+  const auto base_dir{m_path.parent_path()};
+  error_code err;
+  const lock_guard lock(m_mutex);
+  for (auto& c : m_components) {
+    for (auto& f : c.second.files) {
+      if (!t_files.empty() &&
+          find(t_files.cbegin(), t_files.cend(), f.path) == t_files.cend()) {
+        continue;
+      }
+      const auto file_path{base_dir / f.path};
+      f.size = file_size(file_path, err);
+      if (!err) {
+        f.mod_time =
+            last_write_time(file_path, err).time_since_epoch().count();
+      }
+      if (err) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+auto Ledger::verify(const function<progress_callback_t>& t_callback) const
+    -> vector<Mismatch> {
+  // Pair of component name and file record.
+  vector<pair<const string*, const File*>> files;
+  uintmax_t total{};
+  const lock_guard lock(m_mutex);
+  for (const auto& [name, component] : m_components) {
+    for (const auto& f : component.files) {
+      files.emplace_back(&name, &f);
+      total += f.size;
+    }
+  }
+  // Start from the largest files, so threads finish at the same time.
+  sort(files.begin(), files.end(), [] (const auto& lhs, const auto& rhs) {
+    return lhs.second->size > rhs.second->size;
+  });
+
+  // Following variables are guarded by the mutex.
+  mutex result_mutex;
+  vector<Mismatch> mismatches;
+  uintmax_t verified{};
+  if (t_callback) {
+    t_callback(verified, total);
+  }
+
+  atomic_size_t next_index{};
+  const auto verify_files{[&] {
+    for (auto i{next_index++}; i < files.size(); i = next_index++) {
+      const auto& [component, file]{files[i]};
+      const auto file_path{m_path.parent_path() / file->path};
+      string reason;
+      if (error_code err; !is_regular_file(file_path, err)) {
+        reason = "doesn't exist";
+      } else if (Utils::calc_sha256(file_path) != file->sha256) {
+        reason = "checksum mismatch";
+      }
+
+      const lock_guard result_lock(result_mutex);
+      if (!reason.empty()) {
+        mismatches.push_back({*component, file_path, move(reason)});
+      }
+      verified += file->size;
+      if (t_callback) {
+        t_callback(verified, total);
+      }
+    }
+  }};
+
+  const auto threads_count{min<size_t>(
+      max(thread::hardware_concurrency(), 1U), max<size_t>(files.size(), 1U))};
+  vector<future<void>> results;
+  for (size_t t{}; t != threads_count; ++t) {
+    results.push_back(async(launch::async, verify_files));
+  }
+  for (auto& r : results) {
+    r.get();
+  }
+
+  sort(mismatches.begin(), mismatches.end(),
+       [] (const Mismatch& lhs, const Mismatch& rhs) {
+    return lhs.path < rhs.path;
+  });
+  return mismatches;
+}
+
+auto Ledger::save() const -> bool {
+  // Replace the file atomically, so it won't be left half-written.
+  auto tmp_path{m_path};
+  tmp_path += ".tmp";
+  {
+    const lock_guard lock(m_mutex);
+    ofstream ofs(tmp_path, ios::trunc);
+    for (const auto& [name, component] : m_components) {
+      ofs << name << ' ' << component.sha256 << ' ' <<
+             component.files.size() << '\n';
+      // Path is the last field, since it may contain spaces.
+      for (const auto& f : component.files) {
+        ofs << f.size << ' ' << f.mod_time << ' ' << f.sha256 << ' ' <<
+               f.path.string() << '\n';
+      }
+    }
+    if (!ofs) {
+      return false;
+    }
+  }
+  error_code err;
+  rename(tmp_path, m_path, err);
+  return !err;
+}
+
+// ---------------- +
+// Helper functions |
+// ---------------- +
+
+auto Ledger::load() -> bool {
+  ifstream ifs(m_path);
+  if (!ifs) {
+    // Nothing is installed yet.
+    return true;
+  }
+
+  string name;
+  Component component;
+  size_t files_count{};
+  while (ifs >> name >> component.sha256 >> files_count) {
+    component.files.resize(files_count);
+    for (auto& f : component.files) {
+      string file_path;
+      if (!(ifs >> f.size >> f.mod_time >> f.sha256) || ifs.get() != ' ' ||
+          !getline(ifs, file_path) || file_path.empty()) {
+        return false;
+      }
+      f.path = file_path;
+    }
+    m_components.insert_or_assign(move(name), move(component));
+    component = {};
+  }
+  return ifs.eof();
+}
+
+auto Ledger::check_file(const File& t_file) const -> bool {
+  const auto file_path{m_path.parent_path() / t_file.path};
+  error_code err;
+  const auto size{file_size(file_path, err)};
+  if (err || size != t_file.size) {
+    return false;
+  }
+  const auto mod_time{last_write_time(file_path, err)};
+  return !err && mod_time.time_since_epoch().count() == t_file.mod_time;
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "general/scope_guard.hpp"
+#include "local_zip.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+using Method = ZipDirectory::Method;
+
+LocalZip::LocalZip(path t_path): m_path(move(t_path)) {}
+
+auto LocalZip::open() -> bool {
+  try {
+    const int fd{open_fd()};
+    const ScopeGuard fd_guard([fd] { close(fd); });
+
+    struct stat st{};
+    if (fstat(fd, &st) == -1) {
+      return false;
+    }
+    m_size = static_cast<uint64_t>(st.st_size);
+
+    const auto tail_size{min<uint64_t>(m_size, ZipDirectory::MAX_TAIL_SIZE)};
+    const auto tail_offset{m_size - tail_size};
+    string tail(tail_size, '\0');
+    read(fd, tail_offset, tail.data(), tail.size());
+    const auto location{ZipDirectory::find_location(tail, tail_offset)};
+
+    if (location.offset + location.size > m_size) {
+      return false;
+    }
+    string directory(location.size, '\0');
+    read(fd, location.offset, directory.data(), directory.size());
+    m_directory = ZipDirectory(directory);
+    m_location = location;
+  } catch (const exception&) {
+    return false;
+  }
+  return true;
+}
+
+void LocalZip::extract(const ZipDirectory::Entry& t_entry,
+                       const path& t_output_path) const {
+  const int fd{open_fd()};
+  const ScopeGuard fd_guard([fd] { close(fd); });
+  extract(fd, t_entry, t_output_path);
+}
+
+void LocalZip::read_entry(const ZipDirectory::Entry& t_entry,
+                          const function<read_callback_t>& t_callback) const {
+  const int fd{open_fd()};
+  const ScopeGuard fd_guard([fd] { close(fd); });
+  const auto data_offset{get_data_offset(fd, t_entry)};
+
+  if (t_entry.method == Method::DEFLATED) {
+    inflate(fd, data_offset, t_entry, t_callback);
+    return;
+  }
+  if (t_entry.method != Method::STORED ||
+      t_entry.compressed_size != t_entry.uncompressed_size) {
+    throw runtime_error("unsupported compression method");
+  }
+
+  vector<char> buf(static_cast<size_t>(
+      min<uint64_t>(t_entry.compressed_size, BUFFER_SIZE)));
+  uLong crc{crc32(0UL, Z_NULL, 0U)};
+  for (uint64_t done{}; done != t_entry.compressed_size;) {
+    const auto size{min<uint64_t>(t_entry.compressed_size - done, buf.size())};
+    read(fd, data_offset + done, buf.data(), size);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(buf.data()),
+                static_cast<uInt>(size));
+    t_callback(buf.data(), size);
+    done += size;
+  }
+  if (crc != t_entry.crc32) {
+    throw runtime_error("CRC-32 mismatch");
+  }
+}
+
+void LocalZip::read_range(const uint64_t t_offset,
+                          void* const t_data, const size_t t_size) const {
+  if (t_offset + t_size > m_size) {
+    throw runtime_error("range is out of archive");
+  }
+  const int fd{open_fd()};
+  const ScopeGuard fd_guard([fd] { close(fd); });
+  read(fd, t_offset, t_data, t_size);
+}
+
+void LocalZip::extract_all(const vector<Target>& t_targets,
+    const unsigned t_threads_count,
+    const function<extract_callback_t>& t_callback) const {
+  // Following variables are guarded by the mutex.
+  mutex callback_mutex;
+  exception_ptr error;
+
+  atomic_size_t next_index{};
+  const auto extract_targets{[&] {
+    try {
+      const int fd{open_fd()};
+      const ScopeGuard fd_guard([fd] { close(fd); });
+
+      for (auto i{next_index++}; i < t_targets.size(); i = next_index++) {
+        const auto& [entry, output_path]{t_targets[i]};
+        extract(fd, *entry, output_path);
+        if (t_callback) {
+          const lock_guard lock(callback_mutex);
+          t_callback(*entry);
+        }
+      }
+    } catch (...) {
+      const lock_guard lock(callback_mutex);
+      if (!error) {
+        error = current_exception();
+      }
+      // Stop other threads.
+      next_index = t_targets.size();
+    }
+  }};
+
+  const auto threads_count{min<size_t>(
+      t_threads_count == 0U ? max(thread::hardware_concurrency(), 1U) :
+      t_threads_count, max<size_t>(t_targets.size(), 1U))};
+  vector<future<void>> results;
+  for (size_t t{}; t != threads_count; ++t) {
+    results.push_back(async(launch::async, extract_targets));
+  }
+  for (auto& r : results) {
+    r.get();
+  }
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+auto LocalZip::get_data_offset(const ZipDirectory::Entry& t_entry) const
+    -> uint64_t {
+  const int fd{open_fd()};
+  const ScopeGuard fd_guard([fd] { close(fd); });
+  return get_data_offset(fd, t_entry);
+}
+
+auto LocalZip::open_fd() const -> int {
+  const int fd{::open(m_path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd == -1) {
+    throw runtime_error("failed to open archive");
+  }
+  return fd;
+}
+
+auto LocalZip::get_data_offset(const int t_fd,
+    const ZipDirectory::Entry& t_entry) const -> uint64_t {
+  const auto header_offset{t_entry.local_header_offset};
+  if (header_offset + ZipDirectory::LOCAL_HEADER_SIZE > m_size) {
+    throw runtime_error("local header is out of range");
+  }
+  string header(ZipDirectory::LOCAL_HEADER_SIZE, '\0');
+  read(t_fd, header_offset, header.data(), header.size());
+
+  const auto data_offset{
+      header_offset + ZipDirectory::get_local_header_size(header)};
+  if (data_offset + t_entry.compressed_size > m_size) {
+    throw runtime_error("data is out of range");
+  }
+  return data_offset;
+}
+
+void LocalZip::extract(const int t_fd, const ZipDirectory::Entry& t_entry,
+                       const path& t_output_path) const {
+  const auto data_offset{get_data_offset(t_fd, t_entry)};
+  const bool is_deflated{t_entry.method == Method::DEFLATED};
+  if (!is_deflated && (t_entry.method != Method::STORED ||
+      t_entry.compressed_size != t_entry.uncompressed_size)) {
+    throw runtime_error("unsupported compression method");
+  }
+
+  if (unlink(t_output_path.c_str()) == -1 && errno != ENOENT) {
+    throw runtime_error("failed to replace output file \"" +
+                        t_output_path.string() + '"');
+  }
+  const int out_fd{::open(t_output_path.c_str(),
+      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)};
+  if (out_fd == -1) {
+    throw runtime_error("failed to open output file \"" +
+                        t_output_path.string() + '"');
+  }
+  const ScopeGuard out_fd_guard([out_fd] { close(out_fd); });
+
+  if (is_deflated) {
+    inflate(t_fd, data_offset, t_entry,
+            [out_fd] (const char* data, const size_t size) {
+      write(out_fd, data, size);
+    });
+  } else {
+    copy(t_fd, data_offset, out_fd, t_entry.compressed_size);
+  }
+}
+
+void LocalZip::copy(const int t_in_fd, const uint64_t t_offset,
+                    const int t_out_fd, const uint64_t t_size) {
+  auto offset{static_cast<off64_t>(t_offset)};
+  uint64_t copied{};
+
+  while (copied != t_size) {
+    const auto result{copy_file_range(t_in_fd, &offset, t_out_fd, nullptr,
+                      static_cast<size_t>(t_size - copied), 0U)};
+    if (result > 0) {
+      copied += static_cast<uint64_t>(result);
+      continue;
+    }
+    if (result == 0) {
+      throw runtime_error("data is truncated");
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    // Not supported by the kernel or between these file systems.
+    if (errno != ENOSYS && errno != EXDEV &&
+        errno != EINVAL && errno != EOPNOTSUPP) {
+      throw runtime_error("failed to copy data");
+    }
+
+    vector<char> buf(static_cast<size_t>(
+        min<uint64_t>(t_size - copied, BUFFER_SIZE)));
+    while (copied != t_size) {
+      const auto size{min<uint64_t>(t_size - copied, buf.size())};
+      read(t_in_fd, t_offset + copied, buf.data(), size);
+      write(t_out_fd, buf.data(), size);
+      copied += size;
+    }
+  }
+}
+
+void LocalZip::inflate(const int t_in_fd, const uint64_t t_offset,
+    const ZipDirectory::Entry& t_entry,
+    const function<read_callback_t>& t_callback) {
+  z_stream stream{};
+  // Negative window bits mean raw deflate data without zlib header.
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    throw runtime_error("failed to initialize decompressor");
+  }
+  const ScopeGuard stream_guard([&stream] { inflateEnd(&stream); });
+
+  vector<unsigned char>
+      in_buf(static_cast<size_t>(min<uint64_t>(
+             max<uint64_t>(t_entry.compressed_size, 1U), BUFFER_SIZE))),
+      out_buf(BUFFER_SIZE);
+  uLong crc{crc32(0UL, Z_NULL, 0U)};
+  uint64_t
+      read_size{},
+      written{};
+
+  for (int status{Z_OK}; status != Z_STREAM_END;) {
+    if (stream.avail_in == 0U) {
+      const auto size{min<uint64_t>(
+          t_entry.compressed_size - read_size, in_buf.size())};
+      if (size == 0U) {
+        throw runtime_error("data is truncated");
+      }
+      read(t_in_fd, t_offset + read_size, in_buf.data(), size);
+      read_size += size;
+      stream.next_in = in_buf.data();
+      stream.avail_in = static_cast<uInt>(size);
+    }
+
+    stream.next_out = out_buf.data();
+    stream.avail_out = static_cast<uInt>(out_buf.size());
+    status = ::inflate(&stream, Z_NO_FLUSH);
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+      throw runtime_error("data is corrupted");
+    }
+
+    const auto size{out_buf.size() - stream.avail_out};
+    crc = crc32(crc, out_buf.data(), static_cast<uInt>(size));
+    t_callback(reinterpret_cast<const char*>(out_buf.data()), size);
+    written += size;
+  }
+
+  if (written != t_entry.uncompressed_size) {
+    throw runtime_error("data is truncated");
+  }
+  if (crc != t_entry.crc32) {
+    throw runtime_error("CRC-32 mismatch");
+  }
+}
+
+void LocalZip::read(const int t_fd, const uint64_t t_offset,
+                    void* const t_data, const size_t t_size) {
+  for (size_t done{}; done != t_size;) {
+    const auto result{pread(t_fd, static_cast<char*>(t_data) + done,
+        t_size - done, static_cast<off_t>(t_offset + done))};
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      throw runtime_error("failed to read archive");
+    }
+    done += static_cast<size_t>(result);
+  }
+}
+
+void LocalZip::write(const int t_fd, const void* const t_data,
+                     const size_t t_size) {
+  for (size_t done{}; done != t_size;) {
+    const auto result{::write(t_fd,
+        static_cast<const char*>(t_data) + done, t_size - done)};
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    if (result == -1) {
+      throw runtime_error("failed to write data");
+    }
+    done += static_cast<size_t>(result);
+  }
+}
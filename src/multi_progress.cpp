@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <fcli/text.hpp>
+#include "multi_progress.hpp"
+
+using namespace std;
+using namespace chrono;
+using namespace fcli;
+
+MultiProgress::Bar::Bar(MultiProgress& t_parent,
+    const string_view t_text, const bool t_determined):
+    m_parent(t_parent), m_text(t_text), m_determined(t_determined) {}
+
+void MultiProgress::Bar::show() {
+  const lock_guard lock(m_parent.m_mutex);
+  if (!m_visible) {
+    m_visible = true;
+    m_parent.render(true);
+  }
+}
+
+void MultiProgress::Bar::hide() {
+  const lock_guard lock(m_parent.m_mutex);
+  if (m_visible) {
+    m_visible = false;
+    m_parent.render(true);
+  }
+}
+
+void MultiProgress::Bar::finish(const bool t_success, const string_view t_msg) {
+  const lock_guard lock(m_parent.m_mutex);
+  m_visible = false;
+  m_parent.m_finished_msgs.push_back(t_success ?
+      Text::format_copy("<b>✓<r> ") + string(t_msg) :
+      Text::format_message(Text::Message::ERROR, t_msg));
+  m_parent.render(true);
+}
+
+auto MultiProgress::Bar::operator=(const string_view t_text) -> Bar& {
+  const lock_guard lock(m_parent.m_mutex);
+  m_text = t_text;
+  m_parent.render();
+  return *this;
+}
+
+auto MultiProgress::Bar::operator=(const double t_percents) -> Bar& {
+  constexpr double MAX_PERCENTS{100.0};
+  const lock_guard lock(m_parent.m_mutex);
+  m_percents = clamp(t_percents, 0.0, MAX_PERCENTS);
+  m_parent.render();
+  return *this;
+}
+
+void MultiProgress::Bar::set_determined(const bool t_determined) {
+  const lock_guard lock(m_parent.m_mutex);
+  m_determined = t_determined;
+  m_parent.render(true);
+}
+
+auto MultiProgress::Bar::is_determined() const -> bool {
+  const lock_guard lock(m_parent.m_mutex);
+  return m_determined;
+}
+
+auto MultiProgress::Bar::get_text() const -> string {
+  const lock_guard lock(m_parent.m_mutex);
+  return m_text;
+}
+
+auto MultiProgress::Bar::get_percents() const -> double {
+  const lock_guard lock(m_parent.m_mutex);
+  return m_percents;
+}
+
+MultiProgress::MultiProgress(const unsigned short t_width,
+    const bool t_interactive, ostream& t_os):
+    m_width(t_width), m_interactive(t_interactive), m_os(t_os) {}
+
+MultiProgress::~MultiProgress() {
+  const lock_guard lock(m_mutex);
+  for (auto& b : m_bars) {
+    b.m_visible = false;
+  }
+  // Don't let exceptions escape the destructor.
+  try {
+    render(true);
+  } catch (...) {}
+}
+
+auto MultiProgress::add(const string_view t_text,
+                        const bool t_determined) -> Bar& {
+  const lock_guard lock(m_mutex);
+  return m_bars.emplace_back(*this, t_text, t_determined);
+}
+
+void MultiProgress::render(const bool t_force) {
+  if (!m_interactive) {
+    for (const auto& m : m_finished_msgs) {
+      m_os << m << '\n';
+    }
+    if (!m_finished_msgs.empty()) {
+      m_finished_msgs.clear();
+      m_os << flush;
+    }
+    return;
+  }
+
+  const auto now{steady_clock::now()};
+  if (!t_force && now - m_last_render < REFRESH_INTERVAL) {
+    return;
+  }
+  m_last_render = now;
+  ++m_frame;
+
+  clear_active_lines();
+  for (const auto& m : m_finished_msgs) {
+    m_os << m << '\n';
+  }
+  m_finished_msgs.clear();
+
+  for (const auto& b : m_bars) {
+    if (b.m_visible) {
+      m_os << render_bar(b) << '\n';
+      ++m_active_lines;
+    }
+  }
+  m_os << flush;
+}
+
+auto MultiProgress::render_bar(const Bar& t_bar) const -> string {
+  constexpr size_t
+      MARKER_WIDTH{3U},
+      PERCENTS_WIDTH{3U};
+  const auto bar_width{max<size_t>(MIN_BAR_WIDTH, m_width / 3U)};
+
+  string line(1U, '[');
+  if (t_bar.m_determined) {
+    const auto filled{static_cast<size_t>(lround(
+        t_bar.m_percents / 100.0 * static_cast<double>(bar_width)))};
+    line += string(filled, '#') + string(bar_width - filled, ' ') + "] ";
+
+    const auto percents{to_string(lround(t_bar.m_percents))};
+    line += string(PERCENTS_WIDTH - percents.length(), ' ') + percents + "% ";
+  } else {
+    // Marker moves back and forth from frame to frame.
+    const auto last_pos{bar_width - MARKER_WIDTH};
+    auto pos{m_frame % (last_pos * 2U)};
+    if (pos > last_pos) {
+      pos = last_pos * 2U - pos;
+    }
+    line += string(pos, ' ') + string(MARKER_WIDTH, '#') +
+            string(last_pos - pos, ' ') + "] ";
+  }
+
+  // Don't let a line to be wrapped, otherwise the cursor
+  // won't be moved to the first line on the next redraw.
+  if (line.length() < m_width) {
+    line += t_bar.m_text.substr(0U, m_width - line.length());
+  }
+  return line;
+}
+
+void MultiProgress::clear_active_lines() {
+  if (m_active_lines == 0U) {
+    return;
+  }
+  // Move the cursor up and clear everything below it.
+  m_os << "\033[" << m_active_lines << "A\r\033[J";
+  m_active_lines = 0U;
+}
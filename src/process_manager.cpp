@@ -0,0 +1,405 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "general/scope_guard.hpp"
+#include "process_manager.hpp"
+
+// Changing working directory of a spawned process is supported since 2.29.
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+  #define HAS_ADDCHDIR
+#endif
+
+using namespace std;
+using namespace chrono;
+
+namespace {
+  // Epoll data contains index of a process and a channel.
+  constexpr uint64_t CHANNEL_BITS{2U};
+
+  // Returns -1 if a pollable descriptor isn't supported by the kernel.
+  auto open_pidfd([[maybe_unused]] const pid_t t_pid) -> int {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, t_pid, 0U));
+#else
+    return -1;
+#endif
+  }
+
+  void set_non_blocking(const int t_fd) {
+    const auto flags{fcntl(t_fd, F_GETFL)};
+    if (flags == -1 || fcntl(t_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      throw runtime_error("failed to make a descriptor non-blocking");
+    }
+  }
+}
+
+ProcessManager::ProcessManager():
+    m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)), m_read_buffer(READ_BUFFER_SIZE) {
+  if (m_epoll_fd == -1) {
+    throw runtime_error("failed to create an epoll instance");
+  }
+}
+
+ProcessManager::~ProcessManager() {
+  for (auto& p : m_processes) {
+    if (!p.reaped) {
+      kill(p.pid, SIGKILL);
+      reap(p);
+    }
+    for (auto& fd : p.fds) {
+      close_fd(fd);
+    }
+  }
+  close(m_epoll_fd);
+}
+
+auto ProcessManager::start(Command t_command) -> size_t {
+  if (t_command.args.empty()) {
+    throw runtime_error("command is empty");
+  }
+
+  // Pairs of parent's and child's ends. Socket is used for the input, since
+  // writing to it doesn't raise SIGPIPE if a process has exited.
+  array<int, 2U>
+      in_fds{-1, -1},
+      out_fds{-1, -1},
+      err_fds{-1, -1};
+  const ScopeGuard fds_guard([&] {
+    for (auto* const fds : {&in_fds, &out_fds, &err_fds}) {
+      close_fd((*fds)[0]);
+      close_fd((*fds)[1]);
+    }
+  });
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, in_fds.data()) == -1 ||
+      pipe2(out_fds.data(), O_CLOEXEC) == -1 ||
+      pipe2(err_fds.data(), O_CLOEXEC) == -1) {
+    throw runtime_error("failed to create pipes");
+  }
+  const auto pid{spawn(t_command, {in_fds[1], out_fds[1], err_fds[1]})};
+
+  Process process;
+  process.pid = pid;
+  process.fds = {in_fds[0], out_fds[0], err_fds[0], open_pidfd(pid)};
+  if (t_command.timeout != milliseconds::zero()) {
+    process.deadline = steady_clock::now() + t_command.timeout;
+  }
+  process.command = move(t_command);
+  in_fds[0] = out_fds[0] = err_fds[0] = -1;
+
+  const auto index{m_processes.size()};
+  m_processes.push_back(move(process));
+  auto& p{m_processes.back()};
+  for (size_t c{}; c != size<Channel>(); ++c) {
+    if (p.fds.at(c) != -1 && static_cast<Channel>(c) != Channel::PID) {
+      set_non_blocking(p.fds.at(c));
+    }
+  }
+
+  if (p.command.input.empty()) {
+    close_channel(p, Channel::IN);
+  } else {
+    watch(index, Channel::IN, EPOLLOUT);
+  }
+  watch(index, Channel::OUT, EPOLLIN);
+  watch(index, Channel::ERR, EPOLLIN);
+  if (p.fds.at(static_cast<size_t>(Channel::PID)) != -1) {
+    watch(index, Channel::PID, EPOLLIN);
+  }
+  return index;
+}
+
+auto ProcessManager::wait() -> vector<Result> {
+  array<epoll_event, MAX_EVENTS> events{};
+
+  while (!all_of(m_processes.cbegin(), m_processes.cend(), is_finished)) {
+    // Sleep until the nearest deadline.
+    int timeout{-1};
+    const auto now{steady_clock::now()};
+    for (const auto& p : m_processes) {
+      if (p.reaped || p.result.timed_out ||
+          p.command.timeout == milliseconds::zero()) {
+        continue;
+      }
+      const auto left{duration_cast<milliseconds>(p.deadline - now).count()};
+      const auto left_ms{static_cast<int>(max<decltype(left)>(left + 1, 0))};
+      timeout = timeout == -1 ? left_ms : min(timeout, left_ms);
+    }
+
+    const auto count{epoll_wait(m_epoll_fd, events.data(),
+                                static_cast<int>(events.size()), timeout)};
+    if (count == -1 && errno != EINTR) {
+      throw runtime_error("failed to wait for events");
+    }
+
+    for (int i{}; i < count; ++i) {
+      const auto data{events.at(static_cast<size_t>(i)).data.u64};
+      auto& process{m_processes.at(data >> CHANNEL_BITS)};
+      const auto channel{static_cast<Channel>(
+          data & ((1U << CHANNEL_BITS) - 1U))};
+
+      switch (channel) {
+        case Channel::IN:
+          write_input(process);
+          break;
+        case Channel::OUT:
+        case Channel::ERR:
+          read_output(process, channel);
+          break;
+        default:
+          reap(process);
+          close_channel(process, Channel::PID);
+      }
+    }
+
+    for (auto& p : m_processes) {
+      if (!p.reaped && !p.result.timed_out &&
+          p.command.timeout != milliseconds::zero() &&
+          steady_clock::now() >= p.deadline) {
+        kill(p.pid, SIGKILL);
+        p.result.timed_out = true;
+      }
+      // Without a pollable descriptor closing of
+      // the outputs is the only sign of exit.
+      if (!p.reaped && p.fds.at(static_cast<size_t>(Channel::PID)) == -1 &&
+          p.fds.at(static_cast<size_t>(Channel::OUT)) == -1 &&
+          p.fds.at(static_cast<size_t>(Channel::ERR)) == -1) {
+        reap(p);
+      }
+    }
+  }
+
+  vector<Result> results;
+  for (const auto& p : m_processes) {
+    results.push_back(p.result);
+  }
+  return results;
+}
+
+auto ProcessManager::spawn(const Command& t_command,
+                           const array<int, 3U>& t_std_fds) -> pid_t {
+  vector<string> args;
+#ifndef HAS_ADDCHDIR
+  if (!t_command.work_dir.empty()) {
+    // Let a shell change the directory, since the current one is shared by
+    // all threads of the process.
+    args = {"/bin/sh", "-c", "cd -- \"$0\" && exec \"$@\"",
+            t_command.work_dir.string()};
+  }
+#endif
+  args.insert(args.cend(), t_command.args.cbegin(), t_command.args.cend());
+
+  vector<char*> argv;
+  for (auto& a : args) {
+    argv.push_back(a.data());
+  }
+  argv.push_back(nullptr);
+
+  // Passed variables replace the inherited ones.
+  vector<string> env;
+  for (char** var{environ}; *var != nullptr; ++var) {
+    const string_view var_str(*var);
+    const auto name{var_str.substr(0U, var_str.find('='))};
+    if (t_command.env.find(name) == t_command.env.cend()) {
+      env.emplace_back(var_str);
+    }
+  }
+  for (const auto& [name, val] : t_command.env) {
+    env.push_back(name + '=' + val);
+  }
+  vector<char*> envp;
+  for (auto& v : env) {
+    envp.push_back(v.data());
+  }
+  envp.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions{};
+  if (posix_spawn_file_actions_init(&actions) != 0) {
+    throw runtime_error("failed to initialize spawn actions");
+  }
+  const ScopeGuard actions_guard([&actions] {
+    posix_spawn_file_actions_destroy(&actions);
+  });
+  posix_spawnattr_t attrs{};
+  if (posix_spawnattr_init(&attrs) != 0) {
+    throw runtime_error("failed to initialize spawn attributes");
+  }
+  const ScopeGuard attrs_guard([&attrs] { posix_spawnattr_destroy(&attrs); });
+
+  // Other descriptors are closed on execution.
+  const array std_fds{STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  int err{};
+  for (size_t i{}; i != std_fds.size() && err == 0; ++i) {
+    err = posix_spawn_file_actions_adddup2(
+        &actions, t_std_fds.at(i), std_fds.at(i));
+  }
+#ifdef HAS_ADDCHDIR
+  if (err == 0 && !t_command.work_dir.empty()) {
+    err = posix_spawn_file_actions_addchdir_np(
+        &actions, t_command.work_dir.c_str());
+  }
+#endif
+
+  // Don't pass signals blocked by the calling thread to a process.
+  sigset_t signals{};
+  sigemptyset(&signals);
+  if (err == 0) {
+    err = posix_spawnattr_setsigmask(&attrs, &signals);
+  }
+  if (err == 0) {
+    err = posix_spawnattr_setflags(&attrs, POSIX_SPAWN_SETSIGMASK);
+  }
+  if (err != 0) {
+    throw runtime_error("failed to set up spawning");
+  }
+
+  // The calling process is suspended until a process calls exec (or fails
+  // to), but its memory isn't copied.
+  pid_t pid{};
+  err = posix_spawnp(&pid, argv.front(), &actions, &attrs,
+                     argv.data(), envp.data());
+  if (err != 0) {
+    throw runtime_error("failed to start a process: " +
+                        system_category().message(err));
+  }
+  return pid;
+}
+
+void ProcessManager::watch(const size_t t_index, const Channel t_channel,
+                           const uint32_t t_events) {
+  epoll_event event{};
+  event.events = t_events;
+  event.data.u64 = (static_cast<uint64_t>(t_index) << CHANNEL_BITS) |
+                   static_cast<uint64_t>(t_channel);
+  const auto fd{m_processes.at(t_index).fds.at(static_cast<size_t>(t_channel))};
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    throw runtime_error("failed to watch a descriptor");
+  }
+}
+
+void ProcessManager::close_channel(Process& t_process,
+                                   const Channel t_channel) {
+  // Descriptor is removed from the epoll set on closing.
+  close_fd(t_process.fds.at(static_cast<size_t>(t_channel)));
+}
+
+void ProcessManager::write_input(Process& t_process) {
+  const auto& input{t_process.command.input};
+  while (t_process.written_input != input.size()) {
+    const auto result{send(t_process.fds.at(static_cast<size_t>(Channel::IN)),
+        input.data() + t_process.written_input,
+        input.size() - t_process.written_input, MSG_NOSIGNAL)};
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    // Process doesn't read the input anymore.
+    if (result == -1) {
+      break;
+    }
+    t_process.written_input += static_cast<size_t>(result);
+  }
+  close_channel(t_process, Channel::IN);
+}
+
+void ProcessManager::read_output(Process& t_process, const Channel t_channel) {
+  const bool is_out{t_channel == Channel::OUT};
+  auto& line{is_out ? t_process.out_line : t_process.err_line};
+  const auto& callback{is_out ? t_process.command.out_callback :
+                                t_process.command.err_callback};
+  const auto fd{t_process.fds.at(static_cast<size_t>(t_channel))};
+
+  while (true) {
+    const auto result{read(fd, m_read_buffer.data(), m_read_buffer.size())};
+    if (result > 0) {
+      if (callback) {
+        line.append(m_read_buffer.data(), static_cast<size_t>(result));
+        split_lines(line, callback, false);
+      }
+      continue;
+    }
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    // End of the output or an error.
+    break;
+  }
+
+  if (callback) {
+    split_lines(line, callback, true);
+  }
+  close_channel(t_process, t_channel);
+}
+
+void ProcessManager::reap(Process& t_process) {
+  int status{};
+  pid_t result{};
+  do {
+    result = wait4(t_process.pid, &status, 0, &t_process.result.usage);
+  } while (result == -1 && errno == EINTR);
+
+  t_process.reaped = true;
+  if (result == -1) {
+    t_process.result.exit_code = EXIT_FAILURE;
+  } else if (WIFSIGNALED(status)) {
+    // Shells report such processes the same way.
+    constexpr int SIGNAL_EXIT_CODE_BASE{128};
+    t_process.result.exit_code = SIGNAL_EXIT_CODE_BASE + WTERMSIG(status);
+  } else {
+    t_process.result.exit_code = WEXITSTATUS(status);
+  }
+}
+
+void ProcessManager::split_lines(string& t_buffer,
+    const function<line_callback_t>& t_callback, const bool t_flush) {
+  size_t begin{};
+  for (auto end{t_buffer.find('\n')}; end != string::npos;
+       end = t_buffer.find('\n', begin)) {
+    t_callback(string_view(t_buffer).substr(begin, end - begin));
+    begin = end + 1U;
+  }
+  // Erase processed lines at once, so it takes linear time.
+  t_buffer.erase(0U, begin);
+
+  if (t_flush && !t_buffer.empty()) {
+    t_callback(t_buffer);
+    t_buffer.clear();
+  }
+}
+
+auto ProcessManager::is_finished(const Process& t_process) -> bool {
+  return t_process.reaped &&
+         t_process.fds.at(static_cast<size_t>(Channel::OUT)) == -1 &&
+         t_process.fds.at(static_cast<size_t>(Channel::ERR)) == -1;
+}
+
+void ProcessManager::close_fd(int& t_fd) {
+  if (t_fd != -1) {
+    close(t_fd);
+    t_fd = -1;
+  }
+}
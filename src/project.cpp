@@ -4,9 +4,12 @@
  * Licensed under the Apache License, Version 2.0
  */
 
+#include <algorithm>
+#include <array>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <regex>
 #include <set>
@@ -23,6 +26,7 @@
 #include "config.hpp"
 #include "project.hpp"
 #include "utils.hpp"
+#include "zip_writer.hpp"
 
 using namespace std;
 using namespace filesystem;
@@ -88,11 +92,27 @@ auto Project::build(const Apm& t_apm, const bool t_is_debug_build,
       result != EXIT_SUCCESS) {
     return result;
   }
-  if (const auto result{check_sdk(t_apm, fail_with_msg)};
+  // API of the SDK files, which the project will be built with.
+  unsigned short sdk_api{};
+  if (const auto result{check_sdk(t_apm, fail_with_msg, sdk_api)};
       result != EXIT_SUCCESS) {
     return result;
   }
 
+  if (!t_output_apk_copy.empty()) {
+    progress = "Copying the APK file";
+    const auto config{t_is_debug_build ?
+                      BuildConfig::DEBUG : BuildConfig::RELEASE};
+    const auto apk_path{get_apk_path(ApkType::FINAL, config, false)};
+    if (error_code err; !is_regular_file(apk_path, err)) {
+      return fail_with_msg("There is no APK file to copy: \"" +
+                           apk_path.string() + "\" hasn't been built");
+    }
+    if (!Utils::copy_file(apk_path, t_output_apk_copy)) {
+      return fail_with_msg("Couldn't copy the APK file to \"" +
+                           t_output_apk_copy.string() + '"');
+    }
+  }
   return EXIT_SUCCESS;
 }
 
@@ -114,26 +134,77 @@ auto Project::check_output_apk(
 }
 
 auto Project::check_sdk(const Apm& t_apm,
-    const function<fail_func_t>& t_fail_func) const -> int {
+    const function<fail_func_t>& t_fail_func, unsigned short& t_api) const
+    -> int {
   const auto min_sdk_node{m_config_root.child("min-sdk")};
   if (!min_sdk_node) {
     return t_fail_func("Project configuration doesn't define <u>min-sdk<r>");
   }
 
   const auto min_sdk_text{min_sdk_node.text()};
-  // Existence of the SDK value already checked by Apm::run.
-  const auto installed_sdk_api
-      {*t_apm.get_config()->get<unsigned short>(Config::Key::SDK)};
+  // Existence of an installed API already checked by Apm::run.
+  const auto apis{t_apm.get_sdk()->get_installed_apis()};
+  // The closest API to the one, which a project was created for.
+  const auto min_sdk{min<unsigned>(
+      min_sdk_text.as_uint(), numeric_limits<unsigned short>::max())};
+  if (const auto iter{apis.lower_bound(static_cast<unsigned short>(min_sdk))};
+      iter != apis.cend()) {
+    t_api = *iter;
+    return check_sdk_files(*t_apm.get_sdk(), t_api, t_fail_func);
+  }
+
+  string apis_str;
+  for (const auto a : apis) {
+    apis_str += (apis_str.empty() ? "" : ", ") + to_string(a);
+  }
+  return t_fail_func("At least SDK <b>"s + min_sdk_text.get() +
+         "<r> is required to build this project "
+         "(installed API versions: <b>" + apis_str + "<r>)");
+}
 
-  if (min_sdk_text.as_uint() > installed_sdk_api) {
-    return t_fail_func("At least SDK <b>"s + min_sdk_text.get() +
-           "<r> is required to build this project "
-           "(API version of the installed SDK is <b>" +
-           to_string(installed_sdk_api) + "<r>)");
+auto Project::check_sdk_files(const Sdk& t_sdk, const unsigned short t_api,
+    const function<fail_func_t>& t_fail_func) -> int {
+  // Files are resolved for the chosen API, not for the selected one.
+  try {
+    for (size_t t{}; t != size<Sdk::Tool>(); ++t) {
+      static_cast<void>(t_sdk.get_tool_path(
+          static_cast<Sdk::Tool>(t), true, t_api));
+    }
+    for (size_t j{}; j != size<Sdk::Jar>(); ++j) {
+      static_cast<void>(t_sdk.get_jar_path(
+          static_cast<Sdk::Jar>(j), true, t_api));
+    }
+  } catch (const runtime_error& e) {
+    return t_fail_func("Files of SDK <b>" + to_string(t_api) +
+                       "<r> are incomplete: " + e.what());
   }
   return EXIT_SUCCESS;
 }
 
+void Project::write_apk_entries(ZipWriter& t_writer,
+                                vector<ApkEntry> t_entries) {
+  // In order of reading by Android.
+  constexpr array<string_view, 3U>
+      STARTUP_ENTRIES{"AndroidManifest.xml", "resources.arsc", "classes.dex"};
+  const auto get_rank{[&STARTUP_ENTRIES] (const string_view name) {
+    return find(STARTUP_ENTRIES.cbegin(), STARTUP_ENTRIES.cend(), name) -
+           STARTUP_ENTRIES.cbegin();
+  }};
+  // Other entries keep their order.
+  stable_sort(t_entries.begin(), t_entries.end(),
+      [&get_rank] (const auto& lhs, const auto& rhs) {
+        return get_rank(lhs.first) < get_rank(rhs.first);
+      });
+
+  constexpr string_view LIBS_DIR_PREFIX("lib/");
+  for (const auto& [name, file] : t_entries) {
+    const bool is_mapped{name == "resources.arsc" ||
+        (name.compare(0U, LIBS_DIR_PREFIX.size(), LIBS_DIR_PREFIX) == 0 &&
+         path(name).extension() == ".so")};
+    t_writer.add(name, file, is_mapped ? PAGE_ALIGNMENT : 0U);
+  }
+}
+
 // ------- +
 // Getters |
 // ------- +
@@ -142,7 +213,8 @@ auto Project::get_app_dir(const AppDir t_dir,
     const bool t_must_exist) const -> path {
   path root_dir("app");
   const EnumArray<AppDir, path>
-      dirs{root_dir, root_dir / "assets", root_dir / "res", root_dir / "java"};
+      dirs{root_dir, root_dir / "assets", root_dir / "res",
+           root_dir / "java", root_dir / "jniLibs"};
 
   const auto
       relative_path{dirs.get(t_dir)},
@@ -245,6 +317,7 @@ auto Project::create(const path& t_dir, const unsigned short t_sdk_api,
   try {
     expand_variables(directory_entry(t_dir), package, t_sdk_api, min_api);
     set_app_name(t_dir / "app" / "res" / "values" / "strings.xml", app_name);
+    disable_native_libs_extraction(t_dir / "app" / "AndroidManifest.xml");
     relocate_class(
         directory_entry(t_dir / "app" / "java"), "MainActivity.java", package);
   } catch (const exception& e) {
@@ -504,6 +577,39 @@ void Project::set_app_name(const path& t_strings_xml,
   }
 }
 
+void Project::disable_native_libs_extraction(const path& t_manifest_xml) {
+  xml_document manifest;
+  const auto parse_result{manifest.load_file(t_manifest_xml.c_str())};
+  if (!parse_result) {
+    throw runtime_error("failed to parse XML file \"" +
+                        t_manifest_xml.string() + "\" (" +
+                        parse_result.description() + ')');
+  }
+
+  auto application{manifest.child("manifest").child("application")};
+  if (!application) {
+    throw runtime_error(R"(failed to find the "application" element in ")" +
+                        t_manifest_xml.string() + '"');
+  }
+  constexpr auto ATTR_NAME{"android:extractNativeLibs"};
+  auto attr{application.attribute(ATTR_NAME)};
+  if (!attr) {
+    attr = application.append_attribute(ATTR_NAME);
+  }
+  attr = false;
+
+  const string indent(4U, ' ');
+  auto decl{manifest.prepend_child(node_declaration)};
+  decl.append_attribute("version") = "1.0";
+  decl.append_attribute("encoding") = "UTF-8";
+
+  if (!manifest.save_file(t_manifest_xml.c_str(), indent.c_str(),
+                          format_default, encoding_utf8)) {
+    throw runtime_error(
+          "failed to save XML file \"" + t_manifest_xml.string() + '"');
+  }
+}
+
 void Project::relocate_class(const directory_entry& t_root_dir,
                              const path& t_file, const string_view t_package) {
   auto dest_path{t_root_dir.path()};
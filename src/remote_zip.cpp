@@ -0,0 +1,215 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <cpr/callback.h>
+#include <cpr/status_codes.h>
+#include <zlib.h>
+
+#include "general/scope_guard.hpp"
+#include "remote_zip.hpp"
+
+using namespace std;
+using namespace cpr;
+
+using Method = ZipDirectory::Method;
+
+RemoteZip::RemoteZip(HttpClient t_client, Url t_url):
+    m_client(move(t_client)), m_url(move(t_url)) {}
+
+auto RemoteZip::open() -> bool {
+  const auto head{m_client.head(m_url)};
+  if (head.status_code != status::HTTP_OK) {
+    return false;
+  }
+
+  // Header map is case-insensitive.
+  const auto
+      ranges_iter{head.header.find("accept-ranges")},
+      length_iter{head.header.find("content-length")};
+  if (ranges_iter == head.header.cend() || ranges_iter->second != "bytes" ||
+      length_iter == head.header.cend()) {
+    return false;
+  }
+
+  try {
+    m_size = stoull(length_iter->second);
+    // Avoid following redirects on every request.
+    if (!head.url.empty()) {
+      m_url = head.url;
+    }
+
+    const auto tail_size{min<uint64_t>(m_size, ZipDirectory::MAX_TAIL_SIZE)};
+    const auto tail_offset{m_size - tail_size};
+    const auto location{ZipDirectory::find_location(
+                        fetch(tail_offset, tail_size), tail_offset)};
+
+    if (location.offset + location.size > m_size) {
+      return false;
+    }
+    m_directory = ZipDirectory(fetch(location.offset, location.size));
+  } catch (const exception&) {
+    return false;
+  }
+  return true;
+}
+
+void RemoteZip::extract(const ZipDirectory::Entry& t_entry, ostream& t_os,
+    const function<fetch_callback_t>& t_callback,
+    Sha256* const t_sha256) const {
+  const auto header_offset{t_entry.local_header_offset};
+  if (header_offset >= m_size) {
+    throw runtime_error("local header is out of range");
+  }
+  const auto header_size{ZipDirectory::get_local_header_size(fetch(
+      header_offset, min<uint64_t>(m_size - header_offset,
+      ZipDirectory::LOCAL_HEADER_SIZE + t_entry.name.length() +
+      LOCAL_EXTRA_RESERVE)))};
+
+  const auto data_offset{header_offset + header_size};
+  if (data_offset + t_entry.compressed_size > m_size) {
+    throw runtime_error("data is out of range");
+  }
+
+  const bool is_deflated{t_entry.method == Method::DEFLATED};
+  if (!is_deflated && t_entry.method != Method::STORED) {
+    throw runtime_error("unsupported compression method");
+  }
+
+  z_stream stream{};
+  // Negative window bits mean raw deflate data without zlib header.
+  if (is_deflated && inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    throw runtime_error("failed to initialize decompressor");
+  }
+  const ScopeGuard stream_guard([&stream, is_deflated] {
+    if (is_deflated) {
+      inflateEnd(&stream);
+    }
+  });
+
+  vector<unsigned char> buf(INFLATE_BUFFER_SIZE);
+  uLong crc{crc32(0UL, Z_NULL, 0U)};
+  uint64_t written{};
+  bool stream_ended{!is_deflated};
+  string error;
+  long status_code{};
+  // If server ignored the range, then it responds with the whole archive,
+  // which mustn't get to the output.
+  const auto header_callback{HttpClient::make_status_callback(status_code)};
+
+  const auto output{[&] (const unsigned char* const data, const size_t size) {
+    crc = crc32(crc, data, static_cast<uInt>(size));
+    if (t_sha256 != nullptr && !t_sha256->update(data, size)) {
+      error = "failed to hash data";
+      return false;
+    }
+    t_os.write(reinterpret_cast<const char*>(data),
+               static_cast<streamsize>(size));
+    written += size;
+    if (!t_os) {
+      error = "failed to write data";
+      return false;
+    }
+    return true;
+  }};
+
+  const WriteCallback write_callback([&] (const string& data) {
+    if (status_code != status::HTTP_PARTIAL_CONTENT) {
+      return false;
+    }
+    if (t_callback) {
+      t_callback(data.size());
+    }
+    if (!is_deflated) {
+      return output(reinterpret_cast<const unsigned char*>(data.data()),
+                    data.size());
+    }
+
+    // Data can't be modified, but zlib takes a non-const pointer.
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    do {
+      stream.next_out = buf.data();
+      stream.avail_out = static_cast<uInt>(buf.size());
+
+      const auto status{inflate(&stream, Z_NO_FLUSH)};
+      if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+        error = "data is corrupted";
+        return false;
+      }
+      if (!output(buf.data(), buf.size() - stream.avail_out)) {
+        return false;
+      }
+      if (status == Z_STREAM_END) {
+        stream_ended = true;
+        break;
+      }
+    } while (stream.avail_out == 0U || stream.avail_in != 0U);
+    return true;
+  });
+
+  if (t_entry.compressed_size != 0U) {
+    const auto response{m_client.download(write_callback, m_url,
+        make_range(data_offset, t_entry.compressed_size), header_callback)};
+    if (!error.empty()) {
+      throw runtime_error(error);
+    }
+    if (response.status_code != status::HTTP_PARTIAL_CONTENT) {
+      throw runtime_error("failed to fetch data (status code " +
+                          to_string(response.status_code) + ')');
+    }
+  }
+
+  if (!stream_ended || written != t_entry.uncompressed_size) {
+    throw runtime_error("data is truncated");
+  }
+  if (crc != t_entry.crc32) {
+    throw runtime_error("CRC-32 mismatch");
+  }
+}
+
+auto RemoteZip::fetch(const uint64_t t_offset,
+                      const uint64_t t_size) const -> string {
+  if (t_size == 0U) {
+    return {};
+  }
+
+  string data;
+  long status_code{};
+  // If server ignored the range, then it will respond with the OK status.
+  // Transfer is aborted at once, so the whole archive isn't received.
+  const auto header_callback{HttpClient::make_status_callback(status_code)};
+  const WriteCallback write_callback([&] (const string& chunk) {
+    if (status_code != status::HTTP_PARTIAL_CONTENT ||
+        chunk.size() > t_size - data.size()) {
+      return false;
+    }
+    data += chunk;
+    return true;
+  });
+
+  const auto response{m_client.download(write_callback, m_url,
+                      make_range(t_offset, t_size), header_callback)};
+  if (response.status_code != status::HTTP_PARTIAL_CONTENT) {
+    throw runtime_error("server doesn't respond with partial content");
+  }
+  if (data.size() != t_size) {
+    throw runtime_error("unexpected size of partial content");
+  }
+  return data;
+}
+
+auto RemoteZip::make_range(
+    const uint64_t t_offset, const uint64_t t_size) -> Header {
+  // Last position is inclusive.
+  return {{"Range", "bytes=" + to_string(t_offset) + '-' +
+          to_string(t_offset + t_size - 1U)}};
+}
@@ -4,24 +4,47 @@
  * Licensed under the Apache License, Version 2.0
  */
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <functional>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <stdexcept>
 #include <system_error>
+#include <thread>
+#include <tuple>
 #include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include <cpr/api.h>
 #include <cpr/cprtypes.h>
 #include <cpr/status_codes.h>
 #include <fcli/text.hpp>
 
 #include "general/enum_array.hpp"
+#include "general/scope_guard.hpp"
 #include "sdk.hpp"
+#include "sha256.hpp"
 #include "utils.hpp"
+#include "zip_writer.hpp"
 
 using namespace std;
 using namespace filesystem;
@@ -31,19 +54,37 @@ using namespace fcli::literals;
 using Message = Text::Message;
 
 using namespace cpr;
-using namespace libzippp;
 using namespace pugi;
 
 Sdk::Sdk() {
-  auto* env_dir{getenv("XDG_DATA_HOME")};
-  if (env_dir != nullptr) {
-    m_root_dir_path = path(env_dir) / ROOT_DIR_NAME;
-  } else {
-    env_dir = getenv("HOME");
-    if (env_dir == nullptr) {
+  // Fall back path is relative to the home directory.
+  const auto get_base_dir{[] (const char* const env_var,
+                              const path& fall_back_path) {
+    if (const auto* const env_dir{getenv(env_var)}; env_dir != nullptr) {
+      return path(env_dir) / ROOT_DIR_NAME;
+    }
+    const auto* const home_dir{getenv("HOME")};
+    if (home_dir == nullptr) {
       throw runtime_error("HOME isn't set");
     }
-    m_root_dir_path = path(env_dir) / ".local" / "share" / ROOT_DIR_NAME;
+    return path(home_dir) / fall_back_path / ROOT_DIR_NAME;
+  }};
+
+  m_root_dir_path = get_base_dir("XDG_DATA_HOME", path(".local") / "share");
+  m_cache_dir_path = get_base_dir("XDG_CACHE_HOME", ".cache");
+
+  const auto* const system_dir{getenv(string(SYSTEM_DIR_ENV_VAR).c_str())};
+  m_system_dir_path = system_dir == nullptr ?
+                      path(DEFAULT_SYSTEM_DIR) : path(system_dir);
+  // The store itself is being managed, so there is nothing to overlay.
+  if (m_system_dir_path.lexically_normal() ==
+      m_root_dir_path.lexically_normal()) {
+    m_system_dir_path.clear();
+  }
+  m_downloader = Downloader(m_http_client, m_cache_dir_path);
+
+  if (const auto apis{get_installed_apis()}; !apis.empty()) {
+    m_api = *apis.crbegin();
   }
 }
 
@@ -51,17 +92,9 @@ Sdk::Sdk() {
 // Installation process |
 // -------------------- +
 
-auto Sdk::install(const shared_ptr<Config> t_config, const Terminal& t_term,
-                  const unsigned short t_installed_api) -> int {
-  if (t_installed_api != 0U) {
-    cout << Text::format_copy("You have already installed SDK with API <b>" +
-            to_string(t_installed_api) + "<r>.\nDo you want to override it?") <<
-            endl;
-    if (!Utils::request_confirm(false)) {
-      return EXIT_SUCCESS;
-    }
-  }
-
+auto Sdk::install(const shared_ptr<Config> t_config,
+                  const Terminal& t_term) -> int {
+  const auto installed_apis{get_installed_apis()};
   const auto get_progress_width{[&t_term] {
     constexpr unsigned short
         MAX_WIDTH{60U},
@@ -74,100 +107,362 @@ auto Sdk::install(const shared_ptr<Config> t_config, const Terminal& t_term,
     return EXIT_FAILURE;
   }
 
-  const auto api{request_api(manifest)};
+  const auto api{request_api(manifest, installed_apis)};
   if (api == 0U) {
     return EXIT_FAILURE;
   }
   const auto api_str{to_string(api)};
 
-  cout << Text::format_copy(
-          "Installing SDK (API <b>" + api_str + "<r>):") << endl;
-  create_dirs();
-  // Used to store downloaded archives.
-  TmpFile tmp_file(ios::binary);
-  auto& tmp_ofs{tmp_file.get_stream()};
+  cout << Text::format_copy((installed_apis.count(api) == 0U ?
+          "Installing SDK (API <b>" : "Updating SDK (API <b>") +
+          api_str + "<r>):") << endl;
+  create_dirs(api_str);
+  // Only components changed since the last installation are installed.
+  Ledger ledger(m_root_dir_path / LEDGER_FILE_NAME);
+
+  // Cursor movements can be used only if the standard output is a terminal.
+  MultiProgress progress(get_progress_width(), isatty(STDOUT_FILENO) == 1);
+  vector<future<bool>> results;
 
   constexpr array api_dependent_install_funcs{
     &Sdk::install_tools, &Sdk::install_build_tools, &Sdk::install_framework
   };
   for (const auto f : api_dependent_install_funcs) {
-    // Retrieve terminal width every time, since it can be changed by the user.
-    if (!invoke(f, this, manifest, api_str, tmp_file, get_progress_width())) {
-      return EXIT_FAILURE;
+    results.push_back(async(launch::async, f, this, cref(manifest),
+                      cref(api_str), ref(progress), ref(ledger)));
+  }
+
+  constexpr array api_independent_install_funcs{
+    &Sdk::download_apm_jar, &Sdk::install_tzdata, &Sdk::download_assets
+  };
+  for (const auto f : api_independent_install_funcs) {
+    results.push_back(async(launch::async, f,
+                      this, cref(manifest), ref(progress), ref(ledger)));
+  }
+
+  // Wait for all components even if some of them
+  // failed, so their temporary files will be deleted.
+  bool installed{true};
+  for (auto& r : results) {
+    if (!r.get()) {
+      installed = false;
     }
-    if (!tmp_ofs.is_open()) {
-      tmp_ofs.open(tmp_file.get_path(), ios::binary);
+  }
+  deduplicate(ledger);
+  // Keep records of successfully installed components even on failure.
+  if (!ledger.save()) {
+    cerr << Text::format_message(Message::WARNING,
+            "Couldn't save the ledger of installed files") << endl;
+  }
+  if (!installed) {
+    return EXIT_FAILURE;
+  }
+
+  // The last installed API is used for new projects.
+  if (!t_config->apply<decltype(api)>(Config::Key::SDK, api)) {
+    cerr << "Couldn't preserve API version"_err << endl;
+    return EXIT_FAILURE;
+  }
+  m_api = api;
+
+  cout << "SDK installed." << endl;
+  if (installed_apis.empty()) {
+    cout << "Use <b>-c<r> (<b>--create<r>) option "
+            "to create a new project"_note << endl;
+  }
+  return EXIT_SUCCESS;
+}
+
+auto Sdk::verify(const Terminal& t_term) const -> int {
+  constexpr unsigned short
+      MAX_PROGRESS_WIDTH{60U},
+      FALL_BACK_PROGRESS_WIDTH{20U};
+
+  Ledger ledger(m_root_dir_path / LEDGER_FILE_NAME);
+  // Files installed by the previous versions aren't recorded.
+  set<path> unrecorded_paths;
+  const auto check_recorded{[&] (const path& file_path) {
+    // Files of the system store are recorded in its own ledger.
+    if (resolve_shared(file_path) == file_path &&
+        !ledger.is_recorded(file_path)) {
+      unrecorded_paths.insert(file_path);
+    }
+  }};
+  for (const auto a : get_installed_apis()) {
+    const auto api_str{to_string(a)};
+    if (find_api_store(api_str) != &m_root_dir_path) {
+      continue;
+    }
+    for (size_t t{}; t != size<Tool>(); ++t) {
+      check_recorded(make_tool_path(static_cast<Tool>(t), api_str));
+    }
+    for (size_t j{}; j != size<Jar>(); ++j) {
+      check_recorded(make_jar_path(static_cast<Jar>(j), api_str));
     }
   }
+  for (size_t f{}; f != size<File>(); ++f) {
+    check_recorded(make_file_path(static_cast<File>(f)));
+  }
 
-  bool install_api_independent_files{true};
-  if (t_installed_api != 0U) {
-    // Request confirmation before updating of
-    // API independent files if all of them exist.
-    bool confirm_update{true};
+  MultiProgress multi_progress(Utils::get_term_width(t_term,
+      MAX_PROGRESS_WIDTH, FALL_BACK_PROGRESS_WIDTH),
+      isatty(STDOUT_FILENO) == 1);
+  auto& progress{multi_progress.add("Verifying SDK files")};
+  progress.set_determined(true);
+  progress.show();
 
-    for (size_t f{}; f != size<File>(); ++f) {
-      try {
-        static_cast<void>(get_file_path(static_cast<File>(f)));
-      } catch (const runtime_error&) {
-        confirm_update = false;
-        break;
-      }
+  const auto mismatches{ledger.verify(make_verify_callback(progress))};
+  if (mismatches.empty() && unrecorded_paths.empty()) {
+    progress.finish(true, "All SDK files are intact");
+    return EXIT_SUCCESS;
+  }
+  progress.finish(false, "SDK files are damaged");
+
+  for (const auto& m : mismatches) {
+    cerr << Text::format_message(Message::ERROR,
+            m.path.string() + ": " + m.reason) << endl;
+    ledger.forget(m.component);
+  }
+  for (const auto& p : unrecorded_paths) {
+    cerr << Text::format_message(Message::ERROR,
+            p.string() + ": isn't recorded") << endl;
+  }
+  if (!mismatches.empty() && !ledger.save()) {
+    cerr << "Couldn't save the ledger of installed files"_err << endl;
+  }
+
+  cout << "Use <b>-s<r> (<b>--set-up<r>) option to repair SDK"_note << endl;
+  return EXIT_FAILURE;
+}
+
+auto Sdk::export_bundle(const path& t_path, const Terminal& t_term) const
+    -> int {
+  constexpr unsigned short
+      MAX_PROGRESS_WIDTH{60U},
+      FALL_BACK_PROGRESS_WIDTH{20U};
+
+  const auto ledger_path{m_root_dir_path / LEDGER_FILE_NAME};
+  const Ledger ledger(ledger_path);
+  const auto files{ledger.get_files()};
+  if (files.empty()) {
+    cerr << "Installed files aren't recorded. Use <b>-s<r> (<b>--set-up<r>) "
+            "option to reinstall SDK"_err << endl;
+    return EXIT_FAILURE;
+  }
+
+  MultiProgress multi_progress(Utils::get_term_width(t_term,
+      MAX_PROGRESS_WIDTH, FALL_BACK_PROGRESS_WIDTH),
+      isatty(STDOUT_FILENO) == 1);
+  auto& progress{multi_progress.add("Verifying SDK files")};
+  progress.set_determined(true);
+  progress.show();
+
+  // Damaged files mustn't be spread over other machines.
+  if (const auto mismatches{ledger.verify(make_verify_callback(progress))};
+      !mismatches.empty()) {
+    progress.finish(false, "SDK files are damaged");
+    for (const auto& m : mismatches) {
+      cerr << Text::format_message(Message::ERROR,
+              m.path.string() + ": " + m.reason) << endl;
     }
+    cout << "Use <b>--verify-sdk<r> and <b>-s<r> (<b>--set-up<r>) "
+            "options to repair SDK"_note << endl;
+    return EXIT_FAILURE;
+  }
 
-    if (confirm_update) {
-      cout << "Do you want to update API independent files?" << endl;
-      if (!Utils::request_confirm(true)) {
-        install_api_independent_files = false;
-      }
-      if (install_api_independent_files) {
-        cout << "Updating API independent files:" << endl;
-      }
+  progress = "Packing SDK files";
+  progress = 0.0;
+  try {
+    // Files are stored without compression, so they
+    // can be copied directly from the bundle on install.
+    ZipWriter writer(t_path);
+    for (size_t i{}; i != files.size(); ++i) {
+      writer.add(files[i].generic_string(), m_root_dir_path / files[i]);
+      progress = static_cast<double>((i + 1U) * 100U) /
+                 static_cast<double>(files.size());
     }
+    writer.add(LEDGER_FILE_NAME, ledger_path);
+    writer.finish();
+  } catch (const exception& e) {
+    error_code err;
+    remove(t_path, err);
+    progress.finish(false, "Couldn't pack SDK files: "s + e.what());
+    return EXIT_FAILURE;
   }
 
-  if (install_api_independent_files) {
-    const array<function<bool()>, 3U> api_independent_install_funcs{
-      [&] { return download_apm_jar(manifest, get_progress_width()); },
-      [&] { return install_tzdata(manifest, tmp_file, get_progress_width()); },
-      [&] { return download_assets(manifest, get_progress_width()); }
-    };
-    for (const auto& f : api_independent_install_funcs) {
-      if (!f()) {
+  progress.finish(true, "SDK exported");
+  return EXIT_SUCCESS;
+}
+
+auto Sdk::install_bundle(const path& t_source,
+    const shared_ptr<Config> t_config, const Terminal& t_term) -> int {
+  constexpr unsigned short
+      MAX_PROGRESS_WIDTH{60U},
+      FALL_BACK_PROGRESS_WIDTH{20U};
+
+  cout << Text::format_copy("Installing SDK from <u>" +
+          t_source.string() + "<r>:") << endl;
+  // Located in the root directory, so files are moved from it by renaming.
+  const auto staging_dir{m_root_dir_path / STAGING_DIR_NAME};
+  const auto imported_ledger_path{m_root_dir_path / IMPORTED_LEDGER_FILE_NAME};
+  // Files of an interrupted installation are useless.
+  remove_all(staging_dir);
+  create_directories(staging_dir);
+  // Records are merged into the main ledger, so these files aren't needed.
+  const ScopeGuard staging_guard([&staging_dir, &imported_ledger_path] {
+    error_code err;
+    remove_all(staging_dir, err);
+    remove(imported_ledger_path, err);
+  });
+
+  MultiProgress multi_progress(Utils::get_term_width(t_term,
+      MAX_PROGRESS_WIDTH, FALL_BACK_PROGRESS_WIDTH),
+      isatty(STDOUT_FILENO) == 1);
+  auto& progress{multi_progress.add("Reading SDK bundle")};
+  progress.show();
+  if (!unpack_bundle(t_source, staging_dir, progress)) {
+    return EXIT_FAILURE;
+  }
+
+  // Installed files aren't touched until all files of the bundle are valid.
+  Ledger staged_ledger(staging_dir / LEDGER_FILE_NAME);
+  progress = "Verifying SDK files";
+  progress.set_determined(true);
+  progress = 0.0;
+  if (const auto mismatches{
+      staged_ledger.verify(make_verify_callback(progress))};
+      !mismatches.empty()) {
+    progress.finish(false, "SDK bundle is damaged");
+    for (const auto& m : mismatches) {
+      cerr << Text::format_message(Message::ERROR,
+              m.path.string() + ": " + m.reason) << endl;
+    }
+    return EXIT_FAILURE;
+  }
+  // Copied files have their own modification times, which are kept by moving.
+  if (!staged_ledger.refresh_metadata() || !staged_ledger.save()) {
+    progress.finish(false, "Couldn't record installed files");
+    return EXIT_FAILURE;
+  }
+
+  progress = "Moving SDK files";
+  error_code fs_err;
+  for (const auto& f : staged_ledger.get_files()) {
+    const auto output_path{m_root_dir_path / f};
+    create_directories(output_path.parent_path(), fs_err);
+    if (!fs_err) {
+      rename(staging_dir / f, output_path, fs_err);
+    }
+    if (fs_err) {
+      progress.finish(false, "Couldn't move " + f.string() +
+                      " (" + fs_err.message() + ')');
+      return EXIT_FAILURE;
+    }
+  }
+  // Relative paths of the moved files are resolved against the root now.
+  rename(staging_dir / LEDGER_FILE_NAME, imported_ledger_path);
+  const Ledger imported_ledger(imported_ledger_path);
+
+  Ledger ledger(m_root_dir_path / LEDGER_FILE_NAME);
+  ledger.merge(imported_ledger);
+  deduplicate(ledger);
+  if (!ledger.save()) {
+    cerr << Text::format_message(Message::WARNING,
+            "Couldn't save the ledger of installed files") << endl;
+  }
+
+  const auto apis{get_installed_apis()};
+  if (apis.empty()) {
+    progress.finish(false, "SDK bundle doesn't contain a complete API");
+    return EXIT_FAILURE;
+  }
+  // Permissions aren't preserved on extraction.
+  for (const auto a : apis) {
+    const auto api_str{to_string(a)};
+    if (find_api_store(api_str) != &m_root_dir_path) {
+      continue;
+    }
+    for (size_t t{}; t != size<Tool>(); ++t) {
+      const auto tool_path{make_tool_path(static_cast<Tool>(t), api_str)};
+      permissions(tool_path,
+          perms::owner_exec | perms::group_exec | perms::others_exec,
+          perm_options::add, fs_err);
+      if (fs_err) {
+        progress.finish(false, "Couldn't set permissions for " +
+            tool_path.filename().string() + " (" + fs_err.message() + ')');
         return EXIT_FAILURE;
       }
     }
   }
+  progress.finish(true, "SDK files installed");
 
+  // The latest API is used for new projects.
+  const auto api{*apis.crbegin()};
   if (!t_config->apply<decltype(api)>(Config::Key::SDK, api)) {
     cerr << "Couldn't preserve API version"_err << endl;
     return EXIT_FAILURE;
   }
+  m_api = api;
 
   cout << "SDK installed." << endl;
-  if (t_installed_api == 0U) {
-    cout << "Use <b>-c<r> (<b>--create<r>) option "
-            "to create a new project"_note << endl;
-  }
   return EXIT_SUCCESS;
 }
 
 auto Sdk::download_manifest(
-    const unsigned short t_progress_width) -> xml_document {
+    const unsigned short t_progress_width) const -> xml_document {
   using namespace string_literals;
 
-  Progress progress("Downloading manifest", false, t_progress_width);
+  MultiProgress multi_progress(
+      t_progress_width, isatty(STDOUT_FILENO) == 1);
+  auto& progress{multi_progress.add("Downloading manifest")};
   progress.show();
-  const Url url(string(REPO_RAW_URL_PREFIX) + "manifest.xml");
-  const auto response{Get(url)};
 
-  if (!check_response(response,
-      "Couldn't download the manifest file", progress, false)) {
-    return {};
+  const auto cached_path{m_cache_dir_path / MANIFEST_FILE_NAME};
+  auto validators_path{cached_path};
+  validators_path += VALIDATORS_FILE_EXTENSION;
+
+  // The first line is ETag and the second one is Last-Modified.
+  string etag, last_modified;
+  if (exists(cached_path)) {
+    ifstream ifs(validators_path);
+    getline(ifs, etag);
+    getline(ifs, last_modified);
+  }
+  Header header;
+  if (!etag.empty()) {
+    header.emplace("If-None-Match", etag);
+  }
+  if (!last_modified.empty()) {
+    header.emplace("If-Modified-Since", last_modified);
   }
 
+  // Manifest is a text file, so it's compressed well.
+  auto client{m_http_client};
+  client.set_compression(true);
+  const Url url(string(REPO_RAW_URL_PREFIX) + string(MANIFEST_FILE_NAME));
+  const auto response{client.get(url, header)};
+
   xml_document doc;
-  const auto parse_result{doc.load_string(response.text.c_str())};
+  xml_parse_result parse_result;
+  if (response.status_code == status::HTTP_NOT_MODIFIED ||
+      (response.error && exists(cached_path))) {
+    progress.hide();
+    if (response.error) {
+      cerr << Text::format_message(Message::WARNING,
+              "Couldn't check for manifest updates, using the cached copy. " +
+              response.error.message) << endl;
+    }
+    parse_result = doc.load_file(cached_path.c_str());
+  } else {
+    if (!check_response(response,
+        "Couldn't download the manifest file", progress, false)) {
+      return {};
+    }
+    parse_result = doc.load_string(response.text.c_str());
+    if (parse_result.status == status_ok) {
+      save_manifest(response, cached_path, validators_path);
+    }
+  }
 
   if (parse_result.status != status_ok) {
     cerr << Text::format_message(Message::ERROR,
@@ -178,7 +473,34 @@ auto Sdk::download_manifest(
   return doc;
 }
 
-auto Sdk::request_api(const xml_document& t_manifest) -> unsigned short {
+void Sdk::save_manifest(const Response& t_response,
+    const path& t_path, const path& t_validators_path) {
+  error_code err;
+  create_directories(t_path.parent_path(), err);
+  // Replace files atomically, so the copy won't be left half-written.
+  auto tmp_path{t_path};
+  tmp_path += ".tmp";
+  if (!(ofstream(tmp_path, ios::binary | ios::trunc) << t_response.text)) {
+    remove(tmp_path, err);
+    return;
+  }
+
+  const auto& header{t_response.header};
+  const auto get_value{[&header] (const string& key) {
+    const auto iter{header.find(key)};
+    return iter == header.cend() ? string() : iter->second;
+  }};
+  // Remove the old validators first, so they won't refer to the new copy.
+  remove(t_validators_path, err);
+  rename(tmp_path, t_path, err);
+  if (!err) {
+    ofstream(t_validators_path, ios::trunc) << get_value("etag") << '\n' <<
+        get_value("last-modified") << '\n';
+  }
+}
+
+auto Sdk::request_api(const xml_document& t_manifest,
+    const set<unsigned short>& t_installed_apis) -> unsigned short {
   const auto api_attrs{t_manifest.select_nodes("/manifest/tools/set/@api")};
   set<unsigned short> apis;
 
@@ -196,7 +518,8 @@ auto Sdk::request_api(const xml_document& t_manifest) -> unsigned short {
   cout << "Choose API version:" << endl;
   size_t num{};
   for (const auto a : apis) {
-    cout << "  " + to_string(++num) + ". API " + to_string(a) << endl;
+    cout << "  " + to_string(++num) + ". API " + to_string(a) <<
+            (t_installed_apis.count(a) != 0U ? " (installed)" : "") << endl;
   }
 
   unsigned short api{};
@@ -218,11 +541,12 @@ auto Sdk::request_api(const xml_document& t_manifest) -> unsigned short {
   return api;
 }
 
-void Sdk::create_dirs() const {
+void Sdk::create_dirs(const string_view t_api) const {
+  const auto api_dir{get_api_dir(t_api)};
   const array paths{
-    m_root_dir_path,
-    m_root_dir_path / TOOLS_SUBDIR_NAME,
-    m_root_dir_path / JARS_SUBDIR_NAME
+    m_root_dir_path / JARS_SUBDIR_NAME,
+    api_dir / TOOLS_SUBDIR_NAME,
+    api_dir / JARS_SUBDIR_NAME
   };
 
   for (const auto& p : paths) {
@@ -235,9 +559,9 @@ void Sdk::create_dirs() const {
 // ------------------- +
 
 auto Sdk::install_tools(const xml_document& t_manifest,
-    const string& t_api, TmpFile<ofstream>& t_tmp_file,
-    const unsigned short t_progress_width) const -> bool {
-  Progress progress("Preparing to download tools", false, t_progress_width);
+    const string& t_api, MultiProgress& t_progress,
+    Ledger& t_ledger) const -> bool {
+  auto& progress{t_progress.add("Preparing to download tools")};
   progress.show();
 
   const string arch(Utils::get_arch_name(Utils::get_arch()));
@@ -258,54 +582,64 @@ auto Sdk::install_tools(const xml_document& t_manifest,
         "Checksum of tools doesn't exist for architecture <u>" + arch + "<r>"));
     return false;
   }
+  const auto component{"tools/api-" + t_api};
+  if (t_ledger.is_up_to_date(component, checksum)) {
+    progress.finish(true, Text::format_copy(
+        "Tools for <u>" + arch + "<r> are up to date"));
+    return true;
+  }
 
   progress = "Downloading tools";
-  auto& tmp_ofs{t_tmp_file.get_stream()};
   const Url url(string(REPO_RAW_URL_PREFIX) +
                 "tools/api-" + t_api + '/' + arch + ".zip");
-  const auto response{Utils::download(tmp_ofs, url, progress)};
-  tmp_ofs.close();
-
-  const auto& tmp_file_path{t_tmp_file.get_path()};
-  if (!check_response_and_sha256(response,
-      tmp_file_path, checksum, "tools", progress)) {
+  const auto archive_path{fetch_file(url, checksum, "tools", progress)};
+  if (archive_path.empty()) {
     return false;
   }
 
-  ZipArchive zip(tmp_file_path);
+  LocalZip zip(archive_path);
   if (!zip.open()) {
     progress.finish(false, "Couldn't open archive with tools");
     return false;
   }
 
-  error_code fs_err;
-  for (const auto& e : zip.getEntries()) {
-    const auto& name{e.getName()};
-    const auto output_path{m_root_dir_path / TOOLS_SUBDIR_NAME / name};
-    if (!extract_zip_entry(e, output_path, name, progress)) {
-      return false;
+  const auto tools_dir{get_api_dir(t_api) / TOOLS_SUBDIR_NAME};
+  vector<LocalZip::Target> targets;
+  for (const auto& e : zip.get_directory().get_entries()) {
+    // Skip directories.
+    if (!e.name.empty() && e.name.back() != '/') {
+      targets.emplace_back(&e, tools_dir / e.name);
     }
+  }
+  if (!extract_zip_entries(zip, targets, "tools", progress)) {
+    return false;
+  }
 
+  error_code fs_err;
+  vector<path> installed_files;
+  for (const auto& t : targets) {
+    const auto& output_path{t.second};
     permissions(output_path,
         perms::owner_exec | perms::group_exec | perms::others_exec,
         perm_options::add, fs_err);
     if (fs_err) {
       progress.finish(false, "Couldn't set permissions for " +
-                      name + " (" + fs_err.message() + ')');
+          output_path.filename().string() + " (" + fs_err.message() + ')');
       return false;
     }
+    installed_files.push_back(output_path);
   }
 
+  t_ledger.record(component, checksum, installed_files);
   progress.finish(true,
       Text::format_copy("Tools for <u>" + arch + "<r> installed"));
   return true;
 }
 
 auto Sdk::install_build_tools(const xml_document& t_manifest,
-    const string& t_api, TmpFile<ofstream>& t_tmp_file,
-    const unsigned short t_progress_width) const -> bool {
-  Progress progress("Preparing to download build tools",
-                    false, t_progress_width);
+    const string& t_api, MultiProgress& t_progress,
+    Ledger& t_ledger) const -> bool {
+  auto& progress{t_progress.add("Preparing to download build tools")};
   progress.show();
 
   const auto xpath_node{t_manifest.select_node(
@@ -328,28 +662,14 @@ auto Sdk::install_build_tools(const xml_document& t_manifest,
     progress.finish(false, "Checksum of build tools doesn't exist");
     return false;
   }
-
-  progress.set_determined(true);
-  progress = "Downloading build tools";
-  auto& tmp_ofs{t_tmp_file.get_stream()};
-  const auto response{Utils::download(tmp_ofs, url, progress)};
-  tmp_ofs.close();
-
-  const auto& tmp_file_path{t_tmp_file.get_path()};
-  if (!check_response_and_sha256(response,
-      tmp_file_path, checksum, "build tools", progress)) {
-    return false;
-  }
-  // Checksum checker set progress as undetermined.
-
-  // Notify about opening, since an archive is large.
-  progress = "Opening archive with build tools";
-  ZipArchive zip(tmp_file_path);
-  if (!zip.open()) {
-    progress.finish(false, "Couldn't open archive with build tools");
-    return false;
+  const auto component{"build-tools/api-" + t_api};
+  if (t_ledger.is_up_to_date(component, checksum)) {
+    progress.finish(true, "Build tools are up to date");
+    return true;
   }
 
+  // Key is path of a tool in the archive.
+  map<string, ZipEntryTarget> entries;
   for (auto t{node.first_child()}; t != nullptr; t = t.next_sibling()) {
     const path tool_path(t.text().get());
     if (tool_path.empty()) {
@@ -357,30 +677,27 @@ auto Sdk::install_build_tools(const xml_document& t_manifest,
           "Couldn't extract build tools: no path provided for a tool");
       return false;
     }
+    entries.emplace(tool_path, ZipEntryTarget{get_api_dir(t_api) /
+        JARS_SUBDIR_NAME / tool_path.filename(), get_sha256(t)});
+  }
 
-    const auto entry{zip.getEntry(tool_path)};
-    if (entry.isNull()) {
-      progress.finish(false,
-          "Couldn't extract build tools: failed to get ZIP entry \"" +
-          tool_path.string() + '"');
-      return false;
-    }
-
-    const string name(tool_path.filename());
-    const auto output_path{m_root_dir_path / JARS_SUBDIR_NAME / name};
-    if (!extract_zip_entry(entry, output_path, name, progress)) {
-      return false;
-    }
+  if (!install_zip_entries(url, checksum, entries, "build tools", progress)) {
+    return false;
+  }
+  vector<path> installed_files;
+  for (const auto& e : entries) {
+    installed_files.push_back(e.second.output_path);
   }
+  t_ledger.record(component, checksum, installed_files);
 
   progress.finish(true, "Build tools installed");
   return true;
 }
 
 auto Sdk::install_framework(const xml_document& t_manifest,
-    const string& t_api, TmpFile<ofstream>& t_tmp_file,
-    const unsigned short t_progress_width) const -> bool {
-  Progress progress("Preparing to download platform", false, t_progress_width);
+    const string& t_api, MultiProgress& t_progress,
+    Ledger& t_ledger) const -> bool {
+  auto& progress{t_progress.add("Preparing to download platform")};
   progress.show();
 
   const auto xpath_node{t_manifest.select_node(
@@ -403,45 +720,25 @@ auto Sdk::install_framework(const xml_document& t_manifest,
     progress.finish(false, "Checksum of platform doesn't exist");
     return false;
   }
+  const auto component{"platform/api-" + t_api};
+  if (t_ledger.is_up_to_date(component, checksum)) {
+    progress.finish(true, "Android framework is up to date");
+    return true;
+  }
 
   const auto framework_node{node.child("framework")};
   if (!framework_node) {
     progress.finish(false, "Android framework path doesn't exist");
     return false;
   }
-  const path framework_path(framework_node.text().get());
-
-  progress.set_determined(true);
-  progress = "Downloading platform";
-  auto& tmp_ofs{t_tmp_file.get_stream()};
-  const auto response{Utils::download(tmp_ofs, url, progress)};
-  tmp_ofs.close();
-
-  const auto& tmp_file_path{t_tmp_file.get_path()};
-  if (!check_response_and_sha256(response,
-      tmp_file_path, checksum, "platform", progress)) {
-    return false;
-  }
+  const string framework_path(framework_node.text().get());
 
-  progress = "Opening archive with Android framework";
-  ZipArchive zip(tmp_file_path);
-  if (!zip.open()) {
-    progress.finish(false, "Couldn't open archive with Android framework");
-    return false;
-  }
-
-  const auto entry{zip.getEntry(framework_path)};
-  if (entry.isNull()) {
-    progress.finish(false,
-        "Couldn't extract Android framework: failed to get ZIP entry \"" +
-        framework_path.string() + '"');
-    return false;
-  }
-
-  if (!extract_zip_entry(entry, get_jar_path(Jar::FRAMEWORK, false),
-      framework_path.filename().string(), progress)) {
+  const auto output_path{make_jar_path(Jar::FRAMEWORK, t_api)};
+  if (!install_zip_entries(url, checksum, {{framework_path,
+      {output_path, get_sha256(framework_node)}}}, "platform", progress)) {
     return false;
   }
+  t_ledger.record(component, checksum, {output_path});
 
   progress.finish(true, "Android framework installed");
   return true;
@@ -452,9 +749,8 @@ auto Sdk::install_framework(const xml_document& t_manifest,
 // --------------------- +
 
 auto Sdk::download_apm_jar(const xml_document& t_manifest,
-    const unsigned short t_progress_width) const -> bool {
-  Progress progress("Preparing to download apm-jni.jar",
-                    false, t_progress_width);
+    MultiProgress& t_progress, Ledger& t_ledger) const -> bool {
+  auto& progress{t_progress.add("Preparing to download apm-jni.jar")};
   progress.show();
 
   string version(APM_VERSION);
@@ -483,39 +779,32 @@ auto Sdk::download_apm_jar(const xml_document& t_manifest,
     progress.finish(false, "Checksum of apm-jni.jar doesn't exist");
     return false;
   }
-
-  const auto output_path{get_jar_path(Jar::APM_JNI, false)};
-  ofstream ofs(output_path, ios::binary);
-  if (!ofs) {
-    progress.finish(false,
-        "Couldn't download apm-jni.jar: failed to open output file \"" +
-        output_path.string() + '"');
-    return false;
+  constexpr string_view COMPONENT{"apm-jni"};
+  if (t_ledger.is_up_to_date(COMPONENT, checksum)) {
+    progress.finish(true,
+        Text::format_copy("apm-jni.jar <u>" + version + "<r> is up to date"));
+    return true;
   }
 
   progress = "Downloading apm-jni.jar";
   const Url url(string(REPO_RAW_URL_PREFIX) + "apm-jni/" +
                 node.text().as_string() + ".jar");
-  const auto response{Download(ofs, url)};
-  ofs.close();
-
-  if (!check_response_and_sha256(response,
-      output_path, checksum, "apm-jni.jar", progress)) {
-    error_code err;
-    remove(output_path, err);
+  // Output file is replaced only after the checksum is verified.
+  const auto output_path{make_jar_path(Jar::APM_JNI, {})};
+  if (!download_file(url, checksum, output_path, "apm-jni.jar", progress)) {
     return false;
   }
+  t_ledger.record(COMPONENT, checksum, {output_path});
 
   progress.finish(true,
       Text::format_copy("apm-jni.jar <u>" + version + "<r> downloaded"));
   return true;
 }
 
-auto Sdk::install_tzdata(
-    const xml_document& t_manifest, TmpFile<ofstream>& t_tmp_file,
-    const unsigned short t_progress_width) const -> bool {
-  Progress progress("Preparing to download time zone database",
-                    false, t_progress_width);
+auto Sdk::install_tzdata(const xml_document& t_manifest,
+    MultiProgress& t_progress, Ledger& t_ledger) const -> bool {
+  auto& progress{
+      t_progress.add("Preparing to download time zone database")};
   progress.show();
 
   const auto xpath_node
@@ -534,36 +823,39 @@ auto Sdk::install_tzdata(
     progress.finish(false, "Checksum of time zone database doesn't exist");
     return false;
   }
+  constexpr string_view COMPONENT{"tzdata"};
+  if (t_ledger.is_up_to_date(COMPONENT, checksum)) {
+    progress.finish(true, Text::format_copy(
+        "Time zone database <u>" + version + "<r> is up to date"));
+    return true;
+  }
 
   progress = "Downloading time zone database";
-  auto& tmp_ofs{t_tmp_file.get_stream()};
-  const auto response{Utils::download(tmp_ofs, url, progress)};
-  tmp_ofs.close();
-
-  const auto& tmp_file_path{t_tmp_file.get_path()};
-  if (!check_response_and_sha256(response,
-      tmp_file_path, checksum, "time zone database", progress)) {
+  const auto archive_path{
+      fetch_file(url, checksum, "time zone database", progress)};
+  if (archive_path.empty()) {
     return false;
   }
 
-  ZipArchive zip(tmp_file_path);
+  LocalZip zip(archive_path);
   if (!zip.open()) {
     progress.finish(false, "Couldn't open archive with time zone database");
     return false;
   }
 
-  const auto output_path{get_file_path(File::TZDATA, false)};
+  const auto output_path{make_file_path(File::TZDATA)};
   const string name(output_path.filename());
-  const auto entry{zip.getEntry(name)};
+  const auto* const entry{zip.get_directory().find(name)};
 
-  if (entry.isNull()) {
+  if (entry == nullptr) {
     progress.finish(false, "Couldn't install time zone database: "
                     "failed to get ZIP entry \"" + name + '"');
     return false;
   }
-  if (!extract_zip_entry(entry, output_path, name, progress)) {
+  if (!extract_zip_entries(zip, {{entry, output_path}}, name, progress)) {
     return false;
   }
+  t_ledger.record(COMPONENT, checksum, {output_path});
 
   progress.finish(true,
       Text::format_copy("Time zone database <u>" + version + "<r> installed"));
@@ -571,8 +863,8 @@ auto Sdk::install_tzdata(
 }
 
 auto Sdk::download_assets(const xml_document& t_manifest,
-    const unsigned short t_progress_width) const -> bool {
-  Progress progress("Preparing to download assets", false, t_progress_width);
+    MultiProgress& t_progress, Ledger& t_ledger) const -> bool {
+  auto& progress{t_progress.add("Preparing to download assets")};
   progress.show();
 
   const auto xpath_nodes{t_manifest.select_nodes("/manifest/assets/file")};
@@ -582,8 +874,8 @@ auto Sdk::download_assets(const xml_document& t_manifest,
   }
 
   const EnumArray<File, path> output_paths{
-    get_file_path(File::DEBUG_KEYSTORE, false),
-    get_file_path(File::PROJECT_TEMPLATE, false)
+    make_file_path(File::DEBUG_KEYSTORE),
+    make_file_path(File::PROJECT_TEMPLATE)
     // TZDATA doesn't required.
   };
 
@@ -615,27 +907,19 @@ auto Sdk::download_assets(const xml_document& t_manifest,
     }
 
     const auto& asset{assets.at(filename)};
-    const auto& output_path{asset.first};
-
-    ofstream ofs(output_path, ios::binary);
-    if (!ofs) {
-      progress.finish(false, "Couldn't install asset " + filename +
-          ": failed to open output file \"" + output_path.string() + '"');
-      return false;
+    const auto component{"assets/" + filename};
+    if (t_ledger.is_up_to_date(component, checksum)) {
+      progress.finish(true, asset.second + " is up to date");
+      continue;
     }
 
     progress = "Downloading " + filename;
     const Url url(string(REPO_RAW_URL_PREFIX) + "assets/" + filename);
-    const auto response{Download(ofs, url)};
-    ofs.close();
-
-    if (!check_response_and_sha256(response,
-        output_path, checksum, "asset " + filename, progress)) {
-      error_code fs_err;
-      // Ignore any file system errors as it's already failed state.
-      remove(output_path, fs_err);
+    if (!download_file(url, checksum, asset.first,
+                       "asset " + filename, progress)) {
       return false;
     }
+    t_ledger.record(component, checksum, {asset.first});
 
     progress.finish(true, asset.second + " downloaded");
   }
@@ -647,7 +931,7 @@ auto Sdk::download_assets(const xml_document& t_manifest,
 // ---------------- +
 
 auto Sdk::check_response(const Response& t_response,
-    const string_view t_failure_msg, Progress& t_progress,
+    const string_view t_failure_msg, MultiProgress::Bar& t_progress,
     const bool t_fail_using_progress) -> bool {
   if (t_response.status_code == status::HTTP_OK) {
     return true;
@@ -687,66 +971,604 @@ auto Sdk::get_sha256(const xml_node& t_node) -> string {
   return attr.as_string();
 }
 
-auto Sdk::check_sha256(const path& t_file_path, const string_view t_checksum,
-    Progress& t_progress, const string_view t_failure_msg) -> bool {
+auto Sdk::make_download_callback(MultiProgress::Bar& t_progress)
+    -> function<void (uint64_t, uint64_t)> {
+  using namespace chrono;
+  using namespace chrono_literals;
+
+  // Since the progress callback calls too often, we need
+  // to limit how often to update the progress bar.
+  static constexpr auto REFRESH_INTERVAL{100ms};
+  return [&t_progress, original_text{t_progress.get_text()},
+          prev_refresh{steady_clock::time_point()}]
+      (const uint64_t downloaded, const uint64_t total) mutable {
+    const auto current_time{steady_clock::now()};
+    if (total == 0U || current_time - prev_refresh < REFRESH_INTERVAL) {
+      return;
+    }
+    prev_refresh = current_time;
+
+    const auto get_size_mb{[] (const uint64_t bytes) {
+      ostringstream oss;
+      oss << fixed << setprecision(1) <<
+          static_cast<double>(bytes) / pow(1024, 2);
+      return oss.str();
+    }};
+    t_progress = static_cast<double>(downloaded * 100U) /
+                 static_cast<double>(total);
+    t_progress = original_text + " (" + get_size_mb(downloaded) +
+                 " / " + get_size_mb(total) + " MB)";
+  };
+}
+
+auto Sdk::fetch_file(const Url& t_url, const string_view t_checksum,
+    const string_view t_subject, MultiProgress::Bar& t_progress) const
+    -> path {
+  const auto original_text{t_progress.get_text()};
+  t_progress.set_determined(true);
+  path blob_path;
+  try {
+    blob_path = m_downloader.fetch(
+        t_url, t_checksum, make_download_callback(t_progress));
+  } catch (const exception& e) {
+    t_progress.finish(false,
+        "Couldn't download " + string(t_subject) + ": " + e.what());
+    return {};
+  }
+
+  // Only an undetermined post-processing (e. g. extraction) remains.
   t_progress.set_determined(false);
-  t_progress = "Calculating checksum";
+  t_progress = original_text;
+  return blob_path;
+}
+
+auto Sdk::download_file(const Url& t_url, const string_view t_checksum,
+    const path& t_output_path, const string_view t_subject,
+    MultiProgress::Bar& t_progress) const -> bool {
+  const auto blob_path{fetch_file(t_url, t_checksum, t_subject, t_progress)};
+  if (blob_path.empty()) {
+    return false;
+  }
 
-  if (Utils::calc_sha256(t_file_path) != t_checksum) {
+  error_code err;
+  replace_file(blob_path, t_output_path, err);
+  if (err) {
     t_progress.finish(false,
-        string(t_failure_msg) + ": invalid checksum. Try to set up SDK again");
+        "Couldn't install " + string(t_subject) + ": " + err.message());
     return false;
   }
   return true;
 }
 
-auto Sdk::check_response_and_sha256(const Response& t_response,
-    const path& t_file_path, const string_view t_checksum,
-    const string_view t_subject, Progress& t_progress) -> bool {
+auto Sdk::download_to_memory(const Url& t_url, const string_view t_checksum,
+    const string_view t_subject, MultiProgress::Bar& t_progress) const
+    -> unique_ptr<TmpFile<>> {
+  const auto failure_msg{"Couldn't download " + string(t_subject)};
+  // Zero if the server doesn't report size.
+  uint64_t size{};
+  if (const auto head{m_http_client.head(t_url)};
+      head.status_code == status::HTTP_OK) {
+    if (const auto iter{head.header.find("content-length")};
+        iter != head.header.cend()) {
+      size = strtoull(iter->second.c_str(), nullptr, 10);
+    }
+  }
+  // Archives, which are too large or which size is unknown, are kept on disk.
+  const auto storage{size != 0U && size <= MAX_MEMORY_ARCHIVE_SIZE ?
+                     TmpFile<>::Storage::MEMORY : TmpFile<>::Storage::DISK};
+
+  unique_ptr<TmpFile<>> file;
+  unique_ptr<Sha256> sha256;
+  try {
+    file = make_unique<TmpFile<>>(ios::binary | ios::trunc, storage);
+    sha256 = make_unique<Sha256>();
+  } catch (const exception& e) {
+    t_progress.finish(false, failure_msg + ": " + e.what());
+    return nullptr;
+  }
+
+  auto& ofs{file->get_stream()};
+  uint64_t written_size{};
+  bool is_oversized{};
+  // Returning false aborts the transfer.
+  const WriteCallback write_callback([&] (const string& data) {
+    written_size += data.size();
+    // Server mustn't exceed the reported size, since memory is limited.
+    if (storage == TmpFile<>::Storage::MEMORY && written_size > size) {
+      is_oversized = true;
+      return false;
+    }
+    ofs.write(data.data(), static_cast<streamsize>(data.size()));
+    return ofs && sha256->update(data.data(), data.size());
+  });
+  const ProgressCallback progress_callback(
+      [callback{make_download_callback(t_progress)}]
+      (const size_t download_total, const size_t downloaded,
+      size_t /* upload_total */, size_t /* uploaded */) {
+    callback(downloaded, download_total);
+    return true;
+  });
+
+  const auto original_text{t_progress.get_text()};
+  t_progress.set_determined(true);
+  const auto response{
+      m_http_client.download(write_callback, t_url, progress_callback)};
+  t_progress.set_determined(false);
+  t_progress = original_text;
+  ofs.close();
+
+  if (is_oversized) {
+    t_progress.finish(false,
+        failure_msg + ": server sent more data than reported");
+    return nullptr;
+  }
+  if (!check_response(response, failure_msg, t_progress)) {
+    return nullptr;
+  }
+  if (!ofs) {
+    t_progress.finish(false, failure_msg + ": failed to write data");
+    return nullptr;
+  }
+  if (sha256->finish() != t_checksum) {
+    t_progress.finish(false, failure_msg + ": invalid checksum");
+    return nullptr;
+  }
+  return file;
+}
+
+auto Sdk::install_zip_entries(const Url& t_url, const string_view t_checksum,
+    const map<string, ZipEntryTarget>& t_entries, const string_view t_subject,
+    MultiProgress::Bar& t_progress) const -> bool {
   const string subject_str(t_subject);
+  // Entries fetched from a remote archive are cached next to its blob.
+  auto entries_dir{m_downloader.get_blob_path(t_checksum)};
+  entries_dir += ENTRIES_DIR_SUFFIX;
+
+  const auto install_cached_entries{[&] {
+    for (const auto& [name, target] : t_entries) {
+      const auto& output_path{target.output_path};
+      error_code err;
+      replace_file(entries_dir / name, output_path, err);
+      if (err) {
+        t_progress.finish(false, "Couldn't install " +
+            output_path.filename().string() + ": " + err.message());
+        return false;
+      }
+    }
+    return true;
+  }};
 
-  if (!check_response(t_response,
-      "Couldn't download " + subject_str, t_progress)) {
+  if (all_of(t_entries.cbegin(), t_entries.cend(), [&entries_dir]
+      (const auto& e) { return exists(entries_dir / e.first); })) {
+    return install_cached_entries();
+  }
+
+  // Keeps an archive downloaded to memory until extraction is done.
+  unique_ptr<TmpFile<>> archive_file;
+  auto archive_path{m_downloader.find(t_checksum)};
+  const bool has_checksums{all_of(t_entries.cbegin(), t_entries.cend(),
+      [] (const auto& e) { return !e.second.sha256.empty(); })};
+
+  if (archive_path.empty() && has_checksums) {
+    t_progress = "Fetching directory of " + subject_str;
+    RemoteZip remote_zip(m_http_client, t_url);
+    if (remote_zip.open()) {
+      return fetch_zip_entries(remote_zip, t_entries,
+                               entries_dir, subject_str, t_progress) &&
+             install_cached_entries();
+    }
+
+    // Server doesn't support range requests, so download entire archive. It
+    // can't be resumed anyway and only some entries are required, so avoid
+    // writing the archive to disk.
+    t_progress = "Downloading " + subject_str;
+    archive_file =
+        download_to_memory(t_url, t_checksum, subject_str, t_progress);
+    if (!archive_file) {
+      return false;
+    }
+    archive_path = archive_file->get_path();
+  } else if (archive_path.empty()) {
+    // Entries can be verified only using checksum of the entire archive.
+    t_progress = "Downloading " + subject_str;
+    archive_path = fetch_file(t_url, t_checksum, subject_str, t_progress);
+    if (archive_path.empty()) {
+      return false;
+    }
+  }
+
+  // Notify about opening, since an archive can be large.
+  t_progress = "Opening archive with " + subject_str;
+  LocalZip zip(archive_path);
+  if (!zip.open()) {
+    t_progress.finish(false, "Couldn't open archive with " + subject_str);
     return false;
   }
-  if (!check_sha256(t_file_path, t_checksum, t_progress,
-      "Couldn't install " + subject_str)) {
+
+  vector<LocalZip::Target> targets;
+  for (const auto& [name, target] : t_entries) {
+    const auto* const entry{zip.get_directory().find(name)};
+    if (entry == nullptr) {
+      t_progress.finish(false, "Couldn't extract " + subject_str +
+                        ": failed to get ZIP entry \"" + name + '"');
+      return false;
+    }
+    targets.emplace_back(entry, target.output_path);
+  }
+  return extract_zip_entries(zip, targets, subject_str, t_progress);
+}
+
+auto Sdk::fetch_zip_entries(const RemoteZip& t_remote_zip,
+    const map<string, ZipEntryTarget>& t_entries, const path& t_output_dir,
+    const string_view t_subject, MultiProgress::Bar& t_progress) -> bool {
+  const auto& directory{t_remote_zip.get_directory()};
+  // Entry, output path and checksum.
+  vector<tuple<const ZipDirectory::Entry*, path, string_view>> entries;
+  uint64_t total_size{};
+
+  for (const auto& [name, target] : t_entries) {
+    const auto* const entry{directory.find(name)};
+    if (entry == nullptr) {
+      t_progress.finish(false, "Couldn't extract " + string(t_subject) +
+                        ": failed to get ZIP entry \"" + name + '"');
+      return false;
+    }
+    entries.emplace_back(entry, t_output_dir / name, target.sha256);
+    total_size += entry->compressed_size;
+  }
+
+  // Checksum of an archive can't be verified if only some parts of it are
+  // fetched. Instead each entry is verified using its checksum from the
+  // manifest: the central directory isn't authenticated, so its CRC-32 only
+  // detects transfer errors.
+  t_progress.set_determined(true);
+  uint64_t fetched_size{};
+  const auto callback{[&] (const size_t fetched_bytes) {
+    fetched_size += fetched_bytes;
+    t_progress = static_cast<double>(fetched_size * 100U) /
+                 static_cast<double>(max<uint64_t>(total_size, 1U));
+  }};
+
+  for (const auto& [entry, output_path, checksum] : entries) {
+    const string name(output_path.filename());
+    // Entry appears in the cache only when it's fetched and verified.
+    auto tmp_path{output_path};
+    tmp_path += ".tmp";
+
+    error_code err;
+    create_directories(output_path.parent_path(), err);
+    ofstream ofs(tmp_path, ios::binary);
+    if (err || !ofs) {
+      t_progress.finish(false, "Couldn't extract " + name +
+          ": failed to open output file \"" + tmp_path.string() + '"');
+      return false;
+    }
+
+    t_progress = "Fetching " + name;
+    try {
+      // Hashed as it's written, so the file isn't read back.
+      Sha256 sha256;
+      t_remote_zip.extract(*entry, ofs, callback, &sha256);
+      ofs.close();
+      if (!ofs) {
+        throw runtime_error("failed to write data");
+      }
+      if (sha256.finish() != checksum) {
+        throw runtime_error("invalid checksum");
+      }
+      rename(tmp_path, output_path);
+    } catch (const exception& e) {
+      remove(tmp_path, err);
+      t_progress.finish(false, "Couldn't extract " + name + ": " + e.what());
+      return false;
+    }
+  }
+  t_progress.set_determined(false);
+  return true;
+}
+
+auto Sdk::extract_zip_entries(const LocalZip& t_zip,
+    const vector<LocalZip::Target>& t_targets, const string_view t_subject,
+    MultiProgress::Bar& t_progress) -> bool {
+  const string subject_str(t_subject);
+  t_progress = "Extracting " + subject_str;
+  t_progress.set_determined(true);
+  t_progress = 0.0;
+
+  size_t extracted{};
+  try {
+    t_zip.extract_all(t_targets, 0U, [&] (const ZipDirectory::Entry&) {
+      t_progress = static_cast<double>(++extracted * 100U) /
+                   static_cast<double>(t_targets.size());
+    });
+  } catch (const exception& e) {
+    t_progress.finish(false,
+        "Couldn't extract " + subject_str + ": " + e.what());
     return false;
   }
+  t_progress.set_determined(false);
   return true;
 }
 
-auto Sdk::extract_zip_entry(const ZipEntry& t_entry, const path& t_output_path,
-    const string_view t_name, Progress& t_progress) -> bool {
-  const string name_str(t_name);
+auto Sdk::unpack_bundle(const path& t_source, const path& t_output_dir,
+                        MultiProgress::Bar& t_progress) -> bool {
+  // Bundle could be crafted, so don't let it write outside of the root.
+  const auto is_safe_path{[] (const path& file_path) {
+    return !file_path.empty() && file_path.is_relative() &&
+           find(file_path.begin(), file_path.end(), path("..")) ==
+           file_path.end();
+  }};
 
-  ofstream ofs(t_output_path, ios::binary);
-  if (!ofs) {
-    t_progress.finish(false, "Couldn't extract " + name_str +
-        ": failed to open output file \"" + t_output_path.string() + '"');
+  const auto ledger_path{t_output_dir / LEDGER_FILE_NAME};
+  error_code err;
+  if (is_directory(t_source, err)) {
+    copy_file(t_source / LEDGER_FILE_NAME, ledger_path,
+              copy_options::overwrite_existing, err);
+    if (err) {
+      t_progress.finish(false,
+          "Couldn't copy the ledger of mirror (" + err.message() + ')');
+      return false;
+    }
+
+    t_progress = "Copying SDK files";
+    t_progress.set_determined(true);
+    t_progress = 0.0;
+    const auto files{Ledger(ledger_path).get_files()};
+    for (const auto& f : files) {
+      if (!is_safe_path(f)) {
+        t_progress.finish(false, "Mirror contains invalid path " + f.string());
+        return false;
+      }
+      create_directories((t_output_dir / f).parent_path(), err);
+      if (err) {
+        t_progress.finish(false, "Couldn't create directory for " +
+                          f.string() + " (" + err.message() + ')');
+        return false;
+      }
+    }
+
+    // Files are copied concurrently, as entries of a bundle are extracted.
+    // Following variables are guarded by the mutex.
+    mutex progress_mutex;
+    size_t copied_count{};
+    string error_msg;
+
+    atomic_size_t next_index{};
+    const auto copy_files{[&] {
+      for (auto i{next_index++}; i < files.size(); i = next_index++) {
+        const auto& file_path{files[i]};
+        error_code copy_err;
+        replace_file(t_source / file_path, t_output_dir / file_path, copy_err);
+
+        const lock_guard lock(progress_mutex);
+        if (copy_err) {
+          if (error_msg.empty()) {
+            error_msg = "Couldn't copy " + file_path.string() +
+                        " (" + copy_err.message() + ')';
+          }
+          // Stop other threads.
+          next_index = files.size();
+          return;
+        }
+        t_progress = static_cast<double>(++copied_count * 100U) /
+                     static_cast<double>(files.size());
+      }
+    }};
+
+    const auto threads_count{min<size_t>(
+        max(thread::hardware_concurrency(), 1U), files.size())};
+    vector<future<void>> results;
+    for (size_t t{}; t != threads_count; ++t) {
+      results.push_back(async(launch::async, copy_files));
+    }
+    for (auto& r : results) {
+      r.get();
+    }
+    if (!error_msg.empty()) {
+      t_progress.finish(false, error_msg);
+      return false;
+    }
+    t_progress.set_determined(false);
+    return true;
+  }
+
+  LocalZip zip(t_source);
+  if (!zip.open()) {
+    t_progress.finish(false, "Couldn't open SDK bundle");
     return false;
   }
+  const auto& directory{zip.get_directory()};
+  vector<LocalZip::Target> targets;
+  try {
+    const auto* const ledger_entry{directory.find(LEDGER_FILE_NAME)};
+    if (ledger_entry == nullptr) {
+      throw runtime_error("the ledger is missing");
+    }
+    zip.extract(*ledger_entry, ledger_path);
+
+    // Only recorded files are extracted, since others can't be verified.
+    for (const auto& f : Ledger(ledger_path).get_files()) {
+      const auto* const entry{directory.find(f.generic_string())};
+      if (entry == nullptr || !is_safe_path(f)) {
+        throw runtime_error("invalid entry " + f.string());
+      }
+      const auto output_path{t_output_dir / f};
+      create_directories(output_path.parent_path());
+      targets.emplace_back(entry, output_path);
+    }
+  } catch (const exception& e) {
+    t_progress.finish(false, "Couldn't read SDK bundle: "s + e.what());
+    return false;
+  }
+  return extract_zip_entries(zip, targets, "SDK files", t_progress);
+}
+
+void Sdk::deduplicate(Ledger& t_ledger) const {
+  uintmax_t saved_size{};
+  vector<path> replaced_paths;
+  error_code err;
+
+  for (const auto& group : t_ledger.find_duplicates()) {
+    const auto source_path{m_root_dir_path / group.front()};
+    for (auto iter{next(group.cbegin())}; iter != group.cend(); ++iter) {
+      const auto target_path{m_root_dir_path / *iter};
+      // Skip files, which are already hard links to the source.
+      if (equivalent(source_path, target_path, err) || err) {
+        continue;
+      }
+      const auto size{file_size(target_path, err)};
+      if (!err && share_file(source_path, target_path)) {
+        saved_size += size;
+        replaced_paths.push_back(*iter);
+      }
+    }
+  }
+  if (replaced_paths.empty()) {
+    return;
+  }
+
+  // Replaced files have modification time of the source or a new one.
+  t_ledger.refresh_metadata(replaced_paths);
+  ostringstream oss;
+  oss << fixed << setprecision(1) <<
+         static_cast<double>(saved_size) / pow(1024, 2);
+  cout << "Identical files deduplicated, " << oss.str() <<
+          " MB saved." << endl;
+}
+
+auto Sdk::share_file(const path& t_source, const path& t_target) -> bool {
+  auto tmp_path{t_target};
+  tmp_path += ".tmp";
+  error_code err;
+  remove(tmp_path, err);
+
+  create_hard_link(t_source, tmp_path, err);
+  if (err) {
+    // Hard links can be unsupported or limited, so try to share data on disk.
+    const int source_fd{::open(t_source.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (source_fd == -1) {
+      return false;
+    }
+    const ScopeGuard source_fd_guard([source_fd] { close(source_fd); });
+    struct stat st{};
+    if (fstat(source_fd, &st) == -1) {
+      return false;
+    }
 
-  t_progress = "Extracting " + name_str;
-  if (const auto status{t_entry.readContent(ofs)}; status != LIBZIPPP_OK) {
-    t_progress.finish(false, Text::format_copy("Couldn't extract " + name_str +
-        ". libzippp return code: <b>" + to_string(status) + "<r>"));
+    const int target_fd{::open(tmp_path.c_str(),
+        O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777U)};
+    if (target_fd == -1) {
+      return false;
+    }
+    const bool cloned{ioctl(target_fd, FICLONE, source_fd) == 0};
+    close(target_fd);
+    if (!cloned) {
+      remove(tmp_path, err);
+      return false;
+    }
+  }
+
+  rename(tmp_path, t_target, err);
+  if (err) {
+    remove(tmp_path, err);
     return false;
   }
   return true;
 }
 
+void Sdk::replace_file(const path& t_from, const path& t_to,
+                       error_code& t_err) {
+  // Removing of a missing file isn't an error.
+  remove(t_to, t_err);
+  if (!t_err) {
+    copy_file(t_from, t_to, t_err);
+  }
+}
+
+auto Sdk::make_verify_callback(MultiProgress::Bar& t_progress)
+    -> function<void (uintmax_t, uintmax_t)> {
+  using namespace chrono;
+  using namespace chrono_literals;
+
+  // Since the callback is called too often, we need
+  // to limit how often to update the progress bar.
+  constexpr auto REFRESH_INTERVAL{100ms};
+
+  return [&t_progress, REFRESH_INTERVAL,
+          prev_refresh = steady_clock::time_point()]
+         (const uintmax_t verified, const uintmax_t total) mutable {
+    const auto current_time{steady_clock::now()};
+    if (total == 0U || current_time - prev_refresh < REFRESH_INTERVAL) {
+      return;
+    }
+    prev_refresh = current_time;
+    t_progress = static_cast<double>(verified * 100U) /
+                 static_cast<double>(total);
+  };
+}
+
 // ------- +
 // Getters |
 // ------- +
 
-auto Sdk::get_tool_path(const Tool t_tool,
-                        const bool t_must_exist) const -> path {
-  const EnumArray<Tool, string> names{
-    "aapt2", "zipalign"
-  };
+auto Sdk::get_installed_apis() const -> set<unsigned short> {
+  set<unsigned short> apis;
+  error_code err;
+  for (const auto* const store : {&m_root_dir_path, &m_system_dir_path}) {
+    if (store->empty()) {
+      continue;
+    }
+    for (const auto& e : directory_iterator(*store, err)) {
+      const auto name{e.path().filename().string()};
+      if (name.rfind(API_DIR_PREFIX, 0U) != 0U) {
+        continue;
+      }
+      const auto api_str{name.substr(API_DIR_PREFIX.length())};
+      char* api_str_end{};
+      const auto api{strtoul(api_str.c_str(), &api_str_end, 10)};
+      if (*api_str_end != '\0' || api == 0U ||
+          api > numeric_limits<unsigned short>::max()) {
+        continue;
+      }
+      // Skip partially installed APIs.
+      if (find_api_store(api_str) != nullptr) {
+        apis.emplace(api);
+      }
+    }
+  }
+  return apis;
+}
+
+void Sdk::adopt_legacy_files(const unsigned short t_api) {
+  const auto legacy_tools_dir{m_root_dir_path / TOOLS_SUBDIR_NAME};
+  error_code err;
+  if (!is_directory(legacy_tools_dir, err)) {
+    return;
+  }
+
+  const auto api_str{to_string(t_api)};
+  const auto api_dir{get_api_dir(api_str)};
+  create_directories(api_dir / JARS_SUBDIR_NAME, err);
+  rename(legacy_tools_dir, api_dir / TOOLS_SUBDIR_NAME, err);
+  for (size_t j{}; j != size<Jar>(); ++j) {
+    const auto jar{static_cast<Jar>(j)};
+    const auto legacy_path{make_jar_path(jar, {})};
+    if (const auto path{make_jar_path(jar, api_str)}; path != legacy_path) {
+      rename(legacy_path, path, err);
+    }
+  }
+
+  if (const auto apis{get_installed_apis()}; !apis.empty()) {
+    m_api = *apis.crbegin();
+  }
+}
 
-  const auto path{m_root_dir_path / TOOLS_SUBDIR_NAME / names.get(t_tool)};
+auto Sdk::get_tool_path(const Tool t_tool, const bool t_must_exist,
+                        const unsigned short t_api) const -> path {
+  const auto api_str{to_string(t_api == 0U ? m_api : t_api)};
+  const auto* const store{find_api_store(api_str)};
+  const auto path{rebase(make_tool_path(t_tool, api_str),
+                         store == nullptr ? m_root_dir_path : *store)};
   if (t_must_exist) {
     error_code err;
     if (!is_regular_file(path, err)) {
@@ -756,12 +1578,14 @@ auto Sdk::get_tool_path(const Tool t_tool,
   return path;
 }
 
-auto Sdk::get_jar_path(const Jar t_jar, const bool t_must_exist) const -> path {
-  const EnumArray<Jar, string> names{
-    "apm-jni.jar", "apksigner.jar", "d8.jar", "android.jar"
-  };
-
-  const auto path{m_root_dir_path / JARS_SUBDIR_NAME / names.get(t_jar)};
+auto Sdk::get_jar_path(const Jar t_jar, const bool t_must_exist,
+                       const unsigned short t_api) const -> path {
+  const auto api_str{to_string(t_api == 0U ? m_api : t_api)};
+  const auto* const store{find_api_store(api_str)};
+  const auto jar_path{make_jar_path(t_jar, api_str)};
+  // Shared JAR file doesn't depend on store of API.
+  const auto path{t_jar == Jar::APM_JNI ? resolve_shared(jar_path) :
+      rebase(jar_path, store == nullptr ? m_root_dir_path : *store)};
   if (t_must_exist) {
     error_code err;
     if (!is_regular_file(path, err)) {
@@ -773,11 +1597,7 @@ auto Sdk::get_jar_path(const Jar t_jar, const bool t_must_exist) const -> path {
 
 auto Sdk::get_file_path(const File t_file,
                         const bool t_must_exist) const -> path {
-  const EnumArray<File, string> names{
-    "debug.jks", "project-template.zip", "tzdata"
-  };
-
-  const auto path{m_root_dir_path / names.get(t_file)};
+  const auto path{resolve_shared(make_file_path(t_file))};
   if (t_must_exist) {
     error_code err;
     if (!is_regular_file(path, err)) {
@@ -786,3 +1606,82 @@ auto Sdk::get_file_path(const File t_file,
   }
   return path;
 }
+
+auto Sdk::find_api_store(const string_view t_api) const -> const path* {
+  const auto is_complete{[&] (const path& store) {
+    error_code err;
+    for (size_t t{}; t != size<Tool>(); ++t) {
+      if (!is_regular_file(rebase(
+          make_tool_path(static_cast<Tool>(t), t_api), store), err)) {
+        return false;
+      }
+    }
+    for (size_t j{}; j != size<Jar>(); ++j) {
+      const auto jar{static_cast<Jar>(j)};
+      const auto jar_path{make_jar_path(jar, t_api)};
+      // Shared JAR file can be located in any store.
+      if (!is_regular_file(jar == Jar::APM_JNI ? resolve_shared(jar_path) :
+                           rebase(jar_path, store), err)) {
+        return false;
+      }
+    }
+    return true;
+  }};
+
+  if (is_complete(m_root_dir_path)) {
+    return &m_root_dir_path;
+  }
+  if (!m_system_dir_path.empty() && is_complete(m_system_dir_path)) {
+    return &m_system_dir_path;
+  }
+  return nullptr;
+}
+
+auto Sdk::resolve_shared(const path& t_path) const -> path {
+  error_code err;
+  if (m_system_dir_path.empty() || exists(t_path, err)) {
+    return t_path;
+  }
+  auto system_path{rebase(t_path, m_system_dir_path)};
+  return exists(system_path, err) ? system_path : t_path;
+}
+
+auto Sdk::rebase(const path& t_path, const path& t_dir) const -> path {
+  if (t_dir == m_root_dir_path) {
+    return t_path;
+  }
+  return t_dir / t_path.lexically_relative(m_root_dir_path);
+}
+
+auto Sdk::get_api_dir(const string_view t_api) const -> path {
+  // Legacy layout hasn't directories for API versions.
+  if (t_api.empty()) {
+    return m_root_dir_path;
+  }
+  return m_root_dir_path / (string(API_DIR_PREFIX) + string(t_api));
+}
+
+auto Sdk::make_tool_path(const Tool t_tool, const string_view t_api) const
+    -> path {
+  const EnumArray<Tool, string> names{
+    "aapt2", "zipalign"
+  };
+  return get_api_dir(t_api) / TOOLS_SUBDIR_NAME / names.get(t_tool);
+}
+
+auto Sdk::make_jar_path(const Jar t_jar, const string_view t_api) const
+    -> path {
+  const EnumArray<Jar, string> names{
+    "apm-jni.jar", "apksigner.jar", "d8.jar", "android.jar"
+  };
+  // apm-jni.jar doesn't depend on API, so it's shared between versions.
+  const auto dir{t_jar == Jar::APM_JNI ? m_root_dir_path : get_api_dir(t_api)};
+  return dir / JARS_SUBDIR_NAME / names.get(t_jar);
+}
+
+auto Sdk::make_file_path(const File t_file) const -> path {
+  const EnumArray<File, string> names{
+    "debug.jks", "project-template.zip", "tzdata"
+  };
+  return m_root_dir_path / names.get(t_file);
+}
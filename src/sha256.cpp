@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <array>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "sha256.hpp"
+
+using namespace std;
+
+Sha256::Sha256(): m_ctx(EVP_MD_CTX_new()) {
+  if (!m_ctx) {
+    throw runtime_error("failed to allocate a digest context");
+  }
+  if (!init()) {
+    throw runtime_error("failed to initialize a digest context");
+  }
+}
+
+auto Sha256::update(const void* const t_data, const size_t t_size) -> bool {
+  return EVP_DigestUpdate(m_ctx.get(), t_data, t_size) == 1;
+}
+
+auto Sha256::finish() -> string {
+  array<unsigned char, EVP_MAX_MD_SIZE> hash{};
+  unsigned hash_size{};
+
+  if (EVP_DigestFinal_ex(m_ctx.get(), hash.data(), &hash_size) != 1 ||
+      !init()) {
+    return {};
+  }
+
+  ostringstream result_oss;
+  result_oss << hex << setfill('0');
+  for (unsigned i{}; i != hash_size; ++i) {
+    result_oss << setw(2) << static_cast<unsigned short>(hash.at(i));
+  }
+  return result_oss.str();
+}
+
+auto Sha256::init() -> bool {
+  return EVP_DigestInit_ex(m_ctx.get(), EVP_sha256(), nullptr) == 1;
+}
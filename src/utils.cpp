@@ -7,29 +7,31 @@
 #include <algorithm>
 #include <array>
 #include <cctype>
-#include <chrono>
-#include <cmath>
-#include <iomanip>
-#include <sstream>
+#include <cerrno>
+#include <cstdlib>
 #include <stdexcept>
+#include <system_error>
 #include <utility>
+#include <vector>
 
-#include <cpr/api.h>
-#include <cpr/callback.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <fcli/terminal.hpp>
 #include <fcli/text.hpp>
 
-#include <openssl/sha.h>
-#include <pstreams/pstream.h>
-
 #include "general/scope_guard.hpp"
+#include "process_manager.hpp"
+#include "sha256.hpp"
 #include "utils.hpp"
 
 using namespace std;
 using namespace filesystem;
 
-using namespace cpr;
 using namespace fcli;
 using namespace fcli::literals;
 
@@ -104,193 +106,196 @@ auto Utils::check_cin() -> bool {
   return false;
 }
 
-auto Utils::download(ofstream& t_ofs, const Url& t_url,
-    Progress& t_progress, const bool t_append_size) -> Response {
-  using namespace chrono;
-  using namespace chrono_literals;
-
-  // Since the progress callback calls too often, we need
-  // to limit how often to update the progress bar.
-  constexpr auto REFRESH_INTERVAL{100ms};
-  time_point<steady_clock>
-      prev_refresh,
-      current_time;
-
-  const auto original_text{t_progress.get_text()};
-  // Will contain the total file size (if progress is determined).
-  string size_postfix;
-
-  ostringstream size_oss;
-  size_oss << fixed;
-  size_oss.precision(1);
-
-  const auto get_size_mb{[&size_oss] (const size_t bytes) {
-    size_oss.str({});
-    size_oss << static_cast<double>(bytes) / pow(1024, 2);
-    return size_oss.str();
-  }};
-
-  const ProgressCallback progress_callback([&]
-      (const size_t download_total, const size_t downloaded,
-      size_t /* upload_total */, size_t /* uploaded */) {
-    if (download_total == 0U) {
-      return true;
-    }
-
-    current_time = steady_clock::now();
-    if (current_time - prev_refresh < REFRESH_INTERVAL) {
-      return true;
-    }
-    prev_refresh = current_time;
+auto Utils::calc_sha256(const path& t_path) -> string {
+  // Used if the file can't be mapped (e. g. it's a pipe).
+  constexpr size_t BUFFER_SIZE{1U << 20U};
 
-    if (t_progress.is_determined()) {
-      t_progress = static_cast<double>(downloaded * 100U) /
-                   static_cast<double>(download_total);
+  const int fd{open(t_path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd == -1) {
+    return {};
+  }
+  const ScopeGuard fd_guard([fd] { close(fd); });
+
+  try {
+    Sha256 sha256;
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      const auto size{static_cast<size_t>(st.st_size)};
+      // Mapping avoids copying of data from the page cache.
+      void* const data{mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+      if (data != MAP_FAILED) {
+        const ScopeGuard map_guard([data, size] { munmap(data, size); });
+        // Let the kernel read ahead aggressively.
+        madvise(data, size, MADV_SEQUENTIAL);
+        madvise(data, size, MADV_WILLNEED);
+        return sha256.update(data, size) ? sha256.finish() : string();
+      }
     }
 
-    if (!t_append_size) {
-      return true;
-    }
-    if (t_progress.is_determined()) {
-      if (size_postfix.empty()) {
-        size_postfix = " / " + get_size_mb(download_total) + " MB)";
+    vector<char> buf(BUFFER_SIZE);
+    for (;;) {
+      const auto result{read(fd, buf.data(), buf.size())};
+      if (result == 0) {
+        break;
+      }
+      if (result == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return {};
+      }
+      if (!sha256.update(buf.data(), static_cast<size_t>(result))) {
+        return {};
       }
-      t_progress =
-          original_text + " (" + get_size_mb(downloaded) + size_postfix;
-    } else {
-      t_progress = original_text + " (" + get_size_mb(downloaded) + " MB)";
     }
-    return true;
-  });
-
-  const auto response{Download(t_ofs, t_url, progress_callback)};
-  if (t_append_size) {
-    t_progress = original_text;
+    return sha256.finish();
+  } catch (const runtime_error&) {
+    return {};
   }
-  return response;
 }
 
-auto Utils::calc_sha256(const path& t_path) -> string {
-  constexpr size_t BUFFER_SIZE{1U << 13U};
+auto Utils::copy_file(const path& t_from, const path& t_to) -> bool {
+  constexpr size_t BUFFER_SIZE{1U << 20U};
+  error_code err;
 
-  ifstream ifs(t_path, ios::binary);
-  if (!ifs) {
-    return {};
+  const int in_fd{open(t_from.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (in_fd == -1) {
+    return false;
   }
-
-  SHA256_CTX context;
-  if (SHA256_Init(&context) != 1) {
-    return {};
+  const ScopeGuard in_fd_guard([in_fd] { close(in_fd); });
+  struct stat st{};
+  if (fstat(in_fd, &st) == -1) {
+    return false;
   }
 
-  array<char, BUFFER_SIZE> buf{};
-  do {
-    ifs.read(buf.data(), buf.size());
-    if (SHA256_Update(&context, buf.data(),
-        static_cast<unsigned long>(ifs.gcount())) != 1) {
-      return {};
+  // Skipping rewriting keeps the page cache of the target. Modification time
+  // of the source is assigned to copies, so usually hashing isn't required.
+  if (struct stat target_st{}; stat(t_to.c_str(), &target_st) == 0 &&
+      target_st.st_size == st.st_size) {
+    if (target_st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+        target_st.st_mtim.tv_nsec == st.st_mtim.tv_nsec) {
+      return true;
+    }
+    const auto hash{calc_sha256(t_from)};
+    if (!hash.empty() && calc_sha256(t_to) == hash) {
+      const array<timespec, 2U> times{timespec{0, UTIME_OMIT}, st.st_mtim};
+      // It's only an optimization for the next call.
+      utimensat(AT_FDCWD, t_to.c_str(), times.data(), 0);
+      return true;
     }
-  } while (ifs);
-
-  array<unsigned char, SHA256_DIGEST_LENGTH> hash{};
-  if (SHA256_Final(hash.data(), &context) != 1) {
-    return {};
-  }
-
-  ostringstream result_oss;
-  result_oss << hex << setfill('0');
-  for (const auto& c : hash) {
-    result_oss << setw(2) << static_cast<unsigned short>(c);
   }
-  return result_oss.str();
-}
 
-auto Utils::exec(const vector<string>& t_cmd,
-                 const function<output_callback_t>& t_out_callback,
-                 const function<output_callback_t>& t_err_callback,
-                 const directory_entry& t_work_dir) -> int {
-  using namespace redi;
-  constexpr size_t OUTPUT_BUFFER_SIZE{512U};
-
-  ScopeGuard work_path_guard;
-  if (!t_work_dir.path().empty()) {
-    auto prev_work_path{current_path()};
-    current_path(t_work_dir);
-    work_path_guard = [path = move(prev_work_path)] { current_path(path); };
+  // Replace the file atomically, so it won't be left half-written. Name is
+  // unique, so concurrent copies to the same target don't clash.
+  string tmp_path{(t_to.parent_path() /
+      ('.' + t_to.filename().string() + ".XXXXXX")).string()};
+  int out_fd{mkostemp(tmp_path.data(), O_CLOEXEC)};
+  if (out_fd == -1) {
+    return false;
   }
-
-  ipstream ips(t_cmd, pstreams::pstdout | pstreams::pstderr);
-  if (!ips.is_open()) {
-    throw runtime_error("failed to start a process");
+  bool is_copied{};
+  const ScopeGuard out_fd_guard([&out_fd, &tmp_path, &is_copied] {
+    if (out_fd != -1) {
+      close(out_fd);
+    }
+    if (!is_copied) {
+      unlink(tmp_path.c_str());
+    }
+  });
+  if (fchmod(out_fd, st.st_mode & 0777U) == -1) {
+    return false;
   }
 
-  if (t_out_callback || t_err_callback) {
-    // These variables determine whether EOF of a stream has been reached.
-    // Initializer excludes a stream which output isn't required.
-    auto
-        out_finished{!t_out_callback},
-        err_finished{!t_err_callback};
-    string out, err;
-
-    array<char, OUTPUT_BUFFER_SIZE> buf{};
-    streamsize extracted_chars_count{};
-    bool process_extracted_chars{};
-
-    const auto process_stream{[&] (ipstream& stream, bool& finished,
-        string& output, const function<output_callback_t>& callback) {
-      if (finished) {
-        return;
+  const auto copy_data{[in_fd, out_fd, &st] {
+#ifdef FICLONE
+    // Extents are shared, so nothing is copied.
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+      return true;
+    }
+#endif
+    // Limits size of a single call for 32-bit systems.
+    constexpr uint64_t MAX_COPY_SIZE{1U << 30U};
+    auto remaining_size{static_cast<uint64_t>(st.st_size)};
+    while (remaining_size != 0U) {
+      const auto result{copy_file_range(in_fd, nullptr, out_fd, nullptr,
+          static_cast<size_t>(min(remaining_size, MAX_COPY_SIZE)), 0U)};
+      if (result > 0) {
+        remaining_size -= static_cast<uint64_t>(result);
+        continue;
       }
-
-      // Read output in a non-blocking way.
-      while ((extracted_chars_count =
-              stream.readsome(buf.data(), buf.size())) > 0) {
-        output += string(buf.cbegin(), buf.cbegin() + extracted_chars_count);
-        process_extracted_chars = true;
+      if (result == 0) {
+        // The source is truncated.
+        return false;
       }
-
-      if (process_extracted_chars) {
-        process_extracted_chars = false;
-        size_t new_line_pos{};
-        while ((new_line_pos = output.find('\n')) != string::npos) {
-          callback(output.substr(0U, new_line_pos));
-          output.erase(0U, new_line_pos + 1U);
-        }
+      if (errno == EINTR) {
+        continue;
+      }
+      // Not supported by the kernel or between these file systems.
+      if (errno != ENOSYS && errno != EXDEV &&
+          errno != EINVAL && errno != EOPNOTSUPP) {
+        return false;
       }
 
-      if (ips.eof()) {
-        // Clear eofbit.
-        ips.clear();
-        finished = true;
-        if (!output.empty()) {
-          callback(output);
+      vector<char> buf(BUFFER_SIZE);
+      for (;;) {
+        auto result_size{read(in_fd, buf.data(), buf.size())};
+        if (result_size == 0) {
+          return true;
+        }
+        if (result_size == -1) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return false;
+        }
+        for (const char* data{buf.data()}; result_size != 0;) {
+          const auto written{write(out_fd, data,
+                                   static_cast<size_t>(result_size))};
+          if (written == -1) {
+            if (errno == EINTR) {
+              continue;
+            }
+            return false;
+          }
+          data += written;
+          result_size -= written;
         }
       }
-    }};
-
-    do {
-      // By calling the out and err functions
-      // we switch between the stream buffers.
-      process_stream(ips.out(), out_finished, out, t_out_callback);
-      process_stream(ips.err(), err_finished, err, t_err_callback);
-    } while (!(out_finished && err_finished));
-  }
-
-  // Wait in a blocking way until eofbit of the streams will be set,
-  // since calling only the close function may lead to an error.
-  if (!t_out_callback) {
-    ips.out().ignore(numeric_limits<streamsize>::max());
+    }
+    return true;
+  }};
+  if (!copy_data()) {
+    return false;
   }
-  if (!t_err_callback) {
-    ips.err().ignore(numeric_limits<streamsize>::max());
+  const array<timespec, 2U> times{timespec{0, UTIME_OMIT}, st.st_mtim};
+  if (futimens(out_fd, times.data()) == -1) {
+    return false;
   }
 
-  ips.close();
-  auto* const buf{ips.rdbuf()};
-  if (!buf->exited()) {
-    throw runtime_error("a process isn't exited");
+  // Errors of delayed writing can be reported only on closing.
+  const int result{close(out_fd)};
+  out_fd = -1;
+  if (result == -1) {
+    return false;
   }
-  return buf->status();
+  rename(tmp_path, t_to, err);
+  is_copied = !err;
+  return is_copied;
+}
+
+auto Utils::exec(const vector<string>& t_cmd,
+                 const function<output_callback_t>& t_out_callback,
+                 const function<output_callback_t>& t_err_callback,
+                 const directory_entry& t_work_dir) -> int {
+  ProcessManager::Command command;
+  command.args = t_cmd;
+  command.out_callback = t_out_callback;
+  command.err_callback = t_err_callback;
+  command.work_dir = t_work_dir.path();
+
+  ProcessManager manager;
+  manager.start(move(command));
+  return manager.wait().front().exit_code;
 }
 
 auto Utils::get_term_width(
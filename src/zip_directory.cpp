@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <stdexcept>
+#include "zip_directory.hpp"
+
+using namespace std;
+
+namespace {
+  constexpr uint32_t
+      EOCD_SIGNATURE{0x06054b50U},
+      ZIP64_EOCD_SIGNATURE{0x06064b50U},
+      ZIP64_LOCATOR_SIGNATURE{0x07064b50U},
+      CENTRAL_HEADER_SIGNATURE{0x02014b50U},
+      LOCAL_HEADER_SIGNATURE{0x04034b50U};
+
+  constexpr size_t
+      ZIP64_LOCATOR_SIZE{20U},
+      ZIP64_EOCD_SIZE{56U},
+      CENTRAL_HEADER_SIZE{46U};
+
+  // Values of 32-bit fields that indicate presence of the ZIP64 extensions.
+  constexpr uint16_t ZIP64_MARKER_16{UINT16_MAX};
+  constexpr uint32_t ZIP64_MARKER_32{UINT32_MAX};
+  constexpr uint16_t ZIP64_EXTRA_ID{0x0001U};
+}
+
+ZipDirectory::ZipDirectory(const string_view t_data) {
+  size_t pos{};
+  while (pos != t_data.size()) {
+    if (read_le<uint32_t>(t_data, pos) != CENTRAL_HEADER_SIGNATURE) {
+      throw runtime_error("invalid signature of central directory header");
+    }
+
+    Entry entry;
+    entry.version_made_by = read_le<uint16_t>(t_data, pos + 4U);
+    entry.flags = read_le<uint16_t>(t_data, pos + 8U);
+    entry.method = static_cast<Method>(read_le<uint16_t>(t_data, pos + 10U));
+    entry.mod_time = read_le<uint16_t>(t_data, pos + 12U);
+    entry.mod_date = read_le<uint16_t>(t_data, pos + 14U);
+    entry.crc32 = read_le<uint32_t>(t_data, pos + 16U);
+    entry.compressed_size = read_le<uint32_t>(t_data, pos + 20U);
+    entry.uncompressed_size = read_le<uint32_t>(t_data, pos + 24U);
+    entry.external_attrs = read_le<uint32_t>(t_data, pos + 38U);
+    entry.local_header_offset = read_le<uint32_t>(t_data, pos + 42U);
+
+    const auto
+        name_len{read_le<uint16_t>(t_data, pos + 28U)},
+        extra_len{read_le<uint16_t>(t_data, pos + 30U)},
+        comment_len{read_le<uint16_t>(t_data, pos + 32U)};
+    pos += CENTRAL_HEADER_SIZE;
+
+    if (t_data.size() - pos < static_cast<size_t>(name_len) +
+        extra_len + comment_len) {
+      throw runtime_error("unexpected end of central directory");
+    }
+    entry.name = t_data.substr(pos, name_len);
+    pos += name_len;
+
+    // Search for the ZIP64 extended information.
+    const auto extra{t_data.substr(pos, extra_len)};
+    for (size_t e{}; e + 4U <= extra.size();) {
+      const auto
+          id{read_le<uint16_t>(extra, e)},
+          size{read_le<uint16_t>(extra, e + 2U)};
+      e += 4U;
+
+      if (id == ZIP64_EXTRA_ID) {
+        // Fields present only if the corresponding values are masked.
+        size_t field{e};
+        for (auto* const v : {&entry.uncompressed_size,
+             &entry.compressed_size, &entry.local_header_offset}) {
+          if (*v == ZIP64_MARKER_32) {
+            *v = read_le<uint64_t>(extra, field);
+            field += sizeof(uint64_t);
+          }
+        }
+        break;
+      }
+      e += size;
+    }
+    pos += static_cast<size_t>(extra_len) + comment_len;
+
+    m_indexes.emplace(entry.name, m_entries.size());
+    m_entries.push_back(move(entry));
+  }
+}
+
+auto ZipDirectory::find_location(
+    const string_view t_tail, const uint64_t t_tail_offset) -> Location {
+  if (t_tail.size() < EOCD_SIZE) {
+    throw runtime_error("archive is too small");
+  }
+
+  // Comment has variable length, so search from the end. Some
+  // archivers append data after the comment, so allow it too.
+  auto eocd_pos{t_tail.size() - EOCD_SIZE};
+  while (true) {
+    if (read_le<uint32_t>(t_tail, eocd_pos) == EOCD_SIGNATURE &&
+        eocd_pos + EOCD_SIZE + read_le<uint16_t>(t_tail, eocd_pos + 20U) <=
+        t_tail.size()) {
+      break;
+    }
+    if (eocd_pos == 0U) {
+      throw runtime_error("end of central directory record not found");
+    }
+    --eocd_pos;
+  }
+
+  Location location{
+    read_le<uint32_t>(t_tail, eocd_pos + 16U),
+    read_le<uint32_t>(t_tail, eocd_pos + 12U),
+    read_le<uint16_t>(t_tail, eocd_pos + 10U)
+  };
+
+  if (location.offset == ZIP64_MARKER_32 || location.size == ZIP64_MARKER_32 ||
+      location.entries_count == ZIP64_MARKER_16) {
+    if (eocd_pos < ZIP64_LOCATOR_SIZE) {
+      throw runtime_error("ZIP64 end of central directory locator not found");
+    }
+    const auto locator_pos{eocd_pos - ZIP64_LOCATOR_SIZE};
+    if (read_le<uint32_t>(t_tail, locator_pos) != ZIP64_LOCATOR_SIGNATURE) {
+      throw runtime_error("invalid signature of ZIP64 locator");
+    }
+
+    const auto record_offset{read_le<uint64_t>(t_tail, locator_pos + 8U)};
+    if (record_offset < t_tail_offset ||
+        record_offset - t_tail_offset + ZIP64_EOCD_SIZE > locator_pos) {
+      throw runtime_error("ZIP64 end of central directory is out of range");
+    }
+    const auto record_pos{static_cast<size_t>(record_offset - t_tail_offset)};
+    if (read_le<uint32_t>(t_tail, record_pos) != ZIP64_EOCD_SIGNATURE) {
+      throw runtime_error("invalid signature of ZIP64 record");
+    }
+
+    location.entries_count = read_le<uint64_t>(t_tail, record_pos + 32U);
+    location.size = read_le<uint64_t>(t_tail, record_pos + 40U);
+    location.offset = read_le<uint64_t>(t_tail, record_pos + 48U);
+  }
+  return location;
+}
+
+auto ZipDirectory::get_local_header_size(const string_view t_header) -> size_t {
+  if (read_le<uint32_t>(t_header, 0U) != LOCAL_HEADER_SIGNATURE) {
+    throw runtime_error("invalid signature of local file header");
+  }
+  return LOCAL_HEADER_SIZE + read_le<uint16_t>(t_header, 26U) +
+         read_le<uint16_t>(t_header, 28U);
+}
+
+auto ZipDirectory::find(const string_view t_name) const -> const Entry* {
+  const auto iter{m_indexes.find(t_name)};
+  if (iter == m_indexes.cend()) {
+    return nullptr;
+  }
+  return &m_entries.at(iter->second);
+}
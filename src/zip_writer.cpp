@@ -0,0 +1,798 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "general/scope_guard.hpp"
+#include "zip_writer.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+namespace {
+  constexpr uint32_t
+      EOCD_SIGNATURE{0x06054b50U},
+      CENTRAL_HEADER_SIGNATURE{0x02014b50U},
+      LOCAL_HEADER_SIGNATURE{0x04034b50U};
+
+  constexpr uint16_t
+      // Version 1.0 is enough to extract stored files.
+      STORED_VERSION_NEEDED{10U},
+      // Version 2.0 introduced deflating.
+      DEFLATED_VERSION_NEEDED{20U},
+      UNIX_HOST{3U},
+      // High byte is Unix, low one is the specification version 2.0.
+      VERSION_MADE_BY{(UNIX_HOST << 8U) | 20U},
+      // Names are encoded using UTF-8.
+      UTF8_FLAG{1U << 11U},
+      // Bits 1 and 2 are options of deflating.
+      MAXIMUM_DEFLATING_FLAG{1U << 1U},
+      FAST_DEFLATING_FLAG{1U << 2U},
+      // CRC-32 and sizes follow data instead of the local header.
+      DATA_DESCRIPTOR_FLAG{1U << 3U},
+      // 1980-01-01 in the MS-DOS format.
+      MOD_DATE{(1U << 5U) | 1U};
+  // Permissions of copied entries, which weren't created on Unix.
+  constexpr auto DEFAULT_PERMS{perms::owner_read | perms::owner_write |
+                               perms::group_read | perms::others_read};
+  // Offset of CRC-32 in the local file header.
+  constexpr size_t LOCAL_CRC32_OFFSET{14U};
+  // Extra field of zipalign, which contains alignment and padding.
+  constexpr uint16_t ALIGNMENT_EXTRA_ID{0xD935U};
+  // Header of the field (ID and size of data) and alignment.
+  constexpr size_t ALIGNMENT_EXTRA_SIZE{6U};
+  constexpr size_t MAX_ALIGNMENT{1U << 15U};
+  constexpr auto MAX_32{numeric_limits<uint32_t>::max()};
+
+  // Formats, which are compressed by design (the list of aapt is extended).
+  constexpr array<string_view, 37U> COMPRESSED_EXTENSIONS{
+    ".3g2", ".3gp", ".3gpp", ".3gpp2", ".7z", ".aac", ".amr", ".apk", ".awb",
+    ".bz2", ".flac", ".gif", ".gz", ".imy", ".jar", ".jet", ".jpeg", ".jpg",
+    ".m4a", ".m4v", ".mid", ".midi", ".mkv", ".mp2", ".mp3", ".mp4", ".mpeg",
+    ".mpg", ".ogg", ".opus", ".png", ".rtttl", ".smf", ".webm", ".webp",
+    ".xmf", ".zip"
+  };
+  constexpr size_t ENTROPY_SAMPLE_SIZE{16U << 10U};
+  // Data with higher entropy (in bits per byte) is considered compressed.
+  constexpr double MAX_ENTROPY{7.5};
+
+  // Size of the buffer, if the kernel can't copy data.
+  constexpr size_t COPY_BUFFER_SIZE{1U << 20U};
+
+  template<typename T> void append_le(string& t_data, const T t_val) {
+    static_assert(is_unsigned_v<T>, "T must be unsigned integer");
+    for (size_t i{}; i != sizeof(T); ++i) {
+      t_data += static_cast<char>((t_val >> (i * 8U)) & 0xFFU);
+    }
+  }
+
+  // Descriptor is closed when the last owner is destroyed.
+  auto open_shared(const path& t_path, const int t_flags)
+      -> shared_ptr<const int> {
+    const int fd{open(t_path.c_str(), t_flags | O_CLOEXEC)};
+    if (fd == -1) {
+      throw runtime_error("failed to open \"" + t_path.string() + '"');
+    }
+    return shared_ptr<const int>(new int{fd}, [] (const int* const ptr) {
+      close(*ptr);
+      delete ptr;
+    });
+  }
+
+  // Returns false on failure, including the end of file.
+  auto read_range(const int t_fd, uint64_t t_offset,
+                  char* t_data, size_t t_size) -> bool {
+    while (t_size != 0U) {
+      const auto result{pread(t_fd, t_data, t_size,
+                              static_cast<off_t>(t_offset))};
+      if (result <= 0) {
+        if (result == -1 && errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      t_data += result;
+      t_offset += static_cast<uint64_t>(result);
+      t_size -= static_cast<size_t>(result);
+    }
+    return true;
+  }
+
+  auto write_range(const int t_fd, uint64_t t_offset,
+                   const char* t_data, size_t t_size) -> bool {
+    while (t_size != 0U) {
+      const auto result{pwrite(t_fd, t_data, t_size,
+                               static_cast<off_t>(t_offset))};
+      if (result == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      t_data += result;
+      t_offset += static_cast<uint64_t>(result);
+      t_size -= static_cast<size_t>(result);
+    }
+    return true;
+  }
+
+  /*
+   * Copies data between files by the kernel, so it doesn't pass through
+   * user space (and it can be shared on copy-on-write file systems). Falls
+   * back to copying through a buffer.
+   */
+  void copy_range(const int t_in_fd, const uint64_t t_in_offset,
+      const int t_out_fd, const uint64_t t_out_offset, const uint64_t t_size) {
+    auto
+        in_offset{static_cast<off64_t>(t_in_offset)},
+        out_offset{static_cast<off64_t>(t_out_offset)};
+    uint64_t copied{};
+
+    while (copied != t_size) {
+      const auto result{copy_file_range(t_in_fd, &in_offset, t_out_fd,
+          &out_offset, static_cast<size_t>(t_size - copied), 0U)};
+      if (result > 0) {
+        copied += static_cast<uint64_t>(result);
+        continue;
+      }
+      if (result == 0) {
+        throw runtime_error("data is truncated");
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      // Not supported by the kernel or between these file systems.
+      if (errno != ENOSYS && errno != EXDEV &&
+          errno != EINVAL && errno != EOPNOTSUPP) {
+        throw runtime_error("failed to copy data");
+      }
+
+      vector<char> buf(static_cast<size_t>(
+          min<uint64_t>(t_size - copied, COPY_BUFFER_SIZE)));
+      while (copied != t_size) {
+        const auto size{static_cast<size_t>(
+            min<uint64_t>(t_size - copied, buf.size()))};
+        if (!read_range(t_in_fd, t_in_offset + copied, buf.data(), size) ||
+            !write_range(t_out_fd, t_out_offset + copied, buf.data(), size)) {
+          throw runtime_error("failed to copy data");
+        }
+        copied += size;
+      }
+    }
+  }
+}
+
+ZipWriter::ZipWriter(const path& t_path,
+    const Compression t_compression, const bool t_update):
+    m_path(t_path), m_compression(t_compression),
+    m_max_pending_count(max(thread::hardware_concurrency(), 1U) * 2U) {
+  m_is_updating = t_update && load(t_path);
+  if (m_is_updating) {
+    // Data after the last entry (the central directory) is overwritten.
+    m_ofs.open(t_path, ios::binary | ios::in | ios::out);
+    m_ofs.seekp(static_cast<streamoff>(m_offset));
+  } else {
+    m_old_records.clear();
+    m_offset = 0U;
+    m_ofs.open(t_path, ios::binary | ios::trunc);
+  }
+  if (!m_ofs) {
+    throw runtime_error("failed to create archive \"" +
+                        t_path.string() + '"');
+  }
+}
+
+void ZipWriter::add(const string_view t_name, const path& t_file_path,
+                    const size_t t_alignment) {
+  if (m_records.size() == numeric_limits<uint16_t>::max()) {
+    throw runtime_error("archive is too large");
+  }
+  const bool must_store{t_alignment != 0U};
+
+  ifstream ifs(t_file_path, ios::binary);
+  if (!ifs) {
+    throw runtime_error("failed to open \"" + t_file_path.string() + '"');
+  }
+  const auto file_size{filesystem::file_size(t_file_path)};
+  if (file_size > MAX_32) {
+    throw runtime_error("file \"" + t_file_path.string() + "\" is too large");
+  }
+
+  Record record;
+  record.name = t_name;
+  record.mode = static_cast<uint32_t>(status(t_file_path).permissions() &
+                                      perms::mask);
+  record.alignment = get_alignment(t_alignment);
+
+  // Reading is much cheaper than compression, so CRC-32 of a file is
+  // calculated to check whether an existing entry can be kept. It's done at
+  // most once, then data of the file isn't hashed again.
+  optional<uint32_t> file_crc32;
+  const auto get_file_crc32{[&] {
+    if (!file_crc32) {
+      file_crc32 = calc_crc32(ifs, t_file_path);
+    }
+    return *file_crc32;
+  }};
+  if (const auto iter{m_old_records.find(t_name)};
+      iter != m_old_records.cend()) {
+    auto old_record{move(iter->second)};
+    m_old_records.erase(iter);
+    const auto data_offset{
+        old_record.local_header_offset + old_record.local_header_size};
+    if (can_reuse(old_record.method, old_record.size, file_size, must_store) &&
+        (old_record.method != Method::STORED ||
+         data_offset % record.alignment == 0U) &&
+        get_file_crc32() == old_record.crc32) {
+      // Only the central directory stores the mode.
+      old_record.mode = record.mode;
+      old_record.alignment = record.alignment;
+      m_records.push_back(move(old_record));
+      return;
+    }
+  }
+  const auto* const previous_entry{m_previous ?
+      m_previous->get_directory().find(t_name) : nullptr};
+  if (previous_entry != nullptr && can_reuse(previous_entry->method,
+      previous_entry->uncompressed_size, file_size, must_store) &&
+      get_file_crc32() == previous_entry->crc32) {
+    copy(*m_previous, *previous_entry, move(record));
+    return;
+  }
+
+  bool is_stored{must_store || m_compression == Compression::NONE};
+  if (!is_stored) {
+    string sample(min<uint64_t>(file_size, ENTROPY_SAMPLE_SIZE), '\0');
+    if (!ifs.read(sample.data(), static_cast<streamsize>(sample.size()))) {
+      throw runtime_error("failed to read \"" + t_file_path.string() + '"');
+    }
+    ifs.seekg(0);
+    is_stored = !is_compressible(t_file_path, sample);
+  }
+  if (file_crc32) {
+    record.crc32 = *file_crc32;
+    record.is_hashed = true;
+  }
+  const bool is_hashed{record.is_hashed};
+  if (is_stored) {
+    m_records.push_back(move(record));
+    add_stored(t_file_path, file_size, is_hashed);
+    return;
+  }
+
+  const int level{m_compression == Compression::FAST ?
+                  Z_BEST_SPEED : Z_BEST_COMPRESSION};
+  record.method = Method::DEFLATED;
+  m_records.push_back(move(record));
+  auto remaining_size{file_size};
+  string dictionary;
+  for (bool is_first{true}; is_first || remaining_size != 0U;
+       is_first = false) {
+    string data(min<uint64_t>(remaining_size, DATA_BLOCK_SIZE), '\0');
+    if (!ifs.read(data.data(), static_cast<streamsize>(data.size()))) {
+      throw runtime_error("failed to read \"" + t_file_path.string() + '"');
+    }
+    remaining_size -= data.size();
+
+    // Make room before reading of the next block to keep memory usage flat.
+    while (m_pending.size() >= m_max_pending_count) {
+      write_next();
+    }
+    const bool is_last{remaining_size == 0U};
+    auto next_dictionary{is_last ? string() :
+        data.substr(data.size() - min(data.size(), DICTIONARY_SIZE))};
+    m_pending.push_back({m_records.size() - 1U, is_first, is_last,
+                         async(launch::async, process_block, move(data),
+                               move(dictionary), level, is_first, is_last,
+                               is_hashed)});
+    dictionary = move(next_dictionary);
+  }
+}
+
+void ZipWriter::copy(const LocalZip& t_zip,
+    const ZipDirectory::Entry& t_entry, const size_t t_alignment) {
+  if (m_records.size() == numeric_limits<uint16_t>::max()) {
+    throw runtime_error("archive is too large");
+  }
+  if (t_alignment != 0U && t_entry.method != Method::STORED) {
+    throw runtime_error("entry \"" + t_entry.name +
+                        "\" must be stored to be aligned");
+  }
+
+  auto record{make_record(t_entry)};
+  record.alignment = get_alignment(t_alignment);
+  copy(t_zip, t_entry, move(record));
+}
+
+auto ZipWriter::reuse(const path& t_previous_path) -> bool {
+  auto previous{make_unique<LocalZip>(t_previous_path)};
+  if (!previous->open()) {
+    m_previous.reset();
+    return false;
+  }
+  m_previous = move(previous);
+  return true;
+}
+
+void ZipWriter::finish() {
+  while (!m_pending.empty()) {
+    write_next();
+  }
+
+  if (m_is_updating) {
+    uint64_t used_size{};
+    for (const auto& r : m_records) {
+      used_size += r.local_header_size + r.compressed_size;
+    }
+    if ((m_offset - used_size) * 4U > m_offset) {
+      compact();
+    }
+    m_ofs.seekp(static_cast<streamoff>(m_offset));
+  }
+  if (m_offset > MAX_32) {
+    throw runtime_error("archive is too large");
+  }
+
+  string directory;
+  for (const auto& r : m_records) {
+    append_le(directory, CENTRAL_HEADER_SIGNATURE);
+    append_le(directory, VERSION_MADE_BY);
+    append_le(directory, r.method == Method::DEFLATED ?
+                         DEFLATED_VERSION_NEEDED : STORED_VERSION_NEEDED);
+    append_le(directory, r.flags);
+    append_le(directory, static_cast<uint16_t>(r.method));
+    append_le(directory, uint16_t{});
+    append_le(directory, MOD_DATE);
+    append_le(directory, r.crc32);
+    append_le(directory, static_cast<uint32_t>(r.compressed_size));
+    append_le(directory, static_cast<uint32_t>(r.size));
+    append_le(directory, static_cast<uint16_t>(r.name.size()));
+    // Lengths of extra field and comment, disk number and internal attributes.
+    for (size_t i{}; i != 4U; ++i) {
+      append_le(directory, uint16_t{});
+    }
+    // High 16 bits are Unix mode.
+    append_le(directory, (static_cast<uint32_t>(S_IFREG) | r.mode) << 16U);
+    append_le(directory, static_cast<uint32_t>(r.local_header_offset));
+    directory += r.name;
+  }
+
+  const auto directory_size{static_cast<uint32_t>(directory.size())};
+  const auto entries_count{static_cast<uint16_t>(m_records.size())};
+  append_le(directory, EOCD_SIGNATURE);
+  // Disk numbers.
+  append_le(directory, uint16_t{});
+  append_le(directory, uint16_t{});
+  append_le(directory, entries_count);
+  append_le(directory, entries_count);
+  append_le(directory, directory_size);
+  append_le(directory, static_cast<uint32_t>(m_offset));
+  // Comment length.
+  append_le(directory, uint16_t{});
+
+  m_ofs.write(directory.data(), static_cast<streamsize>(directory.size()));
+  m_ofs.close();
+  if (!m_ofs) {
+    throw runtime_error("failed to write archive");
+  }
+  if (m_is_updating) {
+    // Cut off the tail of the previous archive.
+    error_code ec;
+    resize_file(m_path, m_offset + directory.size(), ec);
+    if (ec) {
+      throw runtime_error("failed to truncate archive");
+    }
+  }
+}
+
+auto ZipWriter::load(const path& t_path) -> bool {
+  LocalZip zip(t_path);
+  if (!zip.open()) {
+    return false;
+  }
+
+  try {
+    for (const auto& e : zip.get_directory().get_entries()) {
+      // Sizes of an entry with data descriptor
+      // aren't known from the local header.
+      if ((e.method != Method::STORED && e.method != Method::DEFLATED) ||
+          (e.flags & DATA_DESCRIPTOR_FLAG) != 0U ||
+          e.compressed_size > MAX_32 || e.uncompressed_size > MAX_32) {
+        return false;
+      }
+      auto record{make_record(e)};
+      const auto data_offset{zip.get_data_offset(e)};
+      record.local_header_offset = e.local_header_offset;
+      record.local_header_size = data_offset - e.local_header_offset;
+      m_offset = max(m_offset, data_offset + e.compressed_size);
+      m_old_records.emplace(e.name, move(record));
+    }
+  } catch (const exception&) {
+    return false;
+  }
+  return true;
+}
+
+auto ZipWriter::make_record(const ZipDirectory::Entry& t_entry) -> Record {
+  Record record;
+  record.name = t_entry.name;
+  record.method = t_entry.method;
+  record.flags = t_entry.flags;
+  record.is_copied = true;
+  record.crc32 = t_entry.crc32;
+  record.compressed_size = t_entry.compressed_size;
+  record.size = t_entry.uncompressed_size;
+  // High byte of the version is the host system.
+  record.mode = t_entry.version_made_by >> 8U == UNIX_HOST ?
+      (t_entry.external_attrs >> 16U) & static_cast<uint32_t>(perms::mask) :
+      static_cast<uint32_t>(DEFAULT_PERMS);
+  return record;
+}
+
+auto ZipWriter::get_alignment(const size_t t_alignment) -> size_t {
+  if (t_alignment == 0U) {
+    return DEFAULT_ALIGNMENT;
+  }
+  // Power of two has the only set bit.
+  if ((t_alignment & (t_alignment - 1U)) != 0U ||
+      t_alignment > MAX_ALIGNMENT) {
+    throw runtime_error("invalid alignment " + to_string(t_alignment));
+  }
+  return t_alignment;
+}
+
+auto ZipWriter::can_reuse(const Method t_method, const uint64_t t_size,
+    const uint64_t t_file_size, const bool t_must_store) const -> bool {
+  // Without compression all entries must be stored.
+  return t_size == t_file_size && (t_method == Method::STORED ||
+      (!t_must_store && m_compression != Compression::NONE));
+}
+
+auto ZipWriter::calc_crc32(ifstream& t_ifs, const path& t_file_path)
+    -> uint32_t {
+  vector<char> buf(DATA_BLOCK_SIZE);
+  uLong crc{crc32(0UL, Z_NULL, 0U)};
+  while (t_ifs) {
+    t_ifs.read(buf.data(), static_cast<streamsize>(buf.size()));
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(buf.data()),
+                static_cast<uInt>(t_ifs.gcount()));
+  }
+  if (!t_ifs.eof()) {
+    throw runtime_error("failed to read \"" + t_file_path.string() + '"');
+  }
+  t_ifs.clear();
+  t_ifs.seekg(0);
+  return static_cast<uint32_t>(crc);
+}
+
+void ZipWriter::copy(const LocalZip& t_zip,
+    const ZipDirectory::Entry& t_entry, Record t_record) {
+  if (t_entry.method != Method::STORED && t_entry.method != Method::DEFLATED) {
+    throw runtime_error("entry \"" + t_entry.name +
+                        "\" has unsupported compression method");
+  }
+  if (t_entry.compressed_size > MAX_32 || t_entry.uncompressed_size > MAX_32) {
+    throw runtime_error("entry \"" + t_entry.name + "\" is too large");
+  }
+
+  // Data is copied by the kernel, so it's ready to be written.
+  Block block;
+  block.source_fd = open_shared(t_zip.get_path(), O_RDONLY);
+  block.source_offset = t_zip.get_data_offset(t_entry);
+  block.source_size = t_entry.compressed_size;
+
+  auto record{make_record(t_entry)};
+  record.name = move(t_record.name);
+  record.mode = t_record.mode;
+  record.alignment = t_record.alignment;
+  // Options of deflating are kept, but data descriptor isn't used.
+  record.flags = UTF8_FLAG | (t_entry.flags &
+      (MAXIMUM_DEFLATING_FLAG | FAST_DEFLATING_FLAG));
+  m_records.push_back(move(record));
+
+  while (m_pending.size() >= m_max_pending_count) {
+    write_next();
+  }
+  promise<Block> ready_block;
+  ready_block.set_value(move(block));
+  m_pending.push_back({m_records.size() - 1U, true, true,
+                       ready_block.get_future()});
+}
+
+void ZipWriter::add_stored(const path& t_file_path,
+                           const uint64_t t_size, const bool t_is_hashed) {
+  const auto fd{open_shared(t_file_path, O_RDONLY)};
+  auto remaining_size{t_size};
+  uint64_t offset{};
+  for (bool is_first{true}; is_first || remaining_size != 0U;
+       is_first = false) {
+    const auto size{static_cast<size_t>(
+        min<uint64_t>(remaining_size, DATA_BLOCK_SIZE))};
+    remaining_size -= size;
+
+    while (m_pending.size() >= m_max_pending_count) {
+      write_next();
+    }
+    future<Block> block;
+    if (t_is_hashed) {
+      // Nothing to calculate, so the range is ready to be copied.
+      Block ready_block;
+      ready_block.size = size;
+      ready_block.source_fd = fd;
+      ready_block.source_offset = offset;
+      ready_block.source_size = size;
+      promise<Block> block_promise;
+      block_promise.set_value(move(ready_block));
+      block = block_promise.get_future();
+    } else {
+      block = async(launch::async, hash_range, fd, offset, size, t_file_path);
+    }
+    m_pending.push_back({m_records.size() - 1U, is_first,
+                         remaining_size == 0U, move(block)});
+    offset += size;
+  }
+}
+
+auto ZipWriter::hash_range(const shared_ptr<const int> t_fd,
+    const uint64_t t_offset, const size_t t_size, const path t_file_path)
+    -> Block {
+  string data(t_size, '\0');
+  if (!read_range(*t_fd, t_offset, data.data(), data.size())) {
+    throw runtime_error("failed to read \"" + t_file_path.string() + '"');
+  }
+
+  Block block;
+  block.size = t_size;
+  block.crc32 = static_cast<uint32_t>(crc32(
+      crc32(0UL, Z_NULL, 0U), reinterpret_cast<const Bytef*>(data.data()),
+      static_cast<uInt>(data.size())));
+  block.source_fd = t_fd;
+  block.source_offset = t_offset;
+  block.source_size = t_size;
+  return block;
+}
+
+auto ZipWriter::is_compressible(const path& t_file_path,
+                                const string_view t_sample) -> bool {
+  auto extension{t_file_path.extension().string()};
+  transform(extension.cbegin(), extension.cend(), extension.begin(),
+            [] (const unsigned char c) { return tolower(c); });
+  if (find(COMPRESSED_EXTENSIONS.cbegin(), COMPRESSED_EXTENSIONS.cend(),
+           extension) != COMPRESSED_EXTENSIONS.cend()) {
+    return false;
+  }
+
+  const auto sample{t_sample.substr(0U, ENTROPY_SAMPLE_SIZE)};
+  if (sample.empty()) {
+    return false;
+  }
+  array<size_t, 1U << 8U> counts{};
+  for (const auto c : sample) {
+    ++counts.at(static_cast<unsigned char>(c));
+  }
+  double entropy{};
+  for (const auto c : counts) {
+    if (c != 0U) {
+      const auto p{static_cast<double>(c) / static_cast<double>(sample.size())};
+      entropy -= p * log2(p);
+    }
+  }
+  return entropy <= MAX_ENTROPY;
+}
+
+auto ZipWriter::process_block(string t_data, const string t_dictionary,
+    const int t_level, const bool t_is_first, const bool t_is_last,
+    const bool t_is_hashed) -> Block {
+  Block block;
+  block.size = t_data.size();
+  if (!t_is_hashed) {
+    block.crc32 = static_cast<uint32_t>(crc32(
+        crc32(0UL, Z_NULL, 0U), reinterpret_cast<const Bytef*>(t_data.data()),
+        static_cast<uInt>(t_data.size())));
+  }
+  z_stream stream{};
+  // Negative window bits produce raw deflate data.
+  if (deflateInit2(&stream, t_level, Z_DEFLATED, -MAX_WBITS,
+                   MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw runtime_error("failed to initialize compressor");
+  }
+  const ScopeGuard stream_guard([&stream] { deflateEnd(&stream); });
+  if (!t_dictionary.empty() && deflateSetDictionary(&stream,
+      reinterpret_cast<const Bytef*>(t_dictionary.data()),
+      static_cast<uInt>(t_dictionary.size())) != Z_OK) {
+    throw runtime_error("failed to set dictionary of compressor");
+  }
+
+  // Flushing adds an empty stored block of at most 6 bytes (bound of
+  // deflateBound is enough for the end of a stream, but not for both).
+  constexpr size_t FLUSH_SIZE{6U};
+  block.data.resize(
+      deflateBound(&stream, static_cast<uLong>(t_data.size())) + FLUSH_SIZE);
+  stream.next_in = reinterpret_cast<Bytef*>(t_data.data());
+  stream.avail_in = static_cast<uInt>(t_data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(block.data.data());
+  stream.avail_out = static_cast<uInt>(block.data.size());
+
+  // Only the last block has the final bit.
+  const auto status{deflate(&stream, t_is_last ? Z_FINISH : Z_SYNC_FLUSH)};
+  if ((t_is_last && status != Z_STREAM_END) ||
+      (!t_is_last && (status != Z_OK || stream.avail_in != 0U))) {
+    throw runtime_error("failed to compress data");
+  }
+  block.data.resize(stream.total_out);
+
+  if (t_is_first && t_is_last && block.data.size() >= block.size) {
+    block.data = move(t_data);
+  } else {
+    block.is_deflated = true;
+  }
+  return block;
+}
+
+void ZipWriter::write_next() {
+  auto pending{move(m_pending.front())};
+  m_pending.pop_front();
+  // Rethrows an exception of the task.
+  const auto block{pending.block.get()};
+  auto& record{m_records.at(pending.record_idx)};
+
+  if (pending.is_first) {
+    if (m_offset > MAX_32) {
+      throw runtime_error("archive is too large");
+    }
+    if (!record.is_copied) {
+      if (!block.is_deflated) {
+        record.method = Method::STORED;
+      }
+      record.flags = get_flags(record.method);
+    }
+    record.local_header_offset = m_offset;
+    // CRC-32 and sizes of a new entry are written after the data.
+    write_local_header(record);
+    record.local_header_size = m_offset - record.local_header_offset;
+  }
+  if (block.source_fd) {
+    if (!m_fd) {
+      m_fd = open_shared(m_path, O_WRONLY);
+    }
+    // Buffered data must precede the copied one.
+    m_ofs.flush();
+    copy_range(*block.source_fd, block.source_offset,
+               *m_fd, m_offset, block.source_size);
+    m_ofs.seekp(static_cast<streamoff>(m_offset + block.source_size));
+  } else {
+    m_ofs.write(block.data.data(),
+                static_cast<streamsize>(block.data.size()));
+  }
+  const auto data_size{block.source_fd ?
+                       block.source_size : block.data.size()};
+  m_offset += data_size;
+  if (record.is_copied) {
+    if (!m_ofs) {
+      throw runtime_error("failed to write archive");
+    }
+    return;
+  }
+
+  if (!record.is_hashed) {
+    record.crc32 = pending.is_first ? block.crc32 :
+        static_cast<uint32_t>(crc32_combine(record.crc32, block.crc32,
+                                            static_cast<z_off_t>(block.size)));
+  }
+  record.size += block.size;
+  record.compressed_size += data_size;
+  if (pending.is_last) {
+    if (record.compressed_size > MAX_32) {
+      throw runtime_error("entry \"" + record.name + "\" is too large");
+    }
+    string sizes;
+    append_le(sizes, record.crc32);
+    append_le(sizes, static_cast<uint32_t>(record.compressed_size));
+    append_le(sizes, static_cast<uint32_t>(record.size));
+    m_ofs.seekp(static_cast<streamoff>(
+        record.local_header_offset + LOCAL_CRC32_OFFSET));
+    m_ofs.write(sizes.data(), static_cast<streamsize>(sizes.size()));
+    m_ofs.seekp(static_cast<streamoff>(m_offset));
+  }
+  if (!m_ofs) {
+    throw runtime_error("failed to write archive");
+  }
+}
+
+void ZipWriter::write_local_header(const Record& t_record) {
+  string header;
+  append_le(header, LOCAL_HEADER_SIGNATURE);
+  append_le(header, t_record.method == Method::DEFLATED ?
+                    DEFLATED_VERSION_NEEDED : STORED_VERSION_NEEDED);
+  append_le(header, t_record.flags);
+  append_le(header, static_cast<uint16_t>(t_record.method));
+  append_le(header, uint16_t{});
+  append_le(header, MOD_DATE);
+  append_le(header, t_record.crc32);
+  append_le(header, static_cast<uint32_t>(t_record.compressed_size));
+  append_le(header, static_cast<uint32_t>(t_record.size));
+  append_le(header, static_cast<uint16_t>(t_record.name.size()));
+
+  string extra;
+  const auto alignment{t_record.alignment};
+  const auto data_offset{
+      m_offset + ZipDirectory::LOCAL_HEADER_SIZE + t_record.name.size()};
+  if (t_record.method == Method::STORED && data_offset % alignment != 0U) {
+    const auto padding{(alignment -
+        (data_offset + ALIGNMENT_EXTRA_SIZE) % alignment) % alignment};
+    append_le(extra, ALIGNMENT_EXTRA_ID);
+    append_le(extra, static_cast<uint16_t>(sizeof(uint16_t) + padding));
+    append_le(extra, static_cast<uint16_t>(alignment));
+    extra.append(padding, '\0');
+  }
+  append_le(header, static_cast<uint16_t>(extra.size()));
+  header += t_record.name;
+  header += extra;
+  m_ofs.write(header.data(), static_cast<streamsize>(header.size()));
+  m_offset += header.size();
+}
+
+void ZipWriter::compact() {
+  vector<Record*> records;
+  for (auto& r : m_records) {
+    records.push_back(&r);
+  }
+  sort(records.begin(), records.end(), [] (const auto* lhs, const auto* rhs) {
+    return lhs->local_header_offset < rhs->local_header_offset;
+  });
+
+  m_ofs.flush();
+  ifstream ifs(m_path, ios::binary);
+  vector<char> buf(DATA_BLOCK_SIZE);
+  uint64_t offset{};
+  // Entries are moved only towards the beginning,
+  // so data is never overwritten before reading.
+  for (auto* const r : records) {
+    const auto size{r->local_header_size + r->compressed_size};
+    const auto alignment{r->method == Method::STORED ? r->alignment : 1U};
+    const auto new_offset{r->local_header_offset -
+        (r->local_header_offset - offset) / alignment * alignment};
+    for (uint64_t moved{};
+         r->local_header_offset != new_offset && moved != size;) {
+      const auto chunk_size{min<uint64_t>(size - moved, buf.size())};
+      ifs.seekg(static_cast<streamoff>(r->local_header_offset + moved));
+      ifs.read(buf.data(), static_cast<streamsize>(chunk_size));
+      m_ofs.seekp(static_cast<streamoff>(new_offset + moved));
+      m_ofs.write(buf.data(), static_cast<streamsize>(chunk_size));
+      moved += chunk_size;
+    }
+    r->local_header_offset = new_offset;
+    offset = new_offset + size;
+  }
+  if (!ifs || !m_ofs) {
+    throw runtime_error("failed to compact archive");
+  }
+  m_offset = offset;
+}
+
+auto ZipWriter::get_flags(const Method t_method) const -> uint16_t {
+  if (t_method == Method::STORED) {
+    return UTF8_FLAG;
+  }
+  return UTF8_FLAG | (m_compression == Compression::FAST ?
+                      FAST_DEFLATING_FLAG : MAXIMUM_DEFLATING_FLAG);
+}
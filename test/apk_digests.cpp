@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include <doctest/doctest.h>
+#include "internal/test_data.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "apk_digests.hpp"
+#include "local_zip.hpp"
+#include "sha256.hpp"
+#include "zip_writer.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+namespace {
+auto sha256(const string_view t_data) -> string {
+  Sha256 sha256;
+  sha256.update(t_data.data(), t_data.size());
+  return sha256.finish();
+}
+
+// Digest of a chunk or the top-level one: magic, 32-bit count and data.
+auto sha256(const char t_magic, const size_t t_count, string_view t_data)
+    -> string {
+  string data{t_magic};
+  for (size_t i{}; i != 4U; ++i) {
+    data += static_cast<char>((t_count >> (i * 8U)) & 0xFFU);
+  }
+  data += t_data;
+  return sha256(data);
+}
+
+// Calculates the v2 content digest of an unsigned archive from scratch.
+auto calc_content_digest(const path& t_path) -> string {
+  LocalZip zip(t_path);
+  REQUIRE(zip.open());
+  const auto data{TestData::read_file(t_path)};
+  const auto& location{zip.get_location()};
+  const auto directory_end{location.offset + location.size};
+  const string_view sections[]{
+    string_view(data).substr(0U, location.offset),
+    string_view(data).substr(location.offset, location.size),
+    string_view(data).substr(directory_end)
+  };
+
+  string digests;
+  size_t chunks_count{};
+  for (const auto s : sections) {
+    for (size_t offset{}; offset < s.size(); offset += ApkDigests::CHUNK_SIZE) {
+      const auto chunk{s.substr(offset, ApkDigests::CHUNK_SIZE)};
+      const auto digest{sha256('\xA5', chunk.size(), chunk)};
+      for (size_t i{}; i != digest.size(); i += 2U) {
+        digests += static_cast<char>(stoi(digest.substr(i, 2U), nullptr, 16));
+      }
+      ++chunks_count;
+    }
+  }
+  return sha256('\x5A', chunks_count, digests);
+}
+} // namespace
+
+TEST_CASE("Calculate digests of an APK") {
+  // Spans several chunks, which aren't rehashed if the file isn't changed.
+  constexpr size_t LARGE_FILE_SIZE{3U << 20U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto
+      apk_path{dir / "app.apk"},
+      cache_path{dir / "cache" / "digests"};
+
+  mt19937 engine;
+  const auto large_content{TestData::make_random(LARGE_FILE_SIZE, engine)};
+  ofstream(dir / "large") << large_content;
+  ofstream(dir / "manifest") << "manifest";
+  ofstream(dir / "classes") << "classes";
+
+  const auto write_apk{[&] (const bool update) {
+    ZipWriter writer(apk_path, ZipWriter::Compression::FAST, update);
+    writer.add("res/large", dir / "large");
+    writer.add("AndroidManifest.xml", dir / "manifest");
+    writer.add("classes.dex", dir / "classes");
+    writer.finish();
+  }};
+  write_apk(false);
+
+  {
+    LocalZip apk(apk_path);
+    REQUIRE(apk.open());
+    ApkDigests digests(cache_path);
+    digests.update(apk);
+    CHECK(digests.get_hashed_entries_count() == 3U);
+    CHECK(digests.get_hashed_chunks_count() == 4U);
+    CHECK(digests.get_content_digest() == calc_content_digest(apk_path));
+
+    const auto entry_digests{digests.get_entry_digests()};
+    REQUIRE(entry_digests.size() == 3U);
+    CHECK(entry_digests.at("res/large") == sha256(large_content));
+    CHECK(entry_digests.at("AndroidManifest.xml") == sha256("manifest"));
+    REQUIRE(digests.save());
+  }
+
+  // Changed entry is appended, so only the last chunk is affected.
+  ofstream(dir / "classes") << "changed classes";
+  write_apk(true);
+
+  LocalZip apk(apk_path);
+  REQUIRE(apk.open());
+  ApkDigests digests(cache_path);
+  digests.update(apk);
+  CHECK(digests.get_hashed_entries_count() == 1U);
+  CHECK(digests.get_hashed_chunks_count() == 1U);
+  CHECK(digests.get_content_digest() == calc_content_digest(apk_path));
+  CHECK(digests.get_entry_digests().at("classes.dex") ==
+        sha256("changed classes"));
+
+  // Results mustn't depend on the cache.
+  ApkDigests fresh_digests(dir / "missing");
+  fresh_digests.update(apk, 1U);
+  CHECK(fresh_digests.get_hashed_entries_count() == 3U);
+  CHECK(fresh_digests.get_content_digest() == digests.get_content_digest());
+  CHECK(fresh_digests.get_entry_digests() == digests.get_entry_digests());
+
+  REQUIRE(digests.save());
+  ApkDigests loaded_digests(cache_path);
+  loaded_digests.update(apk);
+  CHECK(loaded_digests.get_hashed_entries_count() == 0U);
+  // Stale space of the replaced entry isn't covered by entries.
+  CHECK(loaded_digests.get_hashed_chunks_count() == 1U);
+  CHECK(loaded_digests.get_content_digest() == digests.get_content_digest());
+
+  // Malformed cache is ignored.
+  ofstream(cache_path) << "malformed";
+  ApkDigests ignored_digests(cache_path);
+  ignored_digests.update(apk);
+  CHECK(ignored_digests.get_hashed_entries_count() == 3U);
+  CHECK(ignored_digests.get_content_digest() == digests.get_content_digest());
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <doctest/doctest.h>
+#include "internal/tmp_dir.hpp"
+
+#include "dex_file.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+namespace {
+void put_u32(string& t_data, const size_t t_offset, const uint32_t t_val) {
+  for (size_t i{}; i != 4U; ++i) {
+    t_data.at(t_offset + i) = static_cast<char>((t_val >> (i * 8U)) & 0xFFU);
+  }
+}
+
+// Makes a file without identifiers, which contains only a header and map.
+auto make_empty_dex() -> string {
+  // Size and two items: the header and map itself.
+  constexpr size_t MAP_SIZE{4U + 2U * 12U};
+  constexpr uint32_t MAP_OFF{DexFile::HEADER_SIZE};
+
+  string data(DexFile::HEADER_SIZE + MAP_SIZE, '\0');
+  data.replace(0U, 8U, string("dex\n035\0", 8U));
+  put_u32(data, 0x20U, static_cast<uint32_t>(data.size()));
+  put_u32(data, 0x24U, DexFile::HEADER_SIZE);
+  put_u32(data, 0x28U, 0x12345678U);
+  put_u32(data, 0x34U, MAP_OFF);
+  put_u32(data, 0x68U, MAP_SIZE);
+  put_u32(data, 0x6CU, MAP_OFF);
+
+  put_u32(data, MAP_OFF, 2U);
+  // Header item: type is zero.
+  put_u32(data, MAP_OFF + 4U + 4U, 1U);
+  // Map list item.
+  put_u32(data, MAP_OFF + 16U, 0x1000U);
+  put_u32(data, MAP_OFF + 16U + 4U, 1U);
+  put_u32(data, MAP_OFF + 16U + 8U, MAP_OFF);
+  return data;
+}
+
+void write_file(const path& t_path, const string& t_data) {
+  ofstream ofs(t_path, ios::binary);
+  ofs.exceptions(ios::badbit | ios::failbit);
+  ofs << t_data;
+}
+} // namespace
+
+TEST_CASE("Read a DEX file") {
+  const TmpDir tmp_dir;
+  const auto dex_path{tmp_dir.get_entry().path() / "classes.dex"};
+  const auto data{make_empty_dex()};
+  write_file(dex_path, data);
+
+  const DexFile dex(dex_path);
+  CHECK(dex.get_version() == 35U);
+  CHECK_FALSE(dex.has_method_handles());
+  CHECK(dex.get_count(DexFile::Pool::STRING) == 0U);
+  CHECK(dex.get_count(DexFile::Pool::METHOD) == 0U);
+  CHECK(dex.get_class_defs_count() == 0U);
+  CHECK(dex.get_type_list(0U).empty());
+  CHECK_THROWS_AS(static_cast<void>(dex.get_string(0U)), runtime_error);
+  CHECK_THROWS_AS(static_cast<void>(dex.get_class_def(0U)), runtime_error);
+
+  auto reader{dex.get_reader(DexFile::HEADER_SIZE)};
+  CHECK(reader.read_u32() == 2U);
+  CHECK_THROWS_AS(static_cast<void>(dex.get_reader(
+      static_cast<uint32_t>(data.size() + 1U))), runtime_error);
+}
+
+TEST_CASE("Open an invalid DEX file") {
+  const TmpDir tmp_dir;
+  const auto dex_path{tmp_dir.get_entry().path() / "classes.dex"};
+  CHECK_THROWS_AS(DexFile{dex_path}, runtime_error);
+
+  SUBCASE("Not a DEX file") {
+    auto data{make_empty_dex()};
+    data.at(0U) = 'D';
+    write_file(dex_path, data);
+  }
+  SUBCASE("Unsupported version") {
+    auto data{make_empty_dex()};
+    data.at(6U) = '4';
+    write_file(dex_path, data);
+  }
+  SUBCASE("Truncated file") {
+    const auto data{make_empty_dex()};
+    write_file(dex_path, data.substr(0U, data.size() - 1U));
+  }
+  SUBCASE("Identifiers are out of the file") {
+    auto data{make_empty_dex()};
+    // Size and offset of string identifiers.
+    put_u32(data, 0x38U, 1U);
+    put_u32(data, 0x3CU, static_cast<uint32_t>(data.size()));
+    write_file(dex_path, data);
+  }
+  CHECK_THROWS_AS(DexFile{dex_path}, runtime_error);
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include "internal/env.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "dex_file.hpp"
+#include "dex_merger.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+TEST_CASE("Merge DEX files") {
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto
+      sources_dir{dir / "src"},
+      classes_dir{dir / "classes"},
+      intermediates_dir{dir / "intermediates"},
+      output_dir{dir / "output"};
+  for (const auto& d : {sources_dir, classes_dir,
+                        intermediates_dir, output_dir}) {
+    create_directory(d);
+  }
+
+  // Classes refer to each other, so their identifiers must be shared.
+  {
+    ofstream(sources_dir / "Shape.java") <<
+        "package test;\n"
+        "public interface Shape {\n"
+        "  double area();\n"
+        "}\n";
+    ofstream(sources_dir / "Square.java") <<
+        "package test;\n"
+        "public class Square implements Shape {\n"
+        "  public static final String NAME = \"square\";\n"
+        "  private final double side;\n"
+        "  public Square(double side) { this.side = side; }\n"
+        "  @Override public double area() { return side * side; }\n"
+        "}\n";
+    ofstream(sources_dir / "Main.java") <<
+        "package test;\n"
+        "public class Main {\n"
+        "  public static void main(String[] args) {\n"
+        "    try {\n"
+        "      Shape shape = new Square(args.length);\n"
+        "      System.out.println(Square.NAME + ' ' + shape.area());\n"
+        "    } catch (IllegalStateException e) {\n"
+        "      System.exit(1);\n"
+        "    }\n"
+        "  }\n"
+        "}\n";
+  }
+
+  const auto jvm{Env::get_jvm()};
+  string out, err;
+  vector<string> javac_args{"-d", classes_dir.string()};
+  for (const auto& e : directory_iterator(sources_dir)) {
+    javac_args.push_back(e.path().string());
+  }
+  REQUIRE(jvm->javac(javac_args, out, err) == 0);
+
+  vector<string> d8_args{"--intermediate", "--file-per-class",
+                         "--output", intermediates_dir.string()};
+  for (const auto& e : recursive_directory_iterator(classes_dir)) {
+    if (e.path().extension() == ".class") {
+      d8_args.push_back(e.path().string());
+    }
+  }
+  REQUIRE(jvm->d8(d8_args, out, err) == 0);
+
+  DexMerger merger;
+  vector<path> dexes;
+  for (const auto& e : recursive_directory_iterator(intermediates_dir)) {
+    if (e.path().extension() == ".dex") {
+      dexes.push_back(e.path());
+      merger.add(e.path());
+    }
+  }
+  REQUIRE(dexes.size() == 3U);
+  CHECK_THROWS_AS(merger.add(dexes.front()), runtime_error);
+
+  // Limit, which every class fits in, but all of them together don't.
+  {
+    uint32_t max_ids_count{};
+    for (const auto& d : dexes) {
+      const DexFile dex(d);
+      for (size_t p{}; p != size<DexFile::Pool>(); ++p) {
+        max_ids_count = max(max_ids_count,
+                            dex.get_count(static_cast<DexFile::Pool>(p)));
+      }
+    }
+
+    DexMerger split_merger(max_ids_count);
+    for (const auto& d : dexes) {
+      split_merger.add(d);
+    }
+    const auto split{split_merger.write(output_dir)};
+    REQUIRE(split.size() >= 2U);
+
+    set<string> classes;
+    for (size_t i{}; i != split.size(); ++i) {
+      const auto& p{split.at(i)};
+      CHECK(p == output_dir / ("classes" +
+            (i == 0U ? string() : to_string(i + 1U)) + ".dex"));
+      const DexFile dex(p);
+      for (uint32_t c{}; c != dex.get_class_defs_count(); ++c) {
+        // Every class must be written exactly once.
+        CHECK(classes.emplace(dex.get_string(
+              dex.get_type(dex.get_class_def(c).class_idx))).second);
+      }
+      CHECK(jvm->d8({"--output", dir.string(), p.string()}, out, err) == 0);
+    }
+    CHECK(classes.size() == 3U);
+  }
+
+  // Files of the split output are stale now.
+  const auto merged{merger.write(output_dir)};
+  REQUIRE(merged.size() == 1U);
+  CHECK(merged.front() == output_dir / "classes.dex");
+  CHECK_FALSE(exists(output_dir / "classes2.dex"));
+  CHECK(DexFile(merged.front()).get_class_defs_count() == 3U);
+
+  // d8 verifies the input, so it fails on a malformed file.
+  CHECK(jvm->d8({"--output", dir.string(),
+                 merged.front().string()}, out, err) == 0);
+}
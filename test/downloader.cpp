@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include <doctest/doctest.h>
+#include "internal/http_server.hpp"
+#include "internal/test_data.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "downloader.hpp"
+#include "sha256.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+namespace {
+auto make_content(const size_t t_size, const char t_seed) -> string {
+  string content(t_size, '\0');
+  for (size_t i{}; i != t_size; ++i) {
+    content[i] = static_cast<char>(i * 31U + static_cast<size_t>(t_seed));
+  }
+  return content;
+}
+
+auto calc_sha256(const string& t_data) -> string {
+  Sha256 sha256;
+  sha256.update(t_data.data(), t_data.size());
+  return sha256.finish();
+}
+} // namespace
+
+TEST_CASE("Download a file") {
+  constexpr size_t SIZE{1U << 20U};
+  const TmpDir tmp_dir;
+  const auto cache_dir{tmp_dir.get_entry().path() / "cache"};
+  const auto output_path{tmp_dir.get_entry().path() / "output"};
+  const HttpClient client;
+
+  const auto content{make_content(SIZE, 'a')};
+  const auto checksum{calc_sha256(content)};
+  uint64_t reported_total{};
+  const auto callback{[&reported_total] (uint64_t, const uint64_t total) {
+    reported_total = total;
+  }};
+
+  SUBCASE("Single segment") {
+    const HttpServer server(content);
+    Downloader(client, cache_dir).download(
+        server.get_url(), checksum, output_path, callback);
+    CHECK(reported_total == SIZE);
+  }
+
+  SUBCASE("Multiple segments") {
+    constexpr unsigned short SEGMENTS_COUNT{4U};
+    const HttpServer server(content);
+    Downloader(client, cache_dir, SEGMENTS_COUNT, SIZE / SEGMENTS_COUNT)
+        .download(server.get_url(), checksum, output_path, callback);
+    // HEAD request and a request per segment.
+    CHECK(server.get_requests_count() == SEGMENTS_COUNT + 1U);
+    CHECK(server.get_sent_bytes() == SIZE);
+  }
+
+  SUBCASE("Server doesn't support ranges") {
+    const HttpServer server(content, false);
+    Downloader(client, cache_dir, 4U, 1U).download(
+        server.get_url(), checksum, output_path);
+  }
+
+  CHECK(TestData::read_file(output_path) == content);
+  // Partial data must not be left.
+  CHECK(filesystem::is_empty(cache_dir / "partial"));
+  CHECK(exists(Downloader(client, cache_dir).get_blob_path(checksum)));
+}
+
+TEST_CASE("Resume an interrupted download") {
+  constexpr size_t SIZE{1U << 20U};
+  const TmpDir tmp_dir;
+  const auto cache_dir{tmp_dir.get_entry().path() / "cache"};
+  const auto output_path{tmp_dir.get_entry().path() / "output"};
+  const HttpClient client;
+
+  const auto content{make_content(SIZE, 'a')};
+  const auto checksum{calc_sha256(content)};
+  HttpServer server(content);
+  const Downloader downloader(client, cache_dir);
+
+  server.break_next_response(SIZE / 2U);
+  CHECK_THROWS_AS(downloader.download(
+      server.get_url(), checksum, output_path), runtime_error);
+  CHECK_FALSE(exists(output_path));
+
+  SUBCASE("Remote file is the same") {
+    downloader.download(server.get_url(), checksum, output_path);
+    CHECK(TestData::read_file(output_path) == content);
+    // Only the remaining part must be fetched.
+    CHECK(server.get_sent_bytes() == SIZE);
+  }
+
+  SUBCASE("Remote file has been changed") {
+    const auto new_content{make_content(SIZE, 'b')};
+    server.set_content(new_content);
+    downloader.download(
+        server.get_url(), calc_sha256(new_content), output_path);
+    CHECK(TestData::read_file(output_path) == new_content);
+  }
+}
+
+TEST_CASE("Discard a corrupted download") {
+  const TmpDir tmp_dir;
+  const auto cache_dir{tmp_dir.get_entry().path() / "cache"};
+  const auto output_path{tmp_dir.get_entry().path() / "output"};
+  const HttpClient client;
+
+  const HttpServer server(make_content(1U << 10U, 'a'));
+  CHECK_THROWS_AS(Downloader(client, cache_dir).download(
+      server.get_url(), calc_sha256("another content"), output_path),
+      runtime_error);
+  CHECK_FALSE(exists(output_path));
+  CHECK(filesystem::is_empty(cache_dir / "partial"));
+}
+
+TEST_CASE("Use cached files") {
+  const TmpDir tmp_dir;
+  const auto cache_dir{tmp_dir.get_entry().path() / "cache"};
+  const HttpClient client;
+  const Downloader downloader(client, cache_dir);
+
+  const auto content{make_content(1U << 10U, 'a')};
+  const auto checksum{calc_sha256(content)};
+  const HttpServer server(content);
+  CHECK(downloader.find(checksum).empty());
+
+  const auto blob_path{downloader.fetch(server.get_url(), checksum)};
+  CHECK(TestData::read_file(blob_path) == content);
+  CHECK(downloader.find(checksum) == blob_path);
+
+  const auto requests_count{server.get_requests_count()};
+  CHECK(downloader.fetch(server.get_url(), checksum) == blob_path);
+  CHECK(server.get_requests_count() == requests_count);
+
+  // Removed blob must be downloaded again.
+  remove(blob_path);
+  CHECK(downloader.find(checksum).empty());
+  CHECK(TestData::read_file(
+        downloader.fetch(server.get_url(), checksum)) == content);
+  CHECK(server.get_requests_count() > requests_count);
+}
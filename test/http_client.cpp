@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include <cpr/cprtypes.h>
+#include <cpr/status_codes.h>
+#include <doctest/doctest.h>
+#include "internal/http_server.hpp"
+
+#include "http_client.hpp"
+
+using namespace std;
+using namespace cpr;
+
+TEST_CASE("Reuse connections between requests") {
+  const string content("content");
+  const HttpServer server(content);
+  const HttpClient client;
+
+  const auto head{client.head(Url(server.get_url()))};
+  CHECK(head.status_code == status::HTTP_OK);
+
+  const auto response{client.get(Url(server.get_url()),
+                      Header{{"Range", "bytes=1-"}})};
+  CHECK(response.status_code == status::HTTP_PARTIAL_CONTENT);
+  CHECK(response.text == content.substr(1U));
+
+  string downloaded;
+  const auto download_response{client.download(
+      WriteCallback([&downloaded] (const string& data) {
+        downloaded += data;
+        return true;
+      }), Url(server.get_url()))};
+  CHECK(download_response.status_code == status::HTTP_OK);
+  CHECK(downloaded == content);
+
+  // Copies share connections too.
+  const auto client_copy{client};
+  CHECK(client_copy.get(Url(server.get_url())).text == content);
+
+  CHECK(server.get_requests_count() == 4U);
+  CHECK(server.get_connections_count() == 1U);
+}
+
+TEST_CASE("Make requests concurrently") {
+  constexpr size_t REQUESTS_COUNT{8U};
+  const string content(1U << 16U, 'a');
+  const HttpServer server(content);
+  const HttpClient client;
+
+  vector<future<string>> results;
+  for (size_t i{}; i != REQUESTS_COUNT; ++i) {
+    results.push_back(async(launch::async, [&client, &server] {
+      return client.get(Url(server.get_url())).text;
+    }));
+  }
+  for (auto& r : results) {
+    CHECK(r.get() == content);
+  }
+  CHECK(server.get_requests_count() == REQUESTS_COUNT);
+}
@@ -17,6 +17,8 @@ using namespace filesystem;
 
 void Env::setup(const directory_entry& t_home_dir) {
   set("HOME", t_home_dir.path().string());
+  // Files of the system-wide store mustn't affect tests.
+  set(Sdk::SYSTEM_DIR_ENV_VAR, {});
   unset_xdg_vars();
 }
 
@@ -0,0 +1,250 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "internal/http_server.hpp"
+
+using namespace std;
+
+HttpServer::HttpServer(string t_content, const bool t_ranges_supported):
+    m_ranges_supported(t_ranges_supported) {
+  set_content(move(t_content));
+
+  m_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (m_socket == -1) {
+    throw runtime_error("failed to create a socket");
+  }
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // Port will be chosen by the system.
+  addr.sin_port = 0U;
+  socklen_t addr_len{sizeof(addr)};
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  auto* const sock_addr{reinterpret_cast<sockaddr*>(&addr)};
+  if (bind(m_socket, sock_addr, addr_len) != 0 ||
+      listen(m_socket, SOMAXCONN) != 0 ||
+      getsockname(m_socket, sock_addr, &addr_len) != 0) {
+    close(m_socket);
+    throw runtime_error("failed to start listening");
+  }
+  m_port = ntohs(addr.sin_port);
+  m_accept_thread = thread(&HttpServer::accept_connections, this);
+}
+
+HttpServer::~HttpServer() {
+  // Wake up the blocked accept and recv calls.
+  shutdown(m_socket, SHUT_RDWR);
+  m_accept_thread.join();
+  close(m_socket);
+
+  {
+    const lock_guard lock(m_mutex);
+    for (const auto c : m_connections) {
+      shutdown(c, SHUT_RDWR);
+    }
+  }
+  // No new threads can be added, since the accepting thread is finished.
+  for (auto& t : m_threads) {
+    t.join();
+  }
+}
+
+auto HttpServer::get_url(const string_view t_path) const -> string {
+  return "http://127.0.0.1:" + to_string(m_port) + string(t_path);
+}
+
+void HttpServer::set_content(string t_content) {
+  auto etag{make_etag(t_content)};
+  auto content{make_shared<const string>(move(t_content))};
+  const lock_guard lock(m_mutex);
+  m_content = move(content);
+  m_etag = move(etag);
+}
+
+void HttpServer::set_ranges_supported(const bool t_supported) {
+  const lock_guard lock(m_mutex);
+  m_ranges_supported = t_supported;
+}
+
+void HttpServer::break_next_response(const size_t t_sent_bytes) {
+  const lock_guard lock(m_mutex);
+  m_break_after = t_sent_bytes;
+}
+
+void HttpServer::accept_connections() {
+  while (true) {
+    const auto fd{accept(m_socket, nullptr, nullptr)};
+    if (fd == -1) {
+      return;
+    }
+    ++m_connections_count;
+    const lock_guard lock(m_mutex);
+    m_connections.push_back(fd);
+    m_threads.emplace_back(&HttpServer::serve, this, fd);
+  }
+}
+
+void HttpServer::serve(const int t_fd) {
+  constexpr size_t BUFFER_SIZE{1U << 12U};
+  constexpr string_view HEADERS_END{"\r\n\r\n"};
+  array<char, BUFFER_SIZE> buf{};
+  string data;
+
+  while (true) {
+    const auto headers_end{data.find(HEADERS_END)};
+    if (headers_end == string::npos) {
+      const auto received{recv(t_fd, buf.data(), buf.size(), 0)};
+      if (received <= 0) {
+        break;
+      }
+      data.append(buf.data(), static_cast<size_t>(received));
+      continue;
+    }
+
+    const auto request{data.substr(0U, headers_end)};
+    data.erase(0U, headers_end + HEADERS_END.length());
+
+    auto line_end{request.find("\r\n")};
+    const auto request_line{request.substr(0U, line_end)};
+    headers_t headers;
+
+    while (line_end != string::npos) {
+      const auto line_begin{line_end + 2U};
+      line_end = request.find("\r\n", line_begin);
+      const auto line{request.substr(line_begin, line_end - line_begin)};
+
+      const auto colon_pos{line.find(':')};
+      if (colon_pos == string::npos) {
+        continue;
+      }
+      auto name{line.substr(0U, colon_pos)};
+      transform(name.begin(), name.end(), name.begin(),
+                [] (const char c) { return static_cast<char>(tolower(c)); });
+      const auto value_pos{line.find_first_not_of(' ', colon_pos + 1U)};
+      headers[name] =
+          value_pos == string::npos ? string() : line.substr(value_pos);
+    }
+
+    ++m_requests_count;
+    if (!respond(t_fd, request_line.substr(0U, request_line.find(' ')),
+                 headers)) {
+      break;
+    }
+  }
+
+  const lock_guard lock(m_mutex);
+  m_connections.erase(
+      find(m_connections.begin(), m_connections.end(), t_fd));
+  close(t_fd);
+}
+
+auto HttpServer::respond(const int t_fd, const string_view t_method,
+                         const headers_t& t_headers) -> bool {
+  shared_ptr<const string> content;
+  string etag;
+  bool ranges_supported{};
+  auto break_after{string::npos};
+  {
+    const lock_guard lock(m_mutex);
+    content = m_content;
+    etag = m_etag;
+    ranges_supported = m_ranges_supported;
+    if (t_method != "HEAD") {
+      swap(break_after, m_break_after);
+    }
+  }
+
+  const auto size{content->size()};
+  size_t
+      first{},
+      last{size == 0U ? 0U : size - 1U};
+  bool is_partial{};
+
+  const auto range_iter{t_headers.find("range")};
+  // Range must be ignored if the content has been changed.
+  const auto if_range_iter{t_headers.find("if-range")};
+  if (ranges_supported && range_iter != t_headers.cend() &&
+      (if_range_iter == t_headers.cend() || if_range_iter->second == etag)) {
+    constexpr string_view UNIT{"bytes="};
+    const auto& range{range_iter->second};
+    const auto dash_pos{range.find('-')};
+    if (range.compare(0U, UNIT.length(), UNIT) != 0 ||
+        dash_pos == string::npos) {
+      return send_all(t_fd, "HTTP/1.1 400 Bad Request\r\n"
+                            "Content-Length: 0\r\n\r\n");
+    }
+
+    const auto
+        first_str{range.substr(UNIT.length(), dash_pos - UNIT.length())},
+        last_str{range.substr(dash_pos + 1U)};
+    if (first_str.empty()) {
+      // Suffix range: last N bytes.
+      first = size - min<size_t>(size, stoull(last_str));
+    } else {
+      first = stoull(first_str);
+      if (!last_str.empty()) {
+        last = min<size_t>(last, stoull(last_str));
+      }
+    }
+
+    if (first >= size || first > last) {
+      return send_all(t_fd, "HTTP/1.1 416 Range Not Satisfiable\r\n"
+          "Content-Range: bytes */" + to_string(size) + "\r\n"
+          "Content-Length: 0\r\n\r\n");
+    }
+    is_partial = true;
+  }
+
+  const auto body_size{size == 0U ? 0U : last - first + 1U};
+  string response(is_partial ? "HTTP/1.1 206 Partial Content\r\n" :
+                               "HTTP/1.1 200 OK\r\n");
+  response += "Content-Length: " + to_string(body_size) + "\r\n";
+  if (ranges_supported) {
+    response += "Accept-Ranges: bytes\r\nETag: " + etag + "\r\n";
+  }
+  if (is_partial) {
+    response += "Content-Range: bytes " + to_string(first) + '-' +
+                to_string(last) + '/' + to_string(size) + "\r\n";
+  }
+  response += "\r\n";
+
+  if (t_method == "HEAD") {
+    return send_all(t_fd, response);
+  }
+
+  const auto sent_size{min(body_size, break_after)};
+  response += content->substr(first, sent_size);
+  m_sent_bytes += sent_size;
+  return send_all(t_fd, response) && sent_size == body_size;
+}
+
+auto HttpServer::make_etag(const string_view t_content) -> string {
+  return '"' + to_string(hash<string_view>{}(t_content)) + '"';
+}
+
+auto HttpServer::send_all(const int t_fd, string_view t_data) -> bool {
+  while (!t_data.empty()) {
+    const auto sent{send(t_fd, t_data.data(), t_data.size(), MSG_NOSIGNAL)};
+    if (sent <= 0) {
+      return false;
+    }
+    t_data.remove_prefix(static_cast<size_t>(sent));
+  }
+  return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ * Minimal HTTP/1.1 server, that serves the same content for any path. It's
+ * used as a local stand-in for remote servers. Supports HEAD requests,
+ * single byte ranges (including If-Range) and persistent connections.
+ */
+class HttpServer {
+public:
+  // Starts listening on a random port of the loopback
+  // interface. Throws an exception on failure.
+  explicit HttpServer(std::string content, bool ranges_supported = true);
+  // Closes all connections and waits for the serving threads.
+  ~HttpServer();
+
+  HttpServer(const HttpServer&) = delete;
+  auto operator=(const HttpServer&) -> HttpServer& = delete;
+  HttpServer(HttpServer&&) = delete;
+  auto operator=(HttpServer&&) -> HttpServer& = delete;
+
+  [[nodiscard]] auto get_url(std::string_view path = "/") const -> std::string;
+  // Entity tag of the content changes too.
+  void set_content(std::string content);
+  // Affects the following requests, as if the server was replaced.
+  void set_ranges_supported(bool supported);
+  /*
+   * The next response body will be cut off after
+   * the specified number of bytes and the connection
+   * closed, as if the network failed.
+   */
+  void break_next_response(std::size_t sent_bytes);
+  // Returns total number of sent body bytes.
+  [[nodiscard]] inline auto get_sent_bytes() const
+      { return m_sent_bytes.load(); }
+  [[nodiscard]] inline auto get_requests_count() const
+      { return m_requests_count.load(); }
+  // Returns number of accepted connections.
+  [[nodiscard]] inline auto get_connections_count() const
+      { return m_connections_count.load(); }
+
+private:
+  // Header names are lowercase.
+  using headers_t = std::map<std::string, std::string>;
+
+  void accept_connections();
+  void serve(int fd);
+  // Returns false if the connection must be closed.
+  auto respond(int fd, std::string_view method,
+               const headers_t& headers) -> bool;
+  // Returns false if the connection is broken.
+  static auto send_all(int fd, std::string_view data) -> bool;
+
+  [[nodiscard]] static auto
+      make_etag(std::string_view content) -> std::string;
+
+  int m_socket{-1};
+  unsigned short m_port{};
+  std::atomic<std::size_t>
+      m_sent_bytes{},
+      m_requests_count{},
+      m_connections_count{};
+
+  std::mutex m_mutex;
+  // Following members are guarded by the mutex.
+  // Responses hold the content, so it can be replaced at any time.
+  std::shared_ptr<const std::string> m_content;
+  std::string m_etag;
+  bool m_ranges_supported;
+  std::size_t m_break_after{std::string::npos};
+  std::vector<int> m_connections;
+  std::vector<std::thread> m_threads;
+  std::thread m_accept_thread;
+};
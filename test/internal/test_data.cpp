@@ -0,0 +1,26 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <fstream>
+#include <iterator>
+
+#include "internal/test_data.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+auto TestData::read_file(const path& t_path) -> string {
+  ifstream ifs(t_path, ios::binary);
+  return {istreambuf_iterator(ifs), istreambuf_iterator<char>()};
+}
+
+auto TestData::make_random(const size_t t_size, mt19937& t_engine) -> string {
+  string content(t_size, '\0');
+  for (auto& c : content) {
+    c = static_cast<char>(t_engine());
+  }
+  return content;
+}
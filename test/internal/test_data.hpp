@@ -0,0 +1,24 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <random>
+#include <string>
+
+// Prepares and reads contents of files used by test cases.
+class TestData {
+public:
+  // Returns empty string if the file can't be read.
+  [[nodiscard]] static auto
+      read_file(const std::filesystem::path& path) -> std::string;
+  // Random bytes can't be compressed. The engine is shared, so every call
+  // returns different content.
+  [[nodiscard]] static auto
+      make_random(std::size_t size, std::mt19937& engine) -> std::string;
+};
@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include "internal/tmp_dir.hpp"
+
+#include "ledger.hpp"
+
+using namespace std;
+using namespace filesystem;
+using namespace chrono_literals;
+
+TEST_CASE("Ledger") {
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto ledger_path{dir / "ledger"};
+  const auto file_path{dir / "sub dir" / "file name"};
+  create_directory(file_path.parent_path());
+  ofstream(file_path) << "content";
+
+  {
+    Ledger ledger(ledger_path);
+    CHECK_FALSE(ledger.is_up_to_date("component", "sha"));
+    REQUIRE(ledger.record("component", "sha", {file_path}));
+    CHECK_FALSE(ledger.record("missing", "sha", {dir / "missing"}));
+    REQUIRE(ledger.save());
+  }
+
+  Ledger ledger(ledger_path);
+  CHECK(ledger.is_up_to_date("component", "sha"));
+  CHECK_FALSE(ledger.is_up_to_date("component", "another sha"));
+  CHECK_FALSE(ledger.is_up_to_date("missing", "sha"));
+
+  SUBCASE("Modified file") {
+    ofstream(file_path, ios::app) << " changed";
+    CHECK_FALSE(ledger.is_up_to_date("component", "sha"));
+  }
+
+  SUBCASE("Forget a component") {
+    ledger.forget("component");
+    CHECK_FALSE(ledger.is_up_to_date("component", "sha"));
+  }
+
+  SUBCASE("Malformed file") {
+    ofstream(ledger_path, ios::app) << "component sha 1\n";
+    CHECK_FALSE(Ledger(ledger_path).is_up_to_date("component", "sha"));
+  }
+}
+
+TEST_CASE("Verify recorded files") {
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const array file_paths{dir / "a", dir / "b", dir / "c"};
+  for (const auto& p : file_paths) {
+    ofstream(p) << p.filename().string();
+  }
+
+  Ledger ledger(dir / "ledger");
+  REQUIRE(ledger.record("first", "sha", {file_paths[0], file_paths[1]}));
+  REQUIRE(ledger.record("second", "sha", {file_paths[2]}));
+  CHECK(ledger.is_recorded(file_paths[0]));
+  CHECK_FALSE(ledger.is_recorded(dir / "d"));
+  CHECK(ledger.verify().empty());
+
+  // Size and modification time are preserved, but content isn't.
+  const auto mod_time{last_write_time(file_paths[1])};
+  ofstream(file_paths[1]) << 'x';
+  last_write_time(file_paths[1], mod_time);
+  remove(file_paths[2]);
+
+  uintmax_t reported_verified{}, reported_total{};
+  const auto mismatches{ledger.verify(
+      [&] (const uintmax_t verified, const uintmax_t total) {
+    reported_verified = verified;
+    reported_total = total;
+  })};
+  CHECK(reported_verified == reported_total);
+  REQUIRE(mismatches.size() == 2U);
+  CHECK(mismatches[0].component == "first");
+  CHECK(mismatches[0].path == file_paths[1]);
+  CHECK(mismatches[1].component == "second");
+  CHECK(mismatches[1].path == file_paths[2]);
+}
+
+TEST_CASE("Merge ledgers") {
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto file_path{dir / "file"};
+  ofstream(file_path) << "content";
+
+  Ledger ledger(dir / "ledger");
+  REQUIRE(ledger.record("component", "old sha", {file_path}));
+  Ledger imported(dir / "imported");
+  REQUIRE(imported.record("component", "new sha", {file_path}));
+  CHECK(imported.get_files() == vector<path>{"file"});
+
+  // The file is replaced by a copy with the same content.
+  ofstream(file_path) << "content";
+  last_write_time(file_path, last_write_time(file_path) - 1h);
+  CHECK_FALSE(imported.is_up_to_date("component", "new sha"));
+  REQUIRE(imported.refresh_metadata());
+  CHECK(imported.is_up_to_date("component", "new sha"));
+
+  ledger.merge(imported);
+  CHECK(ledger.is_up_to_date("component", "new sha"));
+  CHECK_FALSE(ledger.is_up_to_date("component", "old sha"));
+}
+
+TEST_CASE("Find duplicates") {
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const array file_paths{dir / "a", dir / "b", dir / "c", dir / "d", dir / "e"};
+  ofstream(file_paths[0]) << "same";
+  ofstream(file_paths[1]) << "same";
+  ofstream(file_paths[2]) << "other";
+  // Empty files aren't grouped.
+  ofstream{file_paths[3]};
+  ofstream{file_paths[4]};
+
+  Ledger ledger(dir / "ledger");
+  REQUIRE(ledger.record("first", "sha", {file_paths[0], file_paths[3]}));
+  REQUIRE(ledger.record("second", "sha",
+                        {file_paths[1], file_paths[2], file_paths[4]}));
+  CHECK(ledger.find_duplicates() ==
+        vector<vector<path>>{{"a", "b"}});
+
+  SUBCASE("Modified file") {
+    ofstream(file_paths[1], ios::app) << " changed";
+    CHECK(ledger.find_duplicates().empty());
+  }
+}
+
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include <libzippp/libzippp.h>
+#include "internal/test_data.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "local_zip.hpp"
+
+using namespace std;
+using namespace filesystem;
+using namespace libzippp;
+
+TEST_CASE("Extract entries of a local ZIP archive") {
+  constexpr size_t LARGE_FILE_SIZE{1U << 20U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto archive_path{dir / "archive.zip"};
+
+  const string redundant_content(LARGE_FILE_SIZE, 'a');
+  // Incompressible data is stored without compression.
+  mt19937 engine;
+  const auto random_content{TestData::make_random(LARGE_FILE_SIZE, engine)};
+  {
+    ZipArchive zip(archive_path);
+    REQUIRE(zip.open(ZipArchive::Write));
+    REQUIRE(zip.addData("redundant",
+                        redundant_content.data(), redundant_content.size()));
+    REQUIRE(zip.addData("dir/random",
+                        random_content.data(), random_content.size()));
+    REQUIRE(zip.addData("empty", nullptr, 0U));
+    REQUIRE(zip.close() == LIBZIPPP_OK);
+  }
+
+  LocalZip zip(archive_path);
+  REQUIRE(zip.open());
+  const auto& directory{zip.get_directory()};
+  REQUIRE(directory.get_entries().size() == 3U);
+
+  SUBCASE("Single entry") {
+    const auto output_path{dir / "output"};
+    zip.extract(*directory.find("redundant"), output_path);
+    CHECK(TestData::read_file(output_path) == redundant_content);
+  }
+
+  SUBCASE("All entries") {
+    vector<LocalZip::Target> targets;
+    for (const auto& e : directory.get_entries()) {
+      targets.emplace_back(&e, dir / path(e.name).filename());
+    }
+    size_t extracted{};
+    zip.extract_all(targets, 2U, [&extracted] (const ZipDirectory::Entry&) {
+      ++extracted;
+    });
+
+    CHECK(extracted == targets.size());
+    CHECK(TestData::read_file(dir / "redundant") == redundant_content);
+    CHECK(TestData::read_file(dir / "random") == random_content);
+    CHECK(TestData::read_file(dir / "empty").empty());
+  }
+
+  SUBCASE("Hard link of output") {
+    const auto output_path{dir / "output"};
+    ofstream(output_path) << "content";
+    create_hard_link(output_path, dir / "link");
+    zip.extract(*directory.find("empty"), output_path);
+    CHECK(TestData::read_file(output_path).empty());
+    CHECK(TestData::read_file(dir / "link") == "content");
+  }
+
+  SUBCASE("Missing output directory") {
+    CHECK_THROWS_AS(zip.extract_all(
+        {{directory.find("empty"), dir / "missing" / "empty"}}),
+        runtime_error);
+  }
+}
+
+TEST_CASE("Open an invalid archive") {
+  const TmpDir tmp_dir;
+  const auto archive_path{tmp_dir.get_entry().path() / "archive.zip"};
+  ofstream(archive_path) << "not an archive";
+  CHECK_FALSE(LocalZip(archive_path).open());
+  CHECK_FALSE(LocalZip(archive_path.parent_path() / "missing").open());
+}
@@ -41,7 +41,8 @@ auto main(int argc, char* argv[]) -> int {
     Env::set_sdk_home(sdk_home);
   } else {
     // Persistent TODO: exclude SDK dependent test cases.
-    context.addFilter("test-case-exclude", "Create projects,JVM tools");
+    context.addFilter("test-case-exclude", "Create projects,JVM tools,"
+                      "Merge DEX files,Spawn latency with JVM");
   }
 
   const auto status{context.run()};
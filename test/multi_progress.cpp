@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <future>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include "multi_progress.hpp"
+
+using namespace std;
+
+TEST_CASE("Render stacked progress bars") {
+  constexpr unsigned short WIDTH{40U};
+  ostringstream oss;
+  MultiProgress progress(WIDTH, true, oss);
+
+  auto& first{progress.add("First")};
+  auto& second{progress.add("Second", true)};
+  first.show();
+  second.show();
+  second = 50.0;
+  CHECK(oss.str().find("First") != string::npos);
+  CHECK(oss.str().find("Second") != string::npos);
+
+  first.finish(true, "First is done");
+  oss.str({});
+  second = "Second bar";
+  // Finished bars must not be redrawn.
+  second.set_determined(false);
+  CHECK(oss.str().find("First") == string::npos);
+  CHECK(oss.str().find("Second bar") != string::npos);
+
+  // Lines must not be wrapped.
+  second = string(WIDTH * 2U, 'a');
+  second.set_determined(true);
+  CHECK(oss.str().find(string(WIDTH, 'a')) == string::npos);
+}
+
+TEST_CASE("Update progress bars concurrently") {
+  constexpr size_t BARS_COUNT{4U};
+  ostringstream oss;
+  // Non-interactive output contains only messages of the finished bars.
+  MultiProgress progress(30U, false, oss);
+
+  vector<future<void>> tasks;
+  for (size_t i{}; i != BARS_COUNT; ++i) {
+    auto& bar{progress.add("Bar " + to_string(i), true)};
+    tasks.push_back(async(launch::async, [&bar, i] {
+      bar.show();
+      for (unsigned short p{}; p <= 100U; ++p) {
+        bar = static_cast<double>(p);
+      }
+      bar.finish(true, "Bar " + to_string(i) + " finished");
+    }));
+  }
+  for (auto& t : tasks) {
+    t.get();
+  }
+
+  const auto output{oss.str()};
+  for (size_t i{}; i != BARS_COUNT; ++i) {
+    CHECK(output.find("Bar " + to_string(i) + " finished") != string::npos);
+  }
+  // Bars themselves mustn't be drawn.
+  CHECK(output.find('[') == string::npos);
+}
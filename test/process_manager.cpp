@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <doctest/doctest.h>
+#include "internal/env.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "process_manager.hpp"
+
+using namespace std;
+using namespace chrono;
+using namespace filesystem;
+
+TEST_CASE("Supervise several processes") {
+  constexpr size_t PROCESSES_COUNT{4U};
+  ProcessManager manager;
+  vector<vector<string>> outputs(PROCESSES_COUNT);
+
+  for (size_t i{}; i != PROCESSES_COUNT; ++i) {
+    ProcessManager::Command command;
+    // Output lines of the input and exit with the index as a code.
+    command.args = {"sh", "-c", "cat; exit " + to_string(i)};
+    command.input = "first\nsecond " + to_string(i);
+    command.out_callback = [&outputs, i] (const string_view line) {
+      outputs.at(i).emplace_back(line);
+    };
+    CHECK(manager.start(move(command)) == i);
+  }
+
+  const auto results{manager.wait()};
+  REQUIRE(results.size() == PROCESSES_COUNT);
+  for (size_t i{}; i != PROCESSES_COUNT; ++i) {
+    CHECK(results.at(i).exit_code == static_cast<int>(i));
+    CHECK_FALSE(results.at(i).timed_out);
+    CHECK(outputs.at(i) == vector<string>{"first", "second " + to_string(i)});
+  }
+}
+
+TEST_CASE("Large output and input") {
+  constexpr size_t LINES_COUNT{100'000U};
+  string input;
+  for (size_t i{}; i != LINES_COUNT; ++i) {
+    input += to_string(i) + '\n';
+  }
+
+  ProcessManager::Command command;
+  command.args = {"cat"};
+  command.input = input;
+  size_t lines_count{};
+  bool in_order{true};
+  command.out_callback = [&] (const string_view line) {
+    in_order = in_order && line == to_string(lines_count);
+    ++lines_count;
+  };
+
+  ProcessManager manager;
+  manager.start(move(command));
+  CHECK(manager.wait().front().exit_code == 0);
+  CHECK(lines_count == LINES_COUNT);
+  CHECK(in_order);
+}
+
+TEST_CASE("Kill a process on timeout") {
+  ProcessManager::Command command;
+  command.args = {"sleep", "10"};
+  command.timeout = milliseconds(100);
+
+  ProcessManager manager;
+  manager.start(move(command));
+  const auto result{manager.wait().front()};
+  CHECK(result.timed_out);
+  CHECK(result.exit_code == 128 + SIGKILL);
+}
+
+TEST_CASE("Start a missing executable") {
+  ProcessManager::Command command;
+  command.args = {"/nonexistent"};
+  ProcessManager manager;
+  CHECK_THROWS_AS(manager.start(move(command)), runtime_error);
+  CHECK(manager.wait().empty());
+}
+
+TEST_CASE("Working directory and environment") {
+  const TmpDir tmp_dir;
+  const auto work_dir{tmp_dir.get_entry().path()};
+  const auto prev_work_dir{current_path()};
+
+  ProcessManager::Command command;
+  command.args = {"sh", "-c", "pwd; echo \"$APM_TEST_VAR\""};
+  command.work_dir = work_dir;
+  command.env = {{"APM_TEST_VAR", "value"}};
+  vector<string> out;
+  command.out_callback = [&out] (const string_view line) {
+    out.emplace_back(line);
+  };
+
+  ProcessManager manager;
+  manager.start(move(command));
+  CHECK(manager.wait().front().exit_code == 0);
+  CHECK(out == vector<string>{work_dir.string(), "value"});
+  // Working directory of the tests process mustn't be changed.
+  CHECK(current_path() == prev_work_dir);
+}
+
+TEST_CASE("Spawn latency with JVM") {
+  constexpr size_t SPAWNS_COUNT{100U};
+  // Loaded JVM maps a lot of memory, which makes fork expensive.
+  const auto jvm{Env::get_jvm()};
+
+  const auto measure{[SPAWNS_COUNT] (const auto& spawn) {
+    const auto start_time{steady_clock::now()};
+    for (size_t i{}; i != SPAWNS_COUNT; ++i) {
+      spawn();
+    }
+    return duration_cast<microseconds>(
+        steady_clock::now() - start_time) / SPAWNS_COUNT;
+  }};
+
+  const auto spawn_latency{measure([] {
+    ProcessManager::Command command;
+    command.args = {"true"};
+    ProcessManager manager;
+    manager.start(move(command));
+    CHECK(manager.wait().front().exit_code == 0);
+  })};
+  const auto fork_latency{measure([] {
+    const auto pid{fork()};
+    if (pid == 0) {
+      execlp("true", "true", nullptr);
+      _exit(EXIT_FAILURE);
+    }
+    int status{};
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    CHECK(status == 0);
+  })};
+
+  MESSAGE("Average latency of running a process: " <<
+          spawn_latency.count() << " µs using spawn, " <<
+          fork_latency.count() << " µs using fork");
+}
+
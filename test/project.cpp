@@ -4,15 +4,22 @@
  * Licensed under the Apache License, Version 2.0
  */
 
+#include <algorithm>
 #include <array>
+#include <cstddef>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <system_error>
+#include <vector>
 
 #include <doctest/doctest.h>
+#include <pugixml.hpp>
 #include "apm.hpp"
+#include "local_zip.hpp"
 #include "project.hpp"
+#include "zip_writer.hpp"
 
 #include "internal/alt_stream.hpp"
 #include "internal/args.hpp"
@@ -49,5 +56,71 @@ TEST_CASE("Create projects") {
 
     REQUIRE(apm.run(args.get_argc(), args.get_argv()) == EXIT_SUCCESS);
     REQUIRE((*alt_cerr).tellp() == streampos(0));
+
+    // Native libraries are mapped from the APK instead of extracting.
+    const auto manifest_path{projects_path / to_string(project_counter) /
+                             "app" / "AndroidManifest.xml"};
+    pugi::xml_document manifest;
+    REQUIRE(manifest.load_file(manifest_path.c_str()));
+    CHECK(string(manifest.child("manifest").child("application")
+          .attribute("android:extractNativeLibs").value()) == "false");
+  }
+}
+
+TEST_CASE("Write APK entries") {
+  constexpr size_t PAGE_ALIGNMENT{4096U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto apk_path{dir / "app.apk"};
+
+  // Compressible content, so aligned entries must be stored.
+  const string content(PAGE_ALIGNMENT / 2U, 'c');
+  ofstream(dir / "file") << content;
+  const vector<string> names{
+    "res/layout/main.xml", "classes.dex", "lib/x86/libapp.so",
+    "assets/data", "resources.arsc", "lib/x86/gdbserver",
+    "AndroidManifest.xml", "lib/arm64-v8a/libapp.so"
+  };
+  vector<Project::ApkEntry> entries;
+  for (const auto& n : names) {
+    entries.emplace_back(n, dir / "file");
+  }
+  {
+    ZipWriter writer(apk_path, ZipWriter::Compression::FAST);
+    Project::write_apk_entries(writer, entries);
+    writer.finish();
+  }
+
+  LocalZip apk(apk_path);
+  REQUIRE(apk.open());
+  vector<const ZipDirectory::Entry*> apk_entries;
+  for (const auto& n : names) {
+    const auto* const entry{apk.get_directory().find(n)};
+    REQUIRE(entry != nullptr);
+    apk_entries.push_back(entry);
+  }
+  sort(apk_entries.begin(), apk_entries.end(),
+       [] (const auto* const lhs, const auto* const rhs) {
+    return lhs->local_header_offset < rhs->local_header_offset;
+  });
+
+  // Entries, which are read on startup, come first, others keep their order.
+  const array<string, 8U> expected_names{
+    "AndroidManifest.xml", "resources.arsc", "classes.dex",
+    "res/layout/main.xml", "lib/x86/libapp.so", "assets/data",
+    "lib/x86/gdbserver", "lib/arm64-v8a/libapp.so"
+  };
+  for (size_t i{}; i != expected_names.size(); ++i) {
+    CHECK(apk_entries.at(i)->name == expected_names.at(i));
+  }
+
+  // Other entries are compressed as usual.
+  CHECK(apk.get_directory().find("lib/x86/gdbserver")->method ==
+        ZipDirectory::Method::DEFLATED);
+  for (const auto& n : {"resources.arsc", "lib/x86/libapp.so",
+                        "lib/arm64-v8a/libapp.so"}) {
+    const auto* const entry{apk.get_directory().find(n)};
+    CHECK(entry->method == ZipDirectory::Method::STORED);
+    CHECK(apk.get_data_offset(*entry) % PAGE_ALIGNMENT == 0U);
   }
 }
@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+#include <doctest/doctest.h>
+#include <libzippp/libzippp.h>
+#include "internal/http_server.hpp"
+#include "internal/test_data.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "remote_zip.hpp"
+#include "sha256.hpp"
+
+using namespace std;
+using namespace libzippp;
+
+TEST_CASE("Fetch entries of a remote ZIP archive") {
+  constexpr size_t LARGE_FILE_SIZE{1U << 20U};
+  const TmpDir tmp_dir;
+  const auto archive_path{tmp_dir.get_entry().path() / "archive.zip"};
+
+  const string small_content("content");
+  string large_content;
+  // Make data poorly compressible, so the archive will be large.
+  for (size_t i{}; large_content.size() < LARGE_FILE_SIZE; ++i) {
+    large_content += to_string(i * i * 2654435761U);
+  }
+  {
+    ZipArchive zip(archive_path);
+    REQUIRE(zip.open(ZipArchive::Write));
+    REQUIRE(zip.addData("small", small_content.data(), small_content.size()));
+    REQUIRE(zip.addData("dir/large",
+                        large_content.data(), large_content.size()));
+    REQUIRE(zip.close() == LIBZIPPP_OK);
+  }
+
+  auto archive{TestData::read_file(archive_path)};
+  const auto archive_size{archive.size()};
+
+  SUBCASE("Server supports ranges") {
+    const HttpServer server(move(archive));
+    RemoteZip zip(HttpClient(), server.get_url("/archive.zip"));
+    REQUIRE(zip.open());
+
+    const auto* const entry{zip.get_directory().find("small")};
+    REQUIRE(entry != nullptr);
+    ostringstream oss;
+    size_t fetched_bytes{};
+    zip.extract(*entry, oss, [&fetched_bytes] (const size_t bytes) {
+      fetched_bytes += bytes;
+    });
+
+    CHECK(oss.str() == small_content);
+    CHECK(fetched_bytes == entry->compressed_size);
+    // Large entry must not be fetched.
+    CHECK(server.get_sent_bytes() < archive_size / 2U);
+
+    oss.str({});
+    Sha256 sha256;
+    zip.extract(*zip.get_directory().find("dir/large"), oss, {}, &sha256);
+    CHECK(oss.str() == large_content);
+    Sha256 expected_sha256;
+    expected_sha256.update(large_content.data(), large_content.size());
+    CHECK(sha256.finish() == expected_sha256.finish());
+  }
+
+  SUBCASE("Server stops supporting ranges") {
+    HttpServer server(move(archive));
+    RemoteZip zip(HttpClient(), server.get_url());
+    REQUIRE(zip.open());
+    server.set_ranges_supported(false);
+
+    ostringstream oss;
+    CHECK_THROWS(zip.extract(*zip.get_directory().find("dir/large"), oss));
+    // Whole archive in the response body mustn't get to the output.
+    CHECK(oss.str().empty());
+  }
+
+  SUBCASE("Server doesn't support ranges") {
+    const HttpServer server(move(archive), false);
+    RemoteZip zip(HttpClient(), server.get_url());
+    CHECK_FALSE(zip.open());
+    CHECK(server.get_sent_bytes() == 0U);
+  }
+}
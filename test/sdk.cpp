@@ -6,7 +6,11 @@
 
 #include <array>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <system_error>
 
@@ -17,10 +21,12 @@
 #include "internal/tmp_dir.hpp"
 
 #include "general/enum_array.hpp"
+#include "general/scope_guard.hpp"
 #include "apm.hpp"
 #include "sdk.hpp"
 
 using namespace std;
+using namespace filesystem;
 
 TEST_CASE("Install SDKs") {
   MESSAGE("SDKs installation in progress... So as not run this test case every "
@@ -49,6 +55,8 @@ TEST_CASE("Install SDKs") {
     }
 
     const Sdk sdk;
+    CHECK(sdk.get_installed_apis().count(a) == 1U);
+    CHECK(sdk.get_api() == a);
     // Check if all files are installed.
     for (size_t t{}; t != size<Sdk::Tool>(); ++t) {
       CHECK_NOTHROW(static_cast<void>(
@@ -64,3 +72,54 @@ TEST_CASE("Install SDKs") {
     }
   }
 }
+
+TEST_CASE("Resolve files of the system store") {
+  const TmpDir
+      home_dir,
+      system_dir;
+  const auto system_path{system_dir.get_entry().path()};
+  Env::setup(home_dir.get_entry());
+  Env::set(Sdk::SYSTEM_DIR_ENV_VAR, system_path.string());
+  const ScopeGuard env_guard([] { Env::set(Sdk::SYSTEM_DIR_ENV_VAR, {}); });
+
+  const array<path, 7U> file_paths{
+    "api-28/bin/aapt2", "api-28/bin/zipalign", "api-28/lib/apksigner.jar",
+    "api-28/lib/d8.jar", "api-28/lib/android.jar", "lib/apm-jni.jar", "tzdata"
+  };
+  for (const auto& p : file_paths) {
+    create_directories((system_path / p).parent_path());
+    ofstream(system_path / p);
+  }
+
+  const Sdk sdk;
+  CHECK(sdk.get_installed_apis() == set<unsigned short>{28U});
+  CHECK(sdk.get_api() == 28U);
+  CHECK(sdk.get_tool_path(Sdk::Tool::AAPT2) == system_path / file_paths[0]);
+  CHECK(sdk.get_jar_path(Sdk::Jar::APM_JNI) == system_path / file_paths[5]);
+  CHECK(sdk.get_file_path(Sdk::File::TZDATA) == system_path / file_paths[6]);
+  CHECK_THROWS_AS(static_cast<void>(sdk.get_file_path(
+                  Sdk::File::DEBUG_KEYSTORE)), runtime_error);
+
+  SUBCASE("Files of a given API") {
+    for (size_t i{}; i != 5U; ++i) {
+      const auto p{system_path / "api-30" /
+                   file_paths.at(i).lexically_relative("api-28")};
+      create_directories(p.parent_path());
+      ofstream{p};
+    }
+    const Sdk newer_sdk;
+    REQUIRE(newer_sdk.get_api() == 30U);
+    CHECK(newer_sdk.get_tool_path(Sdk::Tool::AAPT2, true, 28U) ==
+          system_path / file_paths[0]);
+    CHECK(newer_sdk.get_jar_path(Sdk::Jar::FRAMEWORK, true, 28U) ==
+          system_path / file_paths[4]);
+  }
+
+  SUBCASE("User's files take precedence") {
+    const auto user_path{home_dir.get_entry().path() /
+                         ".local" / "share" / "apm" / "tzdata"};
+    create_directories(user_path.parent_path());
+    ofstream{user_path};
+    CHECK(Sdk().get_file_path(Sdk::File::TZDATA) == user_path);
+  }
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <string_view>
+
+#include <doctest/doctest.h>
+#include "sha256.hpp"
+
+using namespace std;
+
+TEST_CASE("Calculate SHA256 incrementally") {
+  constexpr string_view
+      EMPTY_HASH(
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"),
+      CONTENT("content"),
+      CONTENT_HASH(
+          "ed7002b439e9ac845f22357d822bac1444730fbdb6016d3ec9432297b9ec9f73");
+
+  Sha256 sha256;
+  CHECK(sha256.finish() == EMPTY_HASH);
+
+  // Feed data by parts.
+  for (const auto c : CONTENT) {
+    REQUIRE(sha256.update(&c, 1U));
+  }
+  CHECK(sha256.finish() == CONTENT_HASH);
+
+  // Calculator must start from scratch after finishing.
+  REQUIRE(sha256.update(CONTENT.data(), CONTENT.size()));
+  CHECK(sha256.finish() == CONTENT_HASH);
+}
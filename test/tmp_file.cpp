@@ -31,3 +31,19 @@ TEST_CASE("Create a temporary file") {
   file.reset();
   CHECK_FALSE(exists(path));
 }
+
+TEST_CASE("Create a temporary file in memory") {
+  TmpFile<fstream> file(ios::in | ios::out | ios::trunc,
+                        TmpFile<fstream>::Storage::MEMORY);
+  auto& fs{file.get_stream()};
+  fs << "content" << flush;
+
+  // File can be reopened by its path.
+  ifstream ifs(file.get_path());
+  string content{istreambuf_iterator(ifs), istreambuf_iterator<char>()};
+  CHECK(content == "content");
+
+  auto moved_file{move(file)};
+  CHECK(file.get_path().empty());
+  CHECK(ifstream(moved_file.get_path()).is_open());
+}
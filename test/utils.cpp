@@ -5,20 +5,21 @@
  */
 
 #include <array>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
-#include <limits>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <vector>
 
-#include <cpr/cprtypes.h>
-#include <cpr/status_codes.h>
-#include <fcli/progress.hpp>
+#include <sys/stat.h>
 
 #include <doctest/doctest.h>
 #include "internal/alt_stream.hpp"
+#include "internal/test_data.hpp"
 #include "internal/tmp_dir.hpp"
 
 #include "tmp_file.hpp"
@@ -26,7 +27,7 @@
 
 using namespace std;
 using namespace filesystem;
-using namespace fcli;
+using namespace chrono_literals;
 
 TEST_CASE("Confirmation requester") {
   AltStream
@@ -85,19 +86,6 @@ TEST_CASE("Check the standard input stream") {
   CHECK(cin);
 }
 
-TEST_CASE("Download a file") {
-  using namespace cpr;
-
-  Progress progress({}, true, cout);
-  TmpFile file;
-  auto& ofs{file.get_stream()};
-  const Url url("https://github.com/lem0nez/apm/raw/data/manifest.xml");
-
-  REQUIRE(Utils::download(ofs, url, progress).status_code == status::HTTP_OK);
-  CHECK(progress.get_percents() > numeric_limits<double>::epsilon());
-  CHECK(ofs.tellp() > streampos(0));
-}
-
 TEST_CASE("Calculate SHA256") {
   constexpr string_view
       EMPTY_HASH(
@@ -119,6 +107,52 @@ TEST_CASE("Calculate SHA256") {
   CHECK(Utils::calc_sha256(path).empty());
 }
 
+TEST_CASE("Copy a file") {
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto
+      source_path{dir / "source"},
+      target_path{dir / "target"};
+
+  const string content(3U << 20U, 'c');
+  ofstream(source_path) << content;
+  REQUIRE(Utils::copy_file(source_path, target_path));
+  CHECK(TestData::read_file(target_path) == content);
+  CHECK(last_write_time(target_path) == last_write_time(source_path));
+  // Temporary file must not be left.
+  CHECK(distance(directory_iterator(dir), directory_iterator()) == 2);
+
+  // The same content isn't rewritten, so the file isn't replaced.
+  const auto get_inode{[&target_path] {
+    struct stat st{};
+    REQUIRE(stat(target_path.c_str(), &st) == 0);
+    return st.st_ino;
+  }};
+  const auto inode{get_inode()};
+  REQUIRE(Utils::copy_file(source_path, target_path));
+  CHECK(get_inode() == inode);
+
+  // Only time differs, so the content is compared.
+  last_write_time(target_path, last_write_time(source_path) - 1h);
+  REQUIRE(Utils::copy_file(source_path, target_path));
+  CHECK(get_inode() == inode);
+  CHECK(last_write_time(target_path) == last_write_time(source_path));
+
+  // Files with the same size and time are considered unchanged.
+  ofstream(source_path) << string(content.size(), 'd');
+  last_write_time(source_path, last_write_time(target_path));
+  REQUIRE(Utils::copy_file(source_path, target_path));
+  CHECK(TestData::read_file(target_path) == content);
+
+  ofstream(source_path) << "changed";
+  REQUIRE(Utils::copy_file(source_path, target_path));
+  CHECK(TestData::read_file(target_path) == "changed");
+
+  CHECK_FALSE(Utils::copy_file(dir / "missing", target_path));
+  CHECK_FALSE(Utils::copy_file(source_path, dir / "missing" / "target"));
+  CHECK(TestData::read_file(target_path) == "changed");
+}
+
 TEST_CASE("Execute commands") {
   CHECK(Utils::exec({"echo"}) == 0);
 
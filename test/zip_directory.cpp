@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <stdexcept>
+#include <string>
+
+#include <doctest/doctest.h>
+#include <libzippp/libzippp.h>
+#include "internal/test_data.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "zip_directory.hpp"
+
+using namespace std;
+using namespace libzippp;
+
+TEST_CASE("Parse ZIP central directory") {
+  const TmpDir tmp_dir;
+  const auto archive_path{tmp_dir.get_entry().path() / "archive.zip"};
+  const string content(1U << 10U, 'a');
+  {
+    ZipArchive zip(archive_path);
+    REQUIRE(zip.open(ZipArchive::Write));
+    REQUIRE(zip.addData("file", content.data(), content.size()));
+    REQUIRE(zip.addData("dir/empty", nullptr, 0U));
+    REQUIRE(zip.close() == LIBZIPPP_OK);
+  }
+
+  const auto archive{TestData::read_file(archive_path)};
+
+  const auto location{ZipDirectory::find_location(archive, 0U)};
+  CHECK(location.entries_count == 2U);
+  REQUIRE(location.offset + location.size <= archive.size());
+
+  const ZipDirectory directory(archive.substr(location.offset, location.size));
+  CHECK(directory.get_entries().size() == 2U);
+  CHECK(directory.find("missing") == nullptr);
+
+  const auto* const entry{directory.find("file")};
+  REQUIRE(entry != nullptr);
+  CHECK(entry->uncompressed_size == content.size());
+  // Data must be compressed, since it's highly redundant.
+  CHECK(entry->compressed_size < content.size());
+
+  const auto header_size{ZipDirectory::get_local_header_size(
+      archive.substr(entry->local_header_offset))};
+  CHECK(header_size >= ZipDirectory::LOCAL_HEADER_SIZE + entry->name.size());
+
+  // Tail without the end of central directory record.
+  CHECK_THROWS_AS(static_cast<void>(ZipDirectory::find_location(
+      archive.substr(0U, location.offset), 0U)), runtime_error);
+}
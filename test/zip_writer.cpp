@@ -0,0 +1,326 @@
+/*
+ * Copyright © 2021 Nikita Dudko. All rights reserved.
+ * Contacts: <nikita.dudko.95@gmail.com>
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <doctest/doctest.h>
+#include "internal/test_data.hpp"
+#include "internal/tmp_dir.hpp"
+
+#include "local_zip.hpp"
+#include "zip_writer.hpp"
+
+using namespace std;
+using namespace filesystem;
+
+TEST_CASE("Write a ZIP archive") {
+  constexpr size_t LARGE_FILE_SIZE{3U << 20U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto archive_path{dir / "archive.zip"};
+
+  const string large_content(LARGE_FILE_SIZE, 'a');
+  ofstream(dir / "large") << large_content;
+  ofstream(dir / "small") << "small";
+  ofstream(dir / "empty");
+  permissions(dir / "small", perms::owner_exec, perm_options::add);
+
+  {
+    ZipWriter writer(archive_path);
+    writer.add("dir/large", dir / "large");
+    writer.add("small", dir / "small");
+    writer.add("empty", dir / "empty");
+    CHECK_THROWS_AS(writer.add("missing", dir / "missing"), runtime_error);
+    writer.finish();
+  }
+
+  LocalZip zip(archive_path);
+  REQUIRE(zip.open());
+  const auto& directory{zip.get_directory()};
+  REQUIRE(directory.get_entries().size() == 3U);
+
+  const auto* const small_entry{directory.find("small")};
+  REQUIRE(small_entry != nullptr);
+  CHECK(small_entry->method == ZipDirectory::Method::STORED);
+  // High 16 bits of external attributes are Unix mode.
+  CHECK(((small_entry->external_attrs >> 16U) &
+         static_cast<unsigned>(perms::owner_exec)) != 0U);
+
+  const array<pair<string, string>, 3U> entries{{
+    {"dir/large", large_content}, {"small", "small"}, {"empty", ""}
+  }};
+  for (const auto& [name, content] : entries) {
+    const auto* const entry{directory.find(name)};
+    REQUIRE(entry != nullptr);
+    const auto output_path{dir / "output"};
+    zip.extract(*entry, output_path);
+    CHECK(TestData::read_file(output_path) == content);
+    // Stored data is copied by the kernel apart from calculating CRC-32,
+    // so the latter is verified by reading.
+    CHECK_NOTHROW(zip.read_entry(*entry, [] (const char*, size_t) {}));
+  }
+}
+
+TEST_CASE("Write a compressed ZIP archive") {
+  // Spans several blocks, which are deflated independently.
+  constexpr size_t LARGE_FILE_SIZE{(5U << 20U) + 1U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto archive_path{dir / "archive.zip"};
+
+  string large_content(LARGE_FILE_SIZE, '\0');
+  for (size_t i{}; i != large_content.size(); ++i) {
+    large_content[i] = static_cast<char>('a' + i % 13U);
+  }
+  mt19937 engine;
+  const auto random_content{TestData::make_random(1U << 16U, engine)};
+  const string image_content(1U << 10U, 'a');
+  ofstream(dir / "large") << large_content;
+  ofstream(dir / "random") << random_content;
+  ofstream(dir / "image.PNG") << image_content;
+
+  for (const auto compression :
+       {ZipWriter::Compression::FAST, ZipWriter::Compression::MAXIMUM}) {
+    ZipWriter writer(archive_path, compression);
+    writer.add("large", dir / "large");
+    writer.add("random", dir / "random");
+    writer.add("image.PNG", dir / "image.PNG");
+    writer.finish();
+
+    LocalZip zip(archive_path);
+    REQUIRE(zip.open());
+    const auto& directory{zip.get_directory()};
+    const array<tuple<string, string, ZipDirectory::Method>, 3U> entries{{
+      {"large", large_content, ZipDirectory::Method::DEFLATED},
+      // Already compressed data is stored.
+      {"random", random_content, ZipDirectory::Method::STORED},
+      {"image.PNG", image_content, ZipDirectory::Method::STORED}
+    }};
+    for (const auto& [name, content, method] : entries) {
+      const auto* const entry{directory.find(name)};
+      REQUIRE(entry != nullptr);
+      CHECK(entry->method == method);
+      // Extraction verifies CRC-32 of deflated data.
+      const auto output_path{dir / "output"};
+      zip.extract(*entry, output_path);
+      CHECK(TestData::read_file(output_path) == content);
+    }
+    CHECK(directory.find("large")->compressed_size < LARGE_FILE_SIZE / 100U);
+  }
+}
+
+TEST_CASE("Copy entries between ZIP archives") {
+  constexpr size_t LARGE_FILE_SIZE{(2U << 20U) + 1U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto
+      previous_path{dir / "previous.zip"},
+      archive_path{dir / "archive.zip"};
+
+  string large_content(LARGE_FILE_SIZE, '\0');
+  mt19937 engine;
+  for (auto& c : large_content) {
+    c = static_cast<char>('a' + engine() % 4U);
+  }
+  ofstream(dir / "large") << large_content;
+  ofstream(dir / "unchanged") << large_content.substr(0U, 1U << 16U);
+  ofstream(dir / "changed") << "old";
+  {
+    ZipWriter writer(previous_path, ZipWriter::Compression::MAXIMUM);
+    writer.add("large", dir / "large");
+    writer.add("unchanged", dir / "unchanged");
+    writer.add("changed", dir / "changed");
+    writer.finish();
+  }
+  LocalZip previous_zip(previous_path);
+  REQUIRE(previous_zip.open());
+  const auto& previous_directory{previous_zip.get_directory()};
+
+  // Same size, but different content.
+  ofstream(dir / "changed") << "new";
+  {
+    // Files are compressed differently with the fast level, so reused
+    // entries can be distinguished by their compressed sizes.
+    ZipWriter writer(archive_path, ZipWriter::Compression::FAST);
+    CHECK_FALSE(writer.reuse(dir / "missing.zip"));
+    REQUIRE(writer.reuse(previous_path));
+    writer.copy(previous_zip, *previous_directory.find("large"));
+    writer.add("unchanged", dir / "unchanged");
+    writer.add("changed", dir / "changed");
+    writer.add("new", dir / "large");
+    writer.finish();
+  }
+
+  LocalZip zip(archive_path);
+  REQUIRE(zip.open());
+  const auto& directory{zip.get_directory()};
+  const array<tuple<string, string, bool>, 4U> entries{{
+    {"large", large_content, true},
+    {"unchanged", large_content.substr(0U, 1U << 16U), true},
+    {"changed", "new", false},
+    // Only entries with the same name are reused.
+    {"new", large_content, false}
+  }};
+  for (const auto& [name, content, is_copied] : entries) {
+    const auto* const entry{directory.find(name)};
+    REQUIRE(entry != nullptr);
+    const auto* const previous_entry{previous_directory.find(
+        name == "new" ? "large" : name)};
+    REQUIRE(previous_entry != nullptr);
+    CHECK((entry->compressed_size == previous_entry->compressed_size &&
+           entry->crc32 == previous_entry->crc32) == is_copied);
+
+    const auto output_path{dir / "output"};
+    zip.extract(*entry, output_path);
+    CHECK(TestData::read_file(output_path) == content);
+  }
+}
+
+TEST_CASE("Update a ZIP archive in place") {
+  constexpr size_t LARGE_FILE_SIZE{1U << 18U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto archive_path{dir / "archive.zip"};
+
+  // Random data is stored, so it takes most of the archive.
+  mt19937 engine;
+  auto large_content{TestData::make_random(LARGE_FILE_SIZE, engine)};
+  ofstream(dir / "large") << large_content;
+  ofstream(dir / "changed") << "old content";
+  ofstream(dir / "removed") << "removed";
+  {
+    // Nothing to update, so the archive is created.
+    ZipWriter writer(archive_path, ZipWriter::Compression::FAST, true);
+    writer.add("large", dir / "large");
+    writer.add("changed", dir / "changed");
+    writer.add("removed", dir / "removed");
+    writer.finish();
+  }
+  const auto get_offset{[&archive_path] (const string& name) {
+    LocalZip zip(archive_path);
+    REQUIRE(zip.open());
+    const auto* const entry{zip.get_directory().find(name)};
+    REQUIRE(entry != nullptr);
+    return entry->local_header_offset;
+  }};
+  const auto large_offset{get_offset("large")};
+  const auto changed_offset{get_offset("changed")};
+
+  const auto check_entries{[&] (const vector<pair<string, string>>& entries) {
+    LocalZip zip(archive_path);
+    REQUIRE(zip.open());
+    CHECK(zip.get_directory().get_entries().size() == entries.size());
+    for (const auto& [name, content] : entries) {
+      const auto* const entry{zip.get_directory().find(name)};
+      REQUIRE(entry != nullptr);
+      const auto output_path{dir / "output"};
+      zip.extract(*entry, output_path);
+      CHECK(TestData::read_file(output_path) == content);
+      // CRC-32 of a changed file is taken from the check against the old
+      // entry, so it must match the written data.
+      CHECK_NOTHROW(zip.read_entry(*entry, [] (const char*, size_t) {}));
+    }
+  }};
+
+  ofstream(dir / "changed") << "new content";
+  ofstream(dir / "added") << "added";
+  {
+    ZipWriter writer(archive_path, ZipWriter::Compression::FAST, true);
+    writer.add("large", dir / "large");
+    writer.add("changed", dir / "changed");
+    writer.add("added", dir / "added");
+    writer.finish();
+  }
+  check_entries({{"large", large_content},
+                 {"changed", "new content"}, {"added", "added"}});
+  // Unchanged data stays in place, changed one is appended.
+  CHECK(get_offset("large") == large_offset);
+  CHECK(get_offset("changed") > changed_offset);
+
+  // Stale data of the large file takes half of the archive.
+  large_content = TestData::make_random(LARGE_FILE_SIZE, engine);
+  ofstream(dir / "large") << large_content;
+  {
+    ZipWriter writer(archive_path, ZipWriter::Compression::FAST, true);
+    writer.add("large", dir / "large");
+    writer.add("changed", dir / "changed");
+    writer.finish();
+  }
+  check_entries({{"large", large_content}, {"changed", "new content"}});
+  CHECK(file_size(archive_path) < LARGE_FILE_SIZE + LARGE_FILE_SIZE / 4U);
+}
+
+TEST_CASE("Align stored entries") {
+  constexpr size_t
+      PAGE_ALIGNMENT{4096U},
+      LARGE_FILE_SIZE{1U << 16U};
+  const TmpDir tmp_dir;
+  const auto dir{tmp_dir.get_entry().path()};
+  const auto archive_path{dir / "archive.zip"};
+
+  mt19937 engine;
+  auto large_content{TestData::make_random(LARGE_FILE_SIZE, engine)};
+  ofstream(dir / "large") << large_content;
+  // Compressible, but it must be stored to be aligned.
+  const string library_content(LARGE_FILE_SIZE, 'l');
+  ofstream(dir / "library") << library_content;
+  ofstream(dir / "odd") << "odd";
+
+  const auto write_archive{[&] (const bool update) {
+    ZipWriter writer(archive_path, ZipWriter::Compression::FAST, update);
+    writer.add("large", dir / "large");
+    writer.add("lib/x86/libapp.so", dir / "library", PAGE_ALIGNMENT);
+    writer.add("odd", dir / "odd");
+    CHECK_THROWS_AS(writer.add("invalid", dir / "odd", 3U), runtime_error);
+    writer.finish();
+  }};
+  const auto check_entries{[&] {
+    LocalZip zip(archive_path);
+    REQUIRE(zip.open());
+    const auto& directory{zip.get_directory()};
+    const array<tuple<string, string, size_t>, 3U> entries{{
+      {"large", large_content, ZipWriter::DEFAULT_ALIGNMENT},
+      {"lib/x86/libapp.so", library_content, PAGE_ALIGNMENT},
+      {"odd", "odd", ZipWriter::DEFAULT_ALIGNMENT}
+    }};
+    for (const auto& [name, content, alignment] : entries) {
+      const auto* const entry{directory.find(name)};
+      REQUIRE(entry != nullptr);
+      CHECK(entry->method == ZipDirectory::Method::STORED);
+      CHECK(zip.get_data_offset(*entry) % alignment == 0U);
+      const auto output_path{dir / "output"};
+      zip.extract(*entry, output_path);
+      CHECK(TestData::read_file(output_path) == content);
+    }
+  }};
+  const auto get_library_offset{[&archive_path] {
+    LocalZip zip(archive_path);
+    REQUIRE(zip.open());
+    const auto* const entry{zip.get_directory().find("lib/x86/libapp.so")};
+    REQUIRE(entry != nullptr);
+    return entry->local_header_offset;
+  }};
+  write_archive(false);
+  check_entries();
+  const auto library_offset{get_library_offset()};
+
+  // Replaced data of the first entry takes half of the archive, so the
+  // library is moved towards the beginning on compaction.
+  large_content = TestData::make_random(LARGE_FILE_SIZE, engine);
+  ofstream(dir / "large") << large_content;
+  write_archive(true);
+  check_entries();
+  CHECK(get_library_offset() < library_offset);
+}